@@ -278,7 +278,6 @@ static byte cur_memory;
 static struct Button buttons[ButLast];
 static byte button_divider;
 static unsigned long now;
-static unsigned long last_midi_tick;
 
 static const byte button_pins[ButLast] = {
   GEN_SYNTH1_BUTTON_PIN,
@@ -294,6 +293,11 @@ static const byte button_pins[ButLast] = {
 };
 
 
+// The JUKEBOX writes two acid lines, the voices of the bank beyond those double them: voice v plays line v % 2
+static inline bool doubles_line(int v, byte chan) {
+  return v >= 2 && VoiceBank::GetChannel(v % 2) == chan;
+}
+
 static void send_midi_noteon(byte chan, byte note, byte vol) {
 #ifdef MIDI_VIA_SERIAL  
   MIDI.sendNoteOn(note, vol, chan);
@@ -302,6 +306,7 @@ static void send_midi_noteon(byte chan, byte note, byte vol) {
   MIDI2.sendNoteOn(note, vol, chan);
 #endif
   handleNoteOn( chan, note, vol) ;
+  for (int v = 2; v < SYNTH_VOICES; v++) if (doubles_line(v, chan)) handleNoteOn(VoiceBank::GetChannel(v), note, vol);
 }
 
 static void send_midi_noteoff(byte chan, byte note) {
@@ -312,6 +317,7 @@ static void send_midi_noteoff(byte chan, byte note) {
   MIDI2.sendNoteOn(note, 0, chan);
 #endif
   handleNoteOff( chan, note, 0) ;
+  for (int v = 2; v < SYNTH_VOICES; v++) if (doubles_line(v, chan)) handleNoteOff(VoiceBank::GetChannel(v), note, 0);
 }
 
 static void init_midi() {
@@ -330,6 +336,7 @@ static void init_midi() {
 static void send_midi_control(byte chan, byte cc_number, byte cc_value) {
   //MIDI.sendControlChange (  cc_number,  cc_value,  chan);
   handleCC( chan,  cc_number,  cc_value);
+  for (int v = 2; v < SYNTH_VOICES; v++) if (doubles_line(v, chan)) handleCC(VoiceBank::GetChannel(v), cc_number, cc_value);
 }
 
 /*
@@ -473,11 +480,20 @@ void sequencer_step(byte step) {
     //    instr_noteon_raw(NumInstruments-1, CRASH_NOTE, 127, 0);
     if (flip(30)) {
       //change drumkit
+#ifdef PRELOAD_ALL
       current_drumkit = myRandom(((Drums.GetSamplesCount()-1)/12)) * 12 ;
       
 //#ifdef DEBUG_JUKEBOX
       DEBF("Selected drumkit: %d\r\n" , current_drumkit);
 //#endif
+#else
+      // only one kit is in memory, the sampler loads the next one in the background
+      if (Drums.GetKitCount() > 0) {
+        uint8_t kit = Drums.GetKit(myRandom(Drums.GetKitCount()));
+        Drums.SetProgram(kit);
+        DEBF("Selected drumkit: %d\r\n" , kit);
+      }
+#endif
     }
 #ifdef DEBUG_JUKEBOX
     DEBUG("CRASH!!!!!!!!!!!!!!!!!!!!!");
@@ -897,17 +913,30 @@ void init_patterns() {
 
 /*
    MIDI clock
+   Ticks are counted on the audio sample clock (see midiTimestamp()), not in millis(). run_tick() plays every tick
+   that falls within the lookahead, and the tick's events carry its exact sample time, so loop()'s scheduling
+   jitter never reaches the groove. The fractional part of the tick length is carried over, so any BPM keeps time.
 */
 
 #define MIDI_TICKS_PER_16TH 1
+#define MIDI_TICK_LOOKAHEAD (DMA_BUF_LEN * 8)   // samples: ticks are handed to the engines this early, must cover loop()'s jitter
 
 static byte midi_playing, midi_tick, midi_step;
-const float tick_coef = 1000ul * 15 / MIDI_TICKS_PER_16TH;
-static unsigned long midi_tick_ms = tick_coef / bpm;
+const float tick_coef = (float)SAMPLE_RATE * 15.0f / MIDI_TICKS_PER_16TH;
+static float midi_tick_samples = tick_coef / bpm;  // tick length, samples
+static uint32_t midi_tick_time = 0;                 // sample clock of the next tick
+static float midi_tick_frac = 0.0f;                 // ... and how far the true tick is off it
 
 inline void set_bpm(float newBpm) {
   bpm = newBpm;
-  midi_tick_ms = tick_coef / newBpm;
+  midi_tick_samples = tick_coef / newBpm;
+}
+
+static void advance_midi_tick_time() {
+  midi_tick_frac += midi_tick_samples;
+  uint32_t whole = (uint32_t)(midi_tick_frac + 0.5f); // nearest sample, the fraction stays within +-0.5
+  midi_tick_time += whole;
+  midi_tick_frac -= (float)whole;
 }
 
 static void decide_on_break() {
@@ -995,6 +1024,8 @@ static void decide_on_break() {
 
 static void do_midi_start() {
   midi_playing = 1;
+  midi_tick_time = midiTimestamp();
+  midi_tick_frac = 0.0f;
   midi_tick = MIDI_TICKS_PER_16TH - 1;
   midi_step = -1;
   send_midi_control(SYNTH1_MIDI_CHAN, 10, 10);
@@ -1250,11 +1281,9 @@ void run_ui() {
       do_midi_stop();
     } else {
 #ifdef DEBUG_JUKEBOX
-      DEBF("starting midi clock, dt=%lu", midi_tick_ms);
+      DEBF("starting midi clock, dt=%0.2f samples", midi_tick_samples);
 #endif
-      last_midi_tick = now;
       do_midi_start();
-      do_midi_tick();
     }
   }
 }
@@ -1272,13 +1301,19 @@ void run_tick() {
     
   }
 
-  /* If MIDI is playing, then check for tick */
-  if (midi_playing && (now - last_midi_tick) >= midi_tick_ms) {
-    do_midi_tick();
-    last_midi_tick += midi_tick_ms;
-    if (last_midi_tick < now) {
+  /* If MIDI is playing, then play the ticks that are due within the lookahead, each at its own sample time */
+  if (midi_playing) {
+    uint32_t now_sample = midiTimestamp();
+    if ((int32_t)(now_sample - midi_tick_time) > (int32_t)midi_tick_samples) {
       /* we are at least one tick late, give up */
-      last_midi_tick = now;
+      midi_tick_time = now_sample;
+      midi_tick_frac = 0.0f;
+    }
+    while ((int32_t)(midi_tick_time - (now_sample + MIDI_TICK_LOOKAHEAD)) < 0) {
+      midiStampAt(midi_tick_time);
+      do_midi_tick();
+      midiStampNow();
+      advance_midi_tick_time();
     }
   }
 }
@@ -28,6 +28,11 @@
 #include "compressor.h"
 #include "synthvoice.h"
 #include "sampler.h"
+#include "midi_queue.h"
+#include "audio_ring.h"
+#include "voice_bank.h"
+#include "synth_kernel.h"
+#include "load_balancer.h"
 #include <Wire.h>
 
 // LCD driver for M5Stack Core S3
@@ -71,9 +76,9 @@ MIDI_NAMESPACE::MidiInterface<MIDI_NAMESPACE::SerialMIDI<HardwareSerial, Serial2
 static float midi_pitches[128];
 static float midi_phase_steps[128];
 static float midi_tbl_steps[128];
-static float exp_square_tbl[TABLE_SIZE+1];
 //static float square_tbl[TABLE_SIZE+1];
 static float saw_tbl[TABLE_SIZE+1];
+static float saw_mipmaps[WAVE_MIPMAP_FLOATS]; // band-limited saw_tbl, one level per octave of the phase step, see mipmapTable()
 static float exp_tbl[TABLE_SIZE+1];
 static float knob_tbl[TABLE_SIZE+1]; // exp-like curve
 static float shaper_tbl[TABLE_SIZE+1]; // illinear tanh()-like curve
@@ -81,10 +86,11 @@ static float lim_tbl[TABLE_SIZE+1]; // diode soft clipping at about 1.0
 static float sin_tbl[TABLE_SIZE+1];
 static float norm1_tbl[16][16]; // cutoff-reso pair gain compensation
 static float norm2_tbl[16][16]; // wavefolder-overdrive gain compensation
+#define NORM_TBL_KMAP 0.1181f     // maps 0-127 to 0-14.99, the cell coordinates of norm1_tbl and norm2_tbl
 //static float (*tables[])[TABLE_SIZE+1] = {&exp_square_tbl, &square_tbl, &saw_tbl, &exp_tbl};
 
 // service variables and arrays
-volatile uint32_t s1t, s2t, drt, fxt, s1T, s2T, drT, fxT, art, arT, c0t, c0T, c1t, c1T; // debug timing: if we use less vars, compiler optimizes them
+volatile uint32_t drt, fxt, drT, fxT, art, arT, c0t, c0T, c1t, c1T; // debug timing: if we use less vars, compiler optimizes them
 volatile uint32_t prescaler;
 static  uint32_t  last_reset = 0;
 static  float     param[POT_NUM];
@@ -92,33 +98,27 @@ static uint8_t    ctrl_hold_notes;
 
 
 // Audio buffers of all kinds
-volatile uint8_t current_gen_buf = 0; // set of buffers for generation
-volatile uint8_t current_out_buf = 1 - 0; // set of buffers for output
-static float synth1_buf[2][DMA_BUF_LEN];    // synth1 mono
-static float synth2_buf[2][DMA_BUF_LEN];    // synth2 mono
-static float drums_buf_l[2][DMA_BUF_LEN];   // drums L
-static float drums_buf_r[2][DMA_BUF_LEN];   // drums R
-static float mix_buf_l[2][DMA_BUF_LEN];     // mix L channel
-static float mix_buf_r[2][DMA_BUF_LEN];     // mix R channel
+AudioRing<AUDIO_STAGES> Audio;              // generators' output, see audio_ring.h
+LoadBalancer Balancer;                      // which core renders which engine, see load_balancer.h
+static float mix_buf_l[DMA_BUF_LEN];        // mix L channel
+static float mix_buf_r[DMA_BUF_LEN];        // mix R channel
 static union {                              // a dirty trick, instead of true converting
   int16_t _signed[DMA_BUF_LEN * 2];
   uint16_t _unsigned[DMA_BUF_LEN * 2];
-} out_buf[2];                               // i2s L+R output buffer
+} out_buf;                                  // i2s L+R output buffer
 size_t bytes_written;                       // i2s result
 
 volatile boolean processing = false;
-#ifndef NO_PSRAM
-volatile float rvb_k1, rvb_k2, rvb_k3;
-#endif
-volatile float dly_k1, dly_k2, dly_k3;
 
 // tasks for Core0 and Core1
 TaskHandle_t SynthTask1;
 TaskHandle_t SynthTask2;
 
-// 303-like synths
-SynthVoice Synth1(0); // instance 0 to recognize from the inside
-SynthVoice Synth2(1); // instance 1 to recognize from the inside
+// 303-like synths, SYNTH_VOICES of them
+VoiceBank Synths;
+#ifdef SYNTH_KERNEL
+SynthKernel Kernels[AUDIO_PRODUCERS];       // one per core, for the voices it renders
+#endif
 
 // 808-like drums
 Sampler Drums( DEFAULT_DRUMKIT ); // argument: starting drumset [0 .. total-1]
@@ -130,6 +130,15 @@ FxReverb Reverb;
 #endif
 Compressor Comp;
 
+// MIDI events on their way from loop() to the audio tasks, one queue per consumer (the voices have theirs in the bank)
+MidiQueue DrumsEvents;
+MidiQueue FxEvents;   // global effects, the mixer applies them
+
+// sample clock: the first sample of the block Core0 is generating, and micros() when its generation started
+volatile uint32_t gen_clock = 0 - DMA_BUF_LEN;
+volatile uint32_t gen_clock_us = 0;
+volatile uint32_t gen_clock_seq = 0;  // odd while the two above are being updated, see midiTimestamp()
+
 hw_timer_t * timer1 = NULL;            // Timer variables
 hw_timer_t * timer2 = NULL;            // Timer variables
 portMUX_TYPE timer1Mux = portMUX_INITIALIZER_UNLOCKED; 
@@ -159,40 +168,112 @@ void IRAM_ATTR onTimer2() {
  * Core Tasks ************************************************************************************************************************
 */
 // forward declaration
-static void IRAM_ATTR mixer() ;
+static void IRAM_ATTR mixer(AudioBlock& block, uint32_t clock) ;
+static void voice_generate(uint8_t v, AudioBlock& block, uint32_t clock) ;
+#ifdef SYNTH_KERNEL
+static int voices_generate(SynthKernel& kernel, uint8_t voices, AudioBlock& block, uint32_t clock) ;
+#endif
+static void drums_generate(AudioBlock& block, uint32_t clock) ;
+
+static inline void set_gen_clock(uint32_t clock) { // Core0, once per block, as it starts generating the block
+  gen_clock_seq = gen_clock_seq + 1;
+  gen_clock = clock;
+  gen_clock_us = micros();
+  gen_clock_seq = gen_clock_seq + 1;
+}
+
+// one engine's part of the block, on whichever core owns the engine now
+static void generate_engine(uint8_t engine, AudioBlock& block, uint32_t clock) {
+  uint32_t t = micros();
+  if (engine == ENGINE_DRUMS) {
+    drums_generate(block, clock);
+    drT = micros() - t;
+  } else {
+    voice_generate(engine, block, clock);
+  }
+  Balancer.AddCost(engine, micros() - t);
+}
+
+#ifdef SYNTH_KERNEL
+// the voices of a core in one go through its kernel, they share the cost evenly
+static void generate_voices(uint8_t core, uint8_t voices, AudioBlock& block, uint32_t clock) {
+  uint32_t t = micros();
+  int count = voices_generate(Kernels[core], voices, block, clock);
+  uint32_t share = (micros() - t) / count;
+  for (uint8_t v = 0; v < SYNTH_VOICES; v++) {
+    if ((voices >> v) & 1) Balancer.AddCost(v, share);
+  }
+}
+#endif
+
+// a core's share of a block: the engines the balancer gives it, into its next free block of the ring
+// false if the ring is full or the other core has to finish first, the next notification brings us back
+static bool core_generate(uint8_t core) {
+  uint32_t clock;
+  AudioBlock* block = Audio.GetFree(core, clock);
+  if (block == NULL) return false;
+  uint32_t n = Audio.GetProduced(core);
+  if (!Balancer.MayStart(n, Audio.GetProduced(1 - core))) return false;
+  if (core == AUDIO_CORE0) {
+    set_gen_clock(clock);
+    Balancer.Plan(n, clock);
+  }
+
+  uint8_t core1Engines = Balancer.GetCore1Engines(n);
+#ifdef SYNTH_KERNEL
+  uint8_t mine = (core == AUDIO_CORE1) ? core1Engines : ~core1Engines;
+  uint8_t voices = mine & ((1 << SYNTH_VOICES) - 1);
+  if (voices) generate_voices(core, voices, *block, clock);
+  if ((mine >> ENGINE_DRUMS) & 1) generate_engine(ENGINE_DRUMS, *block, clock);
+#else
+  for (uint8_t e = 0; e < ENGINES; e++) {
+    if (((core1Engines >> e) & 1) == core) generate_engine(e, *block, clock);
+  }
+#endif
+
+  Audio.Produced(core);
+  if (core == AUDIO_CORE0) xTaskNotifyGive(SynthTask2);
+  return true;
+}
+
+static bool core0_generate() {
+  return core_generate(AUDIO_CORE0);
+}
+
+static bool core1_generate() {
+  return core_generate(AUDIO_CORE1);
+}
+
+// Core1: mix the oldest block and send it to the DAC, false until both cores have finished it
+static bool core1_mix() {
+  uint32_t clock;
+  AudioBlock* block = Audio.GetReady(clock);
+  if (block == NULL) return false;
+
+  fxt = micros();
+  mixer(*block, clock);
+  Balancer.AddMixerCost(micros() - fxt);
+  i2s_output();
+  fxT = micros() - fxt;
+
+  Audio.Mixed();
+  xTaskNotifyGive(SynthTask1);
+  return true;
+}
+
 // Core0 task 
 // static void audio_task1(void *userData) {
 static void IRAM_ATTR audio_task1(void *userData) {
   
   while (true) {
     taskYIELD(); 
-    if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) { // we need all the generators to fill the buffers here, so we wait
+    if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) { // the mixer has freed a block
       c0t = micros();
-      
-//      taskYIELD(); 
-      
-      current_gen_buf = current_out_buf;      // swap buffers
-      current_out_buf = 1 - current_gen_buf;
-      
-      xTaskNotifyGive(SynthTask2);            // if we are here, then we've already received a notification from task2
-      
-      s1t = micros();
-      synth1_generate();
-      s1T = micros() - s1t;
-      
-  //    taskYIELD(); 
-
-      drt = micros();
-      drums_generate();
-      drT = micros() - drt;
-
+      while (core0_generate()) {              // run ahead as far as the ring allows
+        taskYIELD();
+      }
+      c0T = micros() - c0t;
     }
-    
-   // taskYIELD();
-
-    taskYIELD();
-
-    c0T = micros() - c0t;
   }
 }
 
@@ -204,33 +285,20 @@ static void IRAM_ATTR audio_task2(void *userData) {
     
     if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) { // wait for the notification from the SynthTask1
       c1t = micros();
-      fxt = micros();
-      mixer(); 
-      i2s_output();
-      fxT = micros() - fxt;
-      
-      taskYIELD();
-    
-      s2t = micros();
-      synth2_generate();
-      s2T = micros() - s2t;
-      
-      xTaskNotifyGive(SynthTask1); 
+      while (core1_mix() || core1_generate()) { // the output comes first, Core1's engines fill the ring in between
+        taskYIELD();
+      }
+      c1T = micros() - c1t;
     }    
-    
-    c1T = micros() - c1t;
 
     art = micros();
     
     if (timer2_fired) {
       timer2_fired = false;
 
-#ifdef TEST_POTS      
-       readPots();
-#endif
-       
 #ifdef DEBUG_TIMING
-        DEBF ("synt1=%dus synt2=%dus drums=%dus mixer=%dus DMA_BUF=%dus\r\n" , s1T, s2T, drT, fxT, DMA_BUF_TIME);
+        DEBF ("drums=%dus mixer=%dus DMA_BUF=%dus\r\n" , drT, fxT, DMA_BUF_TIME);
+        Balancer.Report(); // per voice
         //    DEBF ("TaskCore0=%dus TaskCore1=%dus DMA_BUF=%dus\r\n" , c0T , c1T , DMA_BUF_TIME);
         //    DEBF ("AllTheRestCore1=%dus\r\n" , arT);
 #endif
@@ -268,14 +336,14 @@ void setup(void) {
 
   for (int i = 0; i < POT_NUM; i++) pinMode( POT_PINS[i] , INPUT);
 
-  Synth1.Init();
-  Synth2.Init();
+  Synths.Init();
   Drums.Init();
 #ifndef NO_PSRAM
   Reverb.Init();
 #endif
   Delay.Init();
   Comp.Init(SAMPLE_RATE);
+  Balancer.Init(0xAA & ((1 << SYNTH_VOICES) - 1)); // start with the classic split: even voices and drums on Core0, odd voices and the mixer on Core1
 #ifdef JUKEBOX
   init_midi(); // AcidBanger function
 #endif
@@ -300,23 +368,21 @@ void setup(void) {
 
   // silence while we haven't loaded anything reasonable
   for (int i = 0; i < DMA_BUF_LEN; i++) {
-    drums_buf_l[current_gen_buf][i] = 0.0f ;
-    drums_buf_r[current_gen_buf][i] = 0.0f ;
-    synth1_buf[current_gen_buf][i] = 0.0f ;
-    synth2_buf[current_gen_buf][i] = 0.0f ;
-    out_buf[current_out_buf]._signed[i * 2] = 0 ;
-    out_buf[current_out_buf]._signed[i * 2 + 1] = 0 ;
-    mix_buf_l[current_out_buf][i] = 0.0f;
-    mix_buf_r[current_out_buf][i] = 0.0f;
+    out_buf._signed[i * 2] = 0 ;
+    out_buf._signed[i * 2 + 1] = 0 ;
+    mix_buf_l[i] = 0.0f;
+    mix_buf_r[i] = 0.0f;
   }
 
   i2sInit();
-  // i2s_write(i2s_num, out_buf[current_out_buf]._signed, sizeof(out_buf[current_out_buf]._signed), &bytes_written, portMAX_DELAY);
+  // i2s_write(i2s_num, out_buf._signed, sizeof(out_buf._signed), &bytes_written, portMAX_DELAY);
+  DEBF("Audio ring: %d stages, generators run up to %u samples (%0.2f ms) ahead of the output\r\n",
+       AUDIO_STAGES, Audio.GetLatency(), 1000.0f * (float)Audio.GetLatency() / (float)SAMPLE_RATE);
 
   //xTaskCreatePinnedToCore( audio_task1, "SynthTask1", 8000, NULL, (1 | portPRIVILEGE_BIT), &SynthTask1, 0 );
   //xTaskCreatePinnedToCore( audio_task2, "SynthTask2", 8000, NULL, (1 | portPRIVILEGE_BIT), &SynthTask2, 1 );
-  xTaskCreatePinnedToCore( audio_task1, "SynthTask1", 5000, NULL, 1, &SynthTask1, 0 );
-  xTaskCreatePinnedToCore( audio_task2, "SynthTask2", 5000, NULL, 1, &SynthTask2, 1 );
+  xTaskCreatePinnedToCore( audio_task1, "SynthTask1", 5000, NULL, AUDIO_TASK_PRIORITY, &SynthTask1, 0 );
+  xTaskCreatePinnedToCore( audio_task2, "SynthTask2", 5000, NULL, AUDIO_TASK_PRIORITY, &SynthTask2, 1 );
 
   // somehow we should allow tasks to run
   xTaskNotifyGive(SynthTask1);
@@ -361,7 +427,11 @@ void loop() { // default loopTask running on the Core1
  *  Some debug and service routines *****************************************************************************************************************************
 */
 
-void readPots() {
+#if defined(TEST_POTS) && POT_SYNTH_VOICE >= SYNTH_VOICES
+#error "POT_SYNTH_VOICE has to be one of the SYNTH_VOICES"
+#endif
+
+void readPots() { // called from loop(), the pots go through the same MIDI queues as the MIDI handlers
   static const float snap = 0.003f;
   static uint8_t i = 0;
   static float tmp;
@@ -382,23 +452,24 @@ void paramChange(uint8_t paramNum, float paramVal) {
   // paramVal === param[paramNum];
   DEBF ("param %d val %0.4f\r\n" , paramNum, paramVal);
   paramVal *= 127.0;
+  MidiQueue* synth = &Synths.Events(POT_SYNTH_VOICE);
   switch (paramNum) {
     case 0:
       //set_bpm( 40.0f + (paramVal * 160.0f));
-      Synth2.ParseCC(CC_303_CUTOFF, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_CUTOFF, paramVal);
       break;
     case 1:
-      Synth2.ParseCC(CC_303_RESO, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_RESO, paramVal);
       break;
     case 2:
-      Synth2.ParseCC(CC_303_OVERDRIVE, paramVal);
-      Synth2.ParseCC(CC_303_DISTORTION, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_OVERDRIVE, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_DISTORTION, paramVal);
       break;
     case 3:
-      Synth2.ParseCC(CC_303_ENVMOD_LVL, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_ENVMOD_LVL, paramVal);
       break;
     case 4:
-      Synth2.ParseCC(CC_303_ACCENT_LVL, paramVal);
+      midiPush(synth, MIDI_EVENT_CC, CC_303_ACCENT_LVL, paramVal);
       break;
     default:
       {}
@@ -429,5 +500,12 @@ void regular_checks() {
   jukebox_tick();
 #endif
 
+#ifdef TEST_POTS
+  static uint32_t last_pots = 0;
+  if (millis() - last_pots >= 200) { // one pot every 200 ms
+    last_pots = millis();
+    readPots();
+  }
+#endif
 
 }
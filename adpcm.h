@@ -0,0 +1,155 @@
+/*
+ * IMA-ADPCM sample store for the sampler (SAMPLER_ADPCM in config.h).
+ *
+ * 4 bits per frame instead of 16, so a cache region holds about four times the sample time. The sampler encodes
+ * the 16 bit PCM while it loads a kit and every sounding voice decodes its sample as it plays, with its own
+ * AdpcmDecoder. ADPCM only runs forward, so the data is cut in blocks of ADPCM_BLOCK frames and each block
+ * starts with a seek point, the decoder state just before its first frame:
+ *
+ *     int16 predictor, uint8 step index, uint8 0      4 bytes
+ *     ADPCM_BLOCK nibbles, low nibble first           ADPCM_BLOCK / 2 bytes
+ *
+ * A voice that starts at an offset (offset_midi) jumps to the seek point of its block and decodes from there.
+ * The encoder runs through the block headers without a reset, so a voice that plays on decodes the same values.
+ * Each decoder keeps its last ADPCM_HISTORY frames for the interpolation taps (sample_interp.h).
+ */
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ADPCM_BLOCK         256                       // frames between two seek points
+#define ADPCM_BLOCK_BYTES   ( 4 + ADPCM_BLOCK / 2 )
+#define ADPCM_HISTORY       8                         // decoded frames a voice keeps, a power of 2
+
+static const int16_t adpcm_steps[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcm_index[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// bytes that frames of PCM take as ADPCM blocks
+static inline size_t AdpcmBytes( size_t frames ) {
+  return ( frames + ADPCM_BLOCK - 1 ) / ADPCM_BLOCK * ADPCM_BLOCK_BYTES;
+}
+
+// the reconstruction step that encoder and decoder share, so both always hold the same state
+static inline void AdpcmStep( int32_t &pred, int32_t &index, int n ) {
+  int32_t step = adpcm_steps[index];
+  int32_t diff = step >> 3;
+  if ( n & 4 ) diff += step;
+  if ( n & 2 ) diff += step >> 1;
+  if ( n & 1 ) diff += step >> 2;
+  pred += ( n & 8 ) ? -diff : diff;
+  if ( pred > 32767 ) pred = 32767; else if ( pred < -32768 ) pred = -32768;
+  index += adpcm_index[n];
+  if ( index < 0 ) index = 0; else if ( index > 88 ) index = 88;
+}
+
+class AdpcmEncoder {
+  public:
+    AdpcmEncoder() {}
+
+    // out needs AdpcmBytes(frames) bytes
+    void Begin( uint8_t* out ) {
+      _out = out;
+      _frame = 0;
+      _pred = 0;
+      _index = 0;
+    }
+
+    inline void Push( int16_t x ) {
+      if ( _frame % ADPCM_BLOCK == 0 ) {
+        _out[0] = _pred & 0xFF;
+        _out[1] = ( _pred >> 8 ) & 0xFF;
+        _out[2] = _index;
+        _out[3] = 0;
+        _out += 4;
+      }
+      int32_t diff = x - _pred;
+      int32_t step = adpcm_steps[_index];
+      int n = 0;
+      if ( diff < 0 ) {
+        n = 8;
+        diff = -diff;
+      }
+      if ( diff >= step ) { n |= 4; diff -= step; }
+      step >>= 1;
+      if ( diff >= step ) { n |= 2; diff -= step; }
+      step >>= 1;
+      if ( diff >= step ) { n |= 1; }
+      AdpcmStep( _pred, _index, n );
+      if ( _frame & 1 ) {
+        *_out++ |= n << 4;
+      } else {
+        *_out = n;
+      }
+      _frame++;
+    }
+
+    // pads the last block with silent nibbles
+    void End() {
+      if ( _frame & 1 ) _out++;
+      uint32_t k = ( _frame + 1 ) / 2 * 2 % ADPCM_BLOCK;
+      while ( k != 0 && k < ADPCM_BLOCK ) {
+        *_out++ = 0;
+        k += 2;
+      }
+    }
+
+  private:
+    uint8_t* _out;
+    uint32_t _frame;
+    int32_t _pred;
+    int32_t _index;
+};
+
+// one per voice: decodes forward to whatever frame the playback position asks for, silence after the end
+struct AdpcmDecoder {
+  int32_t pred;   // value of frame pos - 1
+  int32_t index;
+  uint32_t pos;   // next frame to decode
+  uint32_t end;   // frames in the sample
+  int16_t hist[ 2 * ADPCM_HISTORY ]; // every frame twice, so the last ADPCM_HISTORY frames always lie side by side
+
+  // goes to the seek point of frame's block and decodes up to just before frame
+  inline void Seek( const uint8_t* data, uint32_t frame, uint32_t frames ) {
+    const uint8_t* b = data + frame / ADPCM_BLOCK * ADPCM_BLOCK_BYTES;
+    pred = (int16_t)( b[0] | ( b[1] << 8 ) );
+    index = b[2];
+    pos = frame - frame % ADPCM_BLOCK;
+    end = frames;
+    for ( int k = 0; k < 2 * ADPCM_HISTORY; k++ ) hist[k] = 0;
+    while ( pos < frame ) Next( data );
+  }
+
+  inline void Next( const uint8_t* data ) {
+    int16_t x = 0;
+    if ( pos < end ) {
+      uint32_t k = pos % ADPCM_BLOCK;
+      uint8_t b = data[ pos / ADPCM_BLOCK * ADPCM_BLOCK_BYTES + 4 + ( k >> 1 ) ];
+      AdpcmStep( pred, index, ( b >> ( ( k & 1 ) << 2 ) ) & 15 );
+      x = pred;
+    }
+    hist[ pos % ADPCM_HISTORY ] = hist[ pos % ADPCM_HISTORY + ADPCM_HISTORY ] = x;
+    pos++;
+  }
+
+  // decodes up to frame + ahead and points at frame in the history, with ADPCM_HISTORY - 1 - ahead frames
+  // before it. frame must not go back behind the last one asked for.
+  inline const int16_t* Window( const uint8_t* data, uint32_t frame, int ahead ) {
+    while ( pos <= frame + ahead ) Next( data );
+    return &hist[ ( frame + ahead + 1 ) % ADPCM_HISTORY + ADPCM_HISTORY - 1 - ahead ];
+  }
+
+  inline int32_t Get( const uint8_t* data, uint32_t frame ) {
+    return *Window( data, frame, 0 );
+  }
+};
+
+#endif
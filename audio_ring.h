@@ -0,0 +1,74 @@
+/*
+ * Ring of audio blocks between the generators and the mixer.
+ *
+ * The engines (the 303 voices and the drums) are rendered by both cores, and Core1 mixes. Every block of the ring
+ * holds one DMA buffer worth of each engine's output. Both producers fill blocks in order, as far ahead as the ring
+ * allows, and the mixer takes a block once both have finished it. With STAGES blocks the generators may run
+ * STAGES-1 blocks ahead of the mixer, so a slow block (a kit change, an LCD redraw) is absorbed instead of
+ * starving the I2S output, at the price of (STAGES-1)*DMA_BUF_LEN samples of latency.
+ *
+ * Each counter has exactly one writer, so no locks are needed. Block n starts at sample clock n*DMA_BUF_LEN.
+ */
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <atomic>
+
+enum eAudioProducer_t {AUDIO_CORE0, AUDIO_CORE1, AUDIO_PRODUCERS};
+
+struct AudioBlock {
+  float synth[SYNTH_VOICES][DMA_BUF_LEN];   // 303 voices, mono
+  float drums_l[DMA_BUF_LEN];   // drums L
+  float drums_r[DMA_BUF_LEN];   // drums R
+  float drums_dly_l[DMA_BUF_LEN], drums_dly_r[DMA_BUF_LEN];   // what the drum buses send to the delay
+  float drums_rvb_l[DMA_BUF_LEN], drums_rvb_r[DMA_BUF_LEN];   // ... and to the reverb
+  float drums_side[DMA_BUF_LEN];                              // ... and to the compressor's side-chain
+};
+
+template <int STAGES>
+class AudioRing {
+  public:
+    static_assert(STAGES >= 2 && STAGES <= 4, "the audio ring takes 2, 3 or 4 stages");
+
+    AudioRing() {}
+
+    // producer side: the next block this producer has to fill, NULL while the ring is full
+    inline AudioBlock* GetFree(uint8_t producer, uint32_t& clock) {
+      uint32_t n = _produced[producer].load(std::memory_order_relaxed);
+      if (n - _mixed.load(std::memory_order_acquire) >= STAGES) return NULL;
+      clock = n * DMA_BUF_LEN;
+      return &_blocks[n & (SLOTS - 1)];
+    }
+
+    // blocks this producer has finished, which is also the number of the block it works on
+    inline uint32_t GetProduced(uint8_t producer) { return _produced[producer].load(std::memory_order_acquire); }
+
+    inline void Produced(uint8_t producer) {
+      _produced[producer].store(_produced[producer].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // mixer side: the oldest block, NULL until both producers are done with it
+    inline AudioBlock* GetReady(uint32_t& clock) {
+      uint32_t n = _mixed.load(std::memory_order_relaxed);
+      for (int i = 0; i < AUDIO_PRODUCERS; i++) {
+        if (_produced[i].load(std::memory_order_acquire) == n) return NULL;
+      }
+      clock = n * DMA_BUF_LEN;
+      return &_blocks[n & (SLOTS - 1)];
+    }
+
+    inline void Mixed() {
+      _mixed.store(_mixed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // how many samples the generators may run ahead of the output
+    static constexpr uint32_t GetLatency() { return (STAGES - 1) * DMA_BUF_LEN; }
+
+  private:
+    static constexpr int SLOTS = (STAGES > 2) ? 4 : 2;   // power of 2, so the slot survives the counters wrapping
+    AudioBlock _blocks[SLOTS];
+    std::atomic<uint32_t> _produced[AUDIO_PRODUCERS] = {};
+    std::atomic<uint32_t> _mixed{0};
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
 #define PROG_NAME       "ESP32 AcidBox"
 #define VERSION         "v.1.3.3"
 
@@ -20,6 +23,7 @@
 //#define DEBUG_JUKEBOX
 //#define DEBUG_FX
 //#define DEBUG_TIMING
+//#define DEBUG_BALANCER
 //#define DEBUG_MIDI
 
 #define MIDI_VIA_SERIAL       // use this option to enable Hairless MIDI on Serial port @115200 baud (USB connector), THIS WILL BLOCK SERIAL DEBUGGING as well
@@ -28,6 +32,7 @@
 #define MIDITX_PIN      15      // this pin will be used for output (not implemented yet) when MIDI_VIA_SERIAL2 defined
 
 #define POT_NUM 3
+#define POT_SYNTH_VOICE 1       // the 303 voice the pots play with, the second one
 
 // Pin definitions for different ESP32 variants and boards
 #if defined(CONFIG_IDF_TARGET_ESP32S3)
@@ -49,6 +54,11 @@
 #define I2S_WCLK_PIN    19      // I2S WORD CLOCK pin (WCK WCL LCK)
 #define I2S_DOUT_PIN    18      // to I2S DATA IN pin (DIN D DAT)
 const uint8_t POT_PINS[POT_NUM] = {34, 35, 36};
+#elif defined(HOST_RENDER)
+#define I2S_BCLK_PIN    5       // no pins on the host, these only keep the sketch compilable
+#define I2S_WCLK_PIN    19
+#define I2S_DOUT_PIN    18
+const uint8_t POT_PINS[POT_NUM] = {34, 35, 36};
 #endif
 
 
@@ -56,6 +66,10 @@ float bpm = 130.0f;
 
 #define MAX_CUTOFF_FREQ 4000.0f
 #define MIN_CUTOFF_FREQ 250.0f
+#define FILTER_CONTROL_RATE 4           // TeeBee filter coefficients are calculated every N samples (1, 4, 8 or 16) and interpolated in between, 1 = every sample
+//#define FILTER_COEF_LATTICE           // TeeBee filter takes b0, k, g from a precomputed cutoff x resonance lattice instead of evaluating its polynomials
+#define FILTER_LATTICE_OCTAVE_STEPS 16  // lattice size: cutoff nodes per octave (power of 2), 7 octaves from 128 Hz ...
+#define FILTER_LATTICE_RESOS    8       // ... times resonance nodes, 12 bytes per node
 
 #ifdef USE_INTERNAL_DAC
 #define SAMPLE_RATE     22050   // price for increasing this value having NO_PSRAM is less delay time, you won't hear the difference at 8bit/sample
@@ -72,6 +86,10 @@ const float TWO_DIV_16383 = 1.22077763e-04f;
 #define TABLE_MASK  	        (TABLE_SIZE-1)        // strip MSB's and remain within our desired range of TABLE_SIZE
 #define CICLE_INDEX(i)        (((int32_t)(i)) & TABLE_MASK ) // this way we can operate with periodic functions or waveforms without phase-reset ("if's" are pretty costly in the matter of time)
 
+#define WAVE_MIPMAPS          (TABLE_BIT-2)         // band-limited oscillator levels, level k keeps the harmonics below TABLE_SIZE/4 >> k (alias-free up to a phase step of 2^(k+1))
+#define WAVE_MIPMAP_FULL      3                     // levels 0..2 are TABLE_SIZE long, each one above is half the one below: 16+ samples per cycle of the top harmonic
+#define WAVE_MIPMAP_FLOATS    (WAVE_MIPMAP_FULL * (TABLE_SIZE+1) + TABLE_SIZE - (TABLE_SIZE >> (WAVE_MIPMAPS - WAVE_MIPMAP_FULL)) + WAVE_MIPMAPS - WAVE_MIPMAP_FULL) // all levels with their guard points, 16 kB
+
 const float DIV_TABLE_SIZE =  1.0f / (float)TABLE_SIZE;
 
 // illinear shaper, choose preferred parameters basing on your audial experience
@@ -83,35 +101,69 @@ const float DIV_TABLE_SIZE =  1.0f / (float)TABLE_SIZE;
 const float SHAPER_LOOKUP_COEF = (float)TABLE_SIZE / SHAPER_LOOKUP_MAX;
 #define DMA_BUF_LEN     32          // there should be no problems with low values, down to 32 samples, 64 seems to be OK with some extra
 #define DMA_NUM_BUF     2           // I see no reasom to set more than 2 DMA buffers, but...
+#define AUDIO_STAGES    2           // audio ring depth, 2..4: each stage above 2 lets the generators run one more DMA buffer ahead of the mixer (and adds as much latency)
+#define LOAD_BALANCER               // once per bar, move the engines between the cores by their measured cost, see load_balancer.h
+#define BALANCER_SMOOTH 0.02f       // moving average coefficient of the per-block costs
+#define BALANCER_HYSTERESIS 0.85f   // a new split must shorten the busier core's time at least to this fraction
+
+// FreeRTOS priorities, higher runs first. Arduino's loopTask runs loop() at 1 on Core1 and never blocks. The kit
+// loader never blocks while it converts a kit either, so it shares loopTask's priority: the two take turns every
+// tick, and neither MIDI parsing nor the loader is starved. Above them the sample streamer, as a stream that falls
+// behind is heard at once, and the audio tasks above everything
+#define LOOP_TASK_PRIORITY      1
+#define LOADER_TASK_PRIORITY    1   // sampler's kit loader, blocks until a program change
+#define STREAM_TASK_PRIORITY    2   // sampler's streamer (SAMPLER_STREAM), blocks until the audio task asks for more
+#define AUDIO_TASK_PRIORITY     3   // audio_task1 and audio_task2
+#if !( AUDIO_TASK_PRIORITY > STREAM_TASK_PRIORITY && STREAM_TASK_PRIORITY > LOADER_TASK_PRIORITY && LOADER_TASK_PRIORITY == LOOP_TASK_PRIORITY )
+#error "task priorities have to go audio > streamer > kit loader == loopTask"
+#endif
 
 const uint32_t DMA_BUF_TIME = (uint32_t)(1000000.0f / (float)SAMPLE_RATE * (float)DMA_BUF_LEN); // microseconds per buffer, used for debugging output of time-slots
 
 #define SYNTH1_MIDI_CHAN        1
 #define SYNTH2_MIDI_CHAN        2
+#ifndef SYNTH_VOICES
+#define SYNTH_VOICES            2       // 303 voices in the bank, voice v listens to MIDI channel SYNTH1_MIDI_CHAN + v, see voice_bank.h
+#endif
+//#define SYNTH_KERNEL                  // the voices a core renders run through SynthKernel together, pays off with several voices per core, see synth_kernel.h
+#define SYNTH_KERNEL_LANES      4       // voices per SynthKernel pass
 
 #define DRUM_MIDI_CHAN          10
 
+#define MIDI_QUEUE_SIZE         64      // MIDI events waiting per engine (power of 2), they reach the engines one DMA buffer after they were received
+
 const float TWOPI = PI*2.0f;
 const float MIDI_NORM = 1.0f/127.0f;
 const float ONE_DIV_PI = 1.0f/PI;
 const float ONE_DIV_TWOPI = 1.0f/TWOPI;
 #define FORMAT_LITTLEFS_IF_FAILED true
 
-#define GROUP_HATS  // if so, instruments CH_NUMBER and OH_NUMBER will terminate each other (sampler module)
+#define GROUP_HATS  // if so, instruments CH_NUMBER and OH_NUMBER start in one choke group and fade each other out, CC_808_NOTE_CHOKE sets any (sampler module)
 #define CH_NUMBER  6 // closed hat instrument number in kit (for groupping, zero-based)
 #define OH_NUMBER  7 // open hat instrument number in kit (for groupping, zero-based)
+#define SAMPLER_FADE_MS     5   // fade-out of choked and stolen drum hits (sampler module)
+//#define SAMPLER_FLOAT_STORE // sampler keeps the samples as float instead of int16, needs twice the cache (sampler module)
+//#define SAMPLER_ADPCM       // sampler keeps the samples IMA-ADPCM compressed, 4 bits per frame, decoded while playing, hats get a little noisier (sampler module, see adpcm.h)
+//#define SAMPLER_STREAM      // kits from images keep the heads of long samples in the cache, the tails stream from flash while they play (sampler module, see sample_stream.h)
 
 #ifdef NO_PSRAM
-  #define RAM_SAMPLER_CACHE  40000    // bytes, compact sample set is 132kB, first 8 samples is ~38kB
+  #define RAM_SAMPLER_CACHE  40000    // bytes per kit (two of them, for kit switching), compact sample set is 132kB, first 8 samples is ~38kB, SAMPLER_ADPCM fits a compact set in a quarter
   #define DEFAULT_DRUMKIT 4           // /data/4/ folder
   #define SAMPLECNT       8           // how many samples we prepare (here just 8)
+  #define SAMPLER_INTERPOLATION INTERP_LINEAR // default of every kit, see sample_interp.h for the modes and their cost
+  #define SAMPLER_MAX_VOICES 6        // drum hits at once, one more fades out the quietest (sampler module)
+  #define SAMPLER_STREAM_VOICES 4     // long hits that stream at once, more play their heads only (SAMPLER_STREAM), 2 kB of RAM each
 #else
 //  #define PRELOAD_ALL                 // allows operating all the samples in realtime
   #define PSRAM_SAMPLER_CACHE 3145728 // bytes, we are going to preload ALL the samples from FLASH to PSRAM
+                                      // without PRELOAD_ALL it is split in two kits, one plays while the other one loads
                                       // we divide samples by octaves to use modifiers to particular instruments, not just note numbers
                                       // i.e. we know that all the "C" notes in all octaves are bass drums, and CC_808_BD_TONE affects all BD's
   #define SAMPLECNT       (7 * 12)    // how many samples we prepare (8 octaves by 12 samples)
   #define DEFAULT_DRUMKIT 0           // in my /data /0 has a massive bassdrum , /6 = 808 samples
+  #define SAMPLER_INTERPOLATION INTERP_HERMITE // default of every kit, see sample_interp.h for the modes and their cost
+  #define SAMPLER_MAX_VOICES 16       // drum hits at once, one more fades out the quietest (sampler module)
+  #define SAMPLER_STREAM_VOICES 8     // long hits that stream at once, more play their heads only (SAMPLER_STREAM), 2 kB of RAM each
 #endif
 
 #define TINY 1e-32;
@@ -142,6 +194,11 @@ const float ONE_DIV_TWOPI = 1.0f/TWOPI;
   #endif
 #endif
 
+#ifdef HOST_RENDER             // host render target (host/ folder) has no MIDI ports, the JUKEBOX or a script drives it
+  #undef MIDI_VIA_SERIAL
+  #undef MIDI_VIA_SERIAL2
+#endif
+
 #ifdef MIDI_VIA_SERIAL
   #undef DEBUG_ON
 #endif
@@ -310,3 +367,5 @@ static const float tuning[128] = {
 
 inline float fast_shape(float x);
 static __attribute__((always_inline)) inline float one_div(float a) ;
+
+#endif
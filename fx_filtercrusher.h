@@ -42,6 +42,9 @@ class FxFilterCrusher {
 
     void Process( float* left, float* right );
 
+    // same as Process() sample by sample, the filters run in runs between coefficient updates
+    void ProcessBlock( float* left, float* right, int len );
+
     void SetCutoff( float value ) ;
 
     void SetResonance( float value ) ;
@@ -75,6 +78,7 @@ class FxFilterCrusher {
     float cutoff_lp_slow = 1.0f;
 
     uint8_t effect_prescaler = 0;
+    float oldLP = 0.0f, oldHP = 0.0f, oldReso = 0.0f;
 
     float bitCrusher = 1.0f;
     float div_bitCrusher = 1.0f;
@@ -92,6 +96,23 @@ class FxFilterCrusher {
       *signal = out;
     };
 
+    inline void Filter_ProcessBlock( float *const signal, int len, struct filterProcT *const filterP ) {
+      const float b0 = filterP->filterCoeff->bNorm[0], b1 = filterP->filterCoeff->bNorm[1], b2 = filterP->filterCoeff->bNorm[2];
+      const float a0 = filterP->filterCoeff->aNorm[0], a1 = filterP->filterCoeff->aNorm[1];
+      float w0 = filterP->w[0], w1 = filterP->w[1];
+      for (int i = 0; i < len; i++) {
+        const float in = signal[i];
+        const float out = b0 * in + w0;
+        w0 = b1 * in - a0 * out + w1;
+        w1 = b2 * in - a1 * out;
+        signal[i] = out;
+      }
+      filterP->w[0] = w0;
+      filterP->w[1] = w1;
+    };
+
+    inline void UpdateCoefficients();
+
 
 
 };
@@ -27,13 +27,51 @@ void FxFilterCrusher::SetBitCrusher( float value ) {
 };
 
 void FxFilterCrusher::Process( float* left, float* right ) {
-  static float oldLP, oldHP, oldReso;
   effect_prescaler++;
 
   Filter_Process(left, &mainFilterL_LP);
   Filter_Process(right, &mainFilterR_LP);
   Filter_Process(left, &mainFilterL_HP);
   Filter_Process(right, &mainFilterR_HP);
+
+  UpdateCoefficients();
+
+  if ( bitCrusher < 1.0f ) {
+    int32_t ul = *left * (float)bitCrusher * (float)(1 << 29);
+    *left = ((float)ul * div_bitCrusher * (float)(1 << 29));
+
+    int32_t ur = *right * (float)bitCrusher * (float)(1 << 29);
+    *right = ((float)ur * div_bitCrusher * (float)(1 << 29));
+  }
+};
+
+void FxFilterCrusher::ProcessBlock( float* left, float* right, int len ) {
+  int done = 0;
+  while ( done < len ) {
+    // the coefficients may change after every 16th sample only, up to there the filters run with fixed ones
+    int run = 16 - effect_prescaler % 16;
+    if ( run > len - done ) run = len - done;
+    Filter_ProcessBlock(left + done, run, &mainFilterL_LP);
+    Filter_ProcessBlock(right + done, run, &mainFilterR_LP);
+    Filter_ProcessBlock(left + done, run, &mainFilterL_HP);
+    Filter_ProcessBlock(right + done, run, &mainFilterR_HP);
+    effect_prescaler += run;
+    done += run;
+    UpdateCoefficients();
+  }
+
+  if ( bitCrusher < 1.0f ) {
+    for ( int i = 0; i < len; i++ ) {
+      int32_t ul = left[i] * (float)bitCrusher * (float)(1 << 29);
+      left[i] = ((float)ul * div_bitCrusher * (float)(1 << 29));
+
+      int32_t ur = right[i] * (float)bitCrusher * (float)(1 << 29);
+      right[i] = ((float)ur * div_bitCrusher * (float)(1 << 29));
+    }
+  }
+};
+
+inline void FxFilterCrusher::UpdateCoefficients() {
 /*
   cutoff_lp_slow = (float)cutoff_lp_slow * 0.99f + 0.01f * ((float)lowpassC - (float)cutoff_lp_slow);
   cutoff_hp_slow = (float)cutoff_hp_slow * 0.99f + 0.01f * ((float)highpassC - (float)cutoff_hp_slow);
@@ -51,15 +89,6 @@ void FxFilterCrusher::Process( float* left, float* right ) {
       oldReso = filtReso;    
     }
   }
-
-
-  if ( bitCrusher < 1.0f ) {
-    int32_t ul = *left * (float)bitCrusher * (float)(1 << 29);
-    *left = ((float)ul * div_bitCrusher * (float)(1 << 29));
-
-    int32_t ur = *right * (float)bitCrusher * (float)(1 << 29);
-    *right = ((float)ur * div_bitCrusher * (float)(1 << 29));
-  }
 };
 
 
@@ -11,6 +11,9 @@
  * Changes:
  * - optimized for buffer processing
  * - added interface to set the level
+ * - the combs and allpasses keep their write positions in the instance (they were function statics, shared
+ *   by all the reverbs), so there can be more than one; one FxReverbLine template for all seven of them
+ * - Process(left, right, len) for a whole block
  *
  */
 #ifdef NO_PSRAM 
@@ -27,142 +30,118 @@
 #define l_AP1 (int)( 168 * REV_MULTIPLIER)
 #define l_AP2 (int)( 48 * REV_MULTIPLIER)
 
-#define STATIC_REV_BUFFER
+#define STATIC_REV_BUFFER   // else Init() mallocs the lines (PSRAM is too slow for that)
 
 //rev_time 0.0 <-> 1.0
 //rev_delay 0.0 <-> 1.0
 
+// one delay line of the reverb, as a feedback comb or as an allpass, LEN samples long of which SetTime() uses the first lim
+template <int LEN>
+class FxReverbLine {
+  public:
+    FxReverbLine( float gain ) : g(gain) {}
+
+    inline void Init() {
+#ifndef STATIC_REV_BUFFER
+      if ( buf == NULL ) {
+        buf = (float *)malloc(sizeof(float) * LEN);
+      }
+      if ( buf == NULL ) {
+        DEBF("No more RAM for a reverb line of %d!\r\n", LEN);
+        return;
+      }
+#endif
+      memset( buf, 0, sizeof(float) * LEN );
+      p = 0;
+    };
+
+    inline void SetTime( float rev_time ) {
+      lim = (int)(rev_time * LEN);
+    };
+
+    inline float Comb( float inSample ) {
+      float readback = buf[p];
+      float newV = readback * g + inSample;
+      buf[p] = newV;
+      p++;
+      if ( p >= lim ) {
+        p = 0;
+      }
+      return readback;
+    };
+
+    inline float Allpass( float inSample ) {
+      float readback = buf[p];
+      readback += (-g) * inSample;
+      float newV = readback * g + inSample;
+      buf[p] = newV;
+      p++;
+      if ( p >= lim ) {
+        p = 0;
+      }
+      return readback;
+    };
+
+  private:
+#ifdef STATIC_REV_BUFFER
+    float buf[LEN] = {};
+#else
+    float *buf = NULL;
+#endif
+    int p = 0;        // write position
+    int lim = LEN;    // delay time
+    const float g;
+};
+
 class FxReverb {
 	public:
 	FxReverb() {}
 
   	inline void Process( float *signal_l, float *signal_r ){
+  		Process( signal_l, signal_r, 1 );
+  	};
+
+  	// the mono sum of left and right through the reverb, added to both
+  	inline void Process( float *left, float *right, int len ){
+  		const float level = rev_level;
+  		for ( int i = 0; i < len; i++ ) {
+  			// create mono sample 
+  			float inSample = left[i] + right[i]; // it may cause unwanted audible effects 
   
-  		float inSample;
-  
-  		// create mono sample 
-  		inSample = *signal_l + *signal_r; // it may cause unwanted audible effects 
-  		//inSample *= 0.5f;
-  
-  		// float newsample = (Do_Comb0(inSample) + Do_Comb1(inSample) + Do_Comb2(inSample) + Do_Comb3(inSample)) / 4.0f;
-  		float newsample = (Do_Comb0(inSample) + Do_Comb1(inSample) + Do_Comb2(inSample) + Do_Comb3(inSample)) * 0.125f;
-  		newsample = Do_Allpass0(newsample);
-  		newsample = Do_Allpass1(newsample);
-  		newsample = Do_Allpass2(newsample);
-  
-  		// apply reverb level 
-  		newsample *= rev_level;
+  			float newsample = (cf0.Comb(inSample) + cf1.Comb(inSample) + cf2.Comb(inSample) + cf3.Comb(inSample)) * 0.125f;
+  			newsample = ap0.Allpass(newsample);
+  			newsample = ap1.Allpass(newsample);
+  			newsample = ap2.Allpass(newsample);
   
-  		*signal_l += newsample;
-  		*signal_r += newsample;
+  			// apply reverb level 
+  			newsample *= level;
   
+  			left[i] += newsample;
+  			right[i] += newsample;
+  		}
   	};
   
   	inline void Init(){ 
   		SetLevel( 1.0f );
   		SetTime( 0.75f );
-//  #ifdef NO_PSRAM
-#ifndef STATIC_REV_BUFFER
-      cfbuf0 = (float *)malloc(sizeof(float) * l_CB0);
-      if( cfbuf0 == NULL){
-        DEBUG("No more RAM for reverb cb0!");
-      } else {
-        DEBUG("Memory allocated for reverb cb0");
-      };
-      cfbuf1 = (float *)malloc(sizeof(float) * l_CB1);
-      if( cfbuf1 == NULL){
-        DEBUG("No more RAM for reverb cb1!");
-      } else {
-        DEBUG("Memory allocated for reverb cb1");
-      };
-      cfbuf2 = (float *)malloc(sizeof(float) * l_CB2);
-      if( cfbuf2 == NULL){
-        DEBUG("No more RAM for reverb cb2!");
-      } else {
-        DEBUG("Memory allocated for reverb cb2");
-      };
-      cfbuf3 = (float *)malloc(sizeof(float) * l_CB3);
-      if( cfbuf3 == NULL){
-        DEBUG("No more RAM for reverb cb3!");
-      } else {
-        DEBUG("Memory allocated for reverb cb3");
-      };      
-      apbuf0 = (float *)malloc(sizeof(float) * l_AP0);
-      if( apbuf0 == NULL){
-        DEBUG("No more RAM for reverb apbuf0!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf0");
-      };
-      apbuf1 = (float *)malloc(sizeof(float) * l_AP1);
-      if( apbuf1 == NULL){
-        DEBUG("No more RAM for reverb apbuf1!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf1");
-      };
-      apbuf2 = (float *)malloc(sizeof(float) * l_AP2);
-      if( apbuf2 == NULL){
-        DEBUG("No more RAM for reverb apbuf2!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf2");
-      };
-#endif
-/*#else
-// PSRAM is too slow for that
-      cfbuf0 = (float *)ps_malloc(sizeof(float) * l_CB0);
-      if( cfbuf0 == NULL){
-        DEBUG("No more RAM for reverb cb0!");
-      } else {
-        DEBUG("Memory allocated for reverb cb0");
-      };
-      cfbuf1 = (float *)ps_malloc(sizeof(float) * l_CB1);
-      if( cfbuf1 == NULL){
-        DEBUG("No more RAM for reverb cb1!");
-      } else {
-        DEBUG("Memory allocated for reverb cb1");
-      };
-      cfbuf2 = (float *)ps_malloc(sizeof(float) * l_CB2);
-      if( cfbuf2 == NULL){
-        DEBUG("No more RAM for reverb cb2!");
-      } else {
-        DEBUG("Memory allocated for reverb cb2");
-      };
-      cfbuf3 = (float *)ps_malloc(sizeof(float) * l_CB3);
-      if( cfbuf3 == NULL){
-        DEBUG("No more RAM for reverb cb3!");
-      } else {
-        DEBUG("Memory allocated for reverb cb3");
-      };      
-      apbuf0 = (float *)ps_malloc(sizeof(float) * l_AP0);
-      if( apbuf0 == NULL){
-        DEBUG("No more RAM for reverb apbuf0!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf0");
-      };
-      apbuf1 = (float *)ps_malloc(sizeof(float) * l_AP1);
-      if( apbuf1 == NULL){
-        DEBUG("No more RAM for reverb apbuf1!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf1");
-      };
-      apbuf2 = (float *)ps_malloc(sizeof(float) * l_AP2);
-      if( apbuf2 == NULL){
-        DEBUG("No more RAM for reverb apbuf2!");
-      } else {
-        DEBUG("Memory allocated for reverb apbuf2");
-      };
-#endif
-*/
+  		cf0.Init();
+  		cf1.Init();
+  		cf2.Init();
+  		cf3.Init();
+  		ap0.Init();
+  		ap1.Init();
+  		ap2.Init();
   	};
 		
     inline void SetTime( float value ){
       rev_time = 0.92f * value + 0.02f ;
-      cf0_lim = (int)(rev_time * (l_CB0));
-      cf1_lim = (int)(rev_time * (l_CB1));
-      cf2_lim = (int)(rev_time * (l_CB2));
-      cf3_lim = (int)(rev_time * (l_CB3));
-      ap0_lim = (int)(rev_time * (l_AP0));
-      ap1_lim = (int)(rev_time * (l_AP1));
-      ap2_lim = (int)(rev_time * (l_AP2));
+      cf0.SetTime( rev_time );
+      cf1.SetTime( rev_time );
+      cf2.SetTime( rev_time );
+      cf3.SetTime( rev_time );
+      ap0.SetTime( rev_time );
+      ap1.SetTime( rev_time );
+      ap2.SetTime( rev_time );
 #ifdef DEBUG_FX
       DEBF("reverb time: %0.3f\n", value);
 #endif
@@ -178,129 +157,11 @@ class FxReverb {
 	private:
 		float rev_time = 0.5f;
 		float rev_level = 0.5f;
-#ifdef STATIC_REV_BUFFER
-    float cfbuf0[l_CB0];
-    float cfbuf1[l_CB1];
-    float cfbuf2[l_CB2];
-    float cfbuf3[l_CB3];
-    float apbuf0[l_AP0];
-    float apbuf1[l_AP1];
-    float apbuf2[l_AP2];
-#else
-    float * cfbuf0 = NULL;
-    float * cfbuf1 = NULL;
-    float * cfbuf2 = NULL;
-    float * cfbuf3 = NULL;
-    float * apbuf0 = NULL;
-    float * apbuf1 = NULL;
-    float * apbuf2 = NULL;    
-#endif	
-		//define pointer limits = delay time
-		int cf0_lim, cf1_lim, cf2_lim, cf3_lim, ap0_lim, ap1_lim, ap2_lim;
-
-    
-    inline float Do_Comb0( float inSample ){
-      static int cf0_p = 0;
-      static float cf0_g = 0.805f;
-
-      float readback = cfbuf0[cf0_p];
-      float newV = readback * cf0_g + inSample;
-      cfbuf0[cf0_p] = newV;
-      cf0_p++;
-      if( cf0_p >= cf0_lim ){
-        cf0_p = 0;
-      }
-      return readback;
-    };
-
-    inline float Do_Comb1( float inSample ){
-      
-      static int cf1_p = 0;
-      static float cf1_g = 0.827f;
-
-      float readback = cfbuf1[cf1_p];
-      float newV = readback * cf1_g + inSample;
-      cfbuf1[cf1_p] = newV;
-      cf1_p++;
-      if( cf1_p >= cf1_lim ){
-        cf1_p = 0;
-      }
-      return readback;
-    };
-
-    inline float Do_Comb2( float inSample ){
-      static int cf2_p = 0;
-      static float cf2_g = 0.783f;
-
-      float readback = cfbuf2[cf2_p];
-      float newV = readback * cf2_g + inSample;
-      cfbuf2[cf2_p] = newV;
-      cf2_p++;
-      if( cf2_p >= cf2_lim ){
-        cf2_p = 0;
-      }
-      return readback;
-    };
-
-    inline float Do_Comb3( float inSample ){
-      static int cf3_p = 0;
-      static float cf3_g = 0.764f;
-
-      float readback = cfbuf3[cf3_p];
-      float newV = readback * cf3_g + inSample;
-      cfbuf3[cf3_p] = newV;
-      cf3_p++;
-      if( cf3_p >= cf3_lim ){
-        cf3_p = 0;
-      }
-      return readback;
-    };
-
-
-    inline float Do_Allpass0( float inSample ){
-      static int ap0_p = 0;
-      static float ap0_g = 0.7f;
-
-      float readback = apbuf0[ap0_p];
-      readback += (-ap0_g) * inSample;
-      float newV = readback * ap0_g + inSample;
-      apbuf0[ap0_p] = newV;
-      ap0_p++;
-      if( ap0_p >= ap0_lim ){
-        ap0_p = 0;
-      }
-      return readback;
-    };
-
-    inline float Do_Allpass1( float inSample ){
-      static int ap1_p = 0;
-      static float ap1_g = 0.7f;
-
-      float readback = apbuf1[ap1_p];
-      readback += (-ap1_g) * inSample;
-      float newV = readback * ap1_g + inSample;
-      apbuf1[ap1_p] = newV;
-      ap1_p++;
-      if( ap1_p >= ap1_lim ){
-        ap1_p = 0;
-      }
-      return readback;
-    };
-
-    inline float Do_Allpass2( float inSample ){
-      static int ap2_p = 0;
-      static float ap2_g = 0.7f;
-
-      float readback = apbuf2[ap2_p];
-      readback += (-ap2_g) * inSample;
-      float newV = readback * ap2_g + inSample;
-      apbuf2[ap2_p] = newV;
-      ap2_p++;
-      if( ap2_p >= ap2_lim ){
-        ap2_p = 0;
-      }
-      return readback;
-    };
-
-
+		FxReverbLine<l_CB0> cf0 { 0.805f };
+		FxReverbLine<l_CB1> cf1 { 0.827f };
+		FxReverbLine<l_CB2> cf2 { 0.783f };
+		FxReverbLine<l_CB3> cf3 { 0.764f };
+		FxReverbLine<l_AP0> ap0 { 0.7f };
+		FxReverbLine<l_AP1> ap1 { 0.7f };
+		FxReverbLine<l_AP2> ap2 { 0.7f };
 };
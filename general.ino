@@ -1,120 +1,246 @@
-static void drums_generate() {
-    for (int i=0; i < DMA_BUF_LEN; i++){
-      Drums.Process( &drums_buf_l[current_gen_buf][i], &drums_buf_r[current_gen_buf][i] );      
-    } 
+static void drums_generate(AudioBlock& block, uint32_t clock) {
+    MidiEvent e;
+    int i = 0;
+    Drums.CheckKit();                                             // a kit loaded in the background takes over here
+    while (DrumsEvents.PopDue(clock + DMA_BUF_LEN, e)) {       // render up to each event, then apply it
+      int at = (int32_t)(e.time - clock);
+      if (at > i) {
+        DrumSends sends = {&block.drums_dly_l[i], &block.drums_dly_r[i], &block.drums_rvb_l[i], &block.drums_rvb_r[i], &block.drums_side[i]};
+        Drums.ProcessBlock(&block.drums_l[i], &block.drums_r[i], at - i, &sends);
+        i = at;
+      }
+      applyDrumsEvent(e);
+    }
+    DrumSends sends = {&block.drums_dly_l[i], &block.drums_dly_r[i], &block.drums_rvb_l[i], &block.drums_rvb_r[i], &block.drums_side[i]};
+    Drums.ProcessBlock(&block.drums_l[i], &block.drums_r[i], DMA_BUF_LEN - i, &sends);
+}
+
+static void synth_generate(SynthVoice& synth, MidiQueue& events, float* buf, uint32_t clock) {
+    MidiEvent e;
+    int done = 0;
+    while (events.PopDue(clock + DMA_BUF_LEN, e)) {             // render up to each event, then apply it
+      int at = (int32_t)(e.time - clock);
+      if (at > done) {
+        synth.ProcessBlock(buf + done, at - done);
+        done = at;
+      }
+      applySynthEvent(synth, e);
+    }
+    synth.ProcessBlock(buf + done, DMA_BUF_LEN - done);
 }
 
-static void synth1_generate() {
-    for (int i=0; i < DMA_BUF_LEN; i++){
-      synth1_buf[current_gen_buf][i] = Synth1.getSample() ;      
-    } 
+static void voice_generate(uint8_t v, AudioBlock& block, uint32_t clock) {
+    synth_generate(Synths.Voice(v), Synths.Events(v), block.synth[v], clock);
 }
 
-static void synth2_generate() {
-    for (int i=0; i < DMA_BUF_LEN; i++){
-      synth2_buf[current_gen_buf][i] = Synth2.getSample() ;      
-    } 
+// synth_generate() for up to SYNTH_KERNEL_LANES voices at once: the control parts voice by voice, then the audio stages side by side
+static inline void kernel_generate(SynthKernel& kernel, SynthVoice* const* synths, MidiQueue* const* events, float* const* bufs, int count, uint32_t clock) {
+    kernel.Load(synths, count);
+    for (int l = 0; l < count; l++) {
+      MidiEvent e;
+      int done = 0;
+      while (events[l]->PopDue(clock + DMA_BUF_LEN, e)) {       // up to each event, then apply it
+        int at = (int32_t)(e.time - clock);
+        if (at > done) {
+          kernel.Control(l, done, at);
+          done = at;
+        }
+        applySynthEvent(*synths[l], e);
+      }
+      kernel.Control(l, done, DMA_BUF_LEN);
+    }
+    kernel.Process(bufs);
 }
 
-static void IRAM_ATTR mixer() { // sum buffers 
+#ifdef SYNTH_KERNEL
+// the voices in the mask (bit v = voice v), returns how many
+static int voices_generate(SynthKernel& kernel, uint8_t voices, AudioBlock& block, uint32_t clock) {
+    SynthVoice* synths[SYNTH_VOICES];
+    MidiQueue* events[SYNTH_VOICES];
+    float* bufs[SYNTH_VOICES];
+    int count = 0;
+    for (int v = 0; v < SYNTH_VOICES; v++) {
+      if (((voices >> v) & 1) == 0) continue;
+      synths[count] = &Synths.Voice(v);
+      events[count] = &Synths.Events(v);
+      bufs[count] = block.synth[v];
+      count++;
+    }
+    for (int i = 0; i < count; i += SYNTH_KERNEL_LANES) {
+      int n = (count - i < SYNTH_KERNEL_LANES) ? count - i : SYNTH_KERNEL_LANES;
+      if (n > 1) kernel_generate(kernel, synths + i, events + i, bufs + i, n, clock);
+      else synth_generate(*synths[i], *events[i], bufs[i], clock);   // a lone voice is faster without the shadow lanes
+    }
+    return count;
+}
+#endif
+
+static void IRAM_ATTR mixer(AudioBlock& block, uint32_t clock) { // sum buffers 
 #ifdef DEBUG_MASTER_OUT
   static float meter = 0.0f;
 #endif
-  static float synth1_out_l, synth1_out_r, synth2_out_l, synth2_out_r, drums_out_l, drums_out_r;
+  static float synth_out_l, synth_out_r, synths_l, synths_r, drums_out_l, drums_out_r;
   static float dly_l, dly_r, rvb_l, rvb_r;
-  static float mono_mix;
-    dly_k1 = Synth1._sendDelay;
-    dly_k2 = Synth2._sendDelay;
-    dly_k3 = Drums._sendDelay;
-#ifndef NO_PSRAM 
-    rvb_k1 = Synth1._sendReverb;
-    rvb_k2 = Synth2._sendReverb;
-    rvb_k3 = Drums._sendReverb;
-#endif
+  static float rvb_buf_l[DMA_BUF_LEN], rvb_buf_r[DMA_BUF_LEN];
+  float pan[SYNTH_VOICES], dly_k[SYNTH_VOICES], rvb_k[SYNTH_VOICES];  // the voices' mixer strips
+  MidiEvent e;
+  while (FxEvents.PopDue(clock + DMA_BUF_LEN, e)) applyFxEvent(e); // global effects follow MIDI per block
+    for (int v = 0; v < SYNTH_VOICES; v++) {
+      pan[v] = Synths.Voice(v).GetPan();
+      dly_k[v] = Synths.Voice(v)._sendDelay;
+      rvb_k[v] = Synths.Voice(v)._sendReverb;
+    }
     for (int i=0; i < DMA_BUF_LEN; i++) { 
-      drums_out_l = drums_buf_l[current_out_buf][i];
-      drums_out_r = drums_buf_r[current_out_buf][i];
-
-      synth1_out_l = Synth1.GetPan() * synth1_buf[current_out_buf][i];
-      synth1_out_r = (1.0f - Synth1.GetPan()) * synth1_buf[current_out_buf][i];
-      synth2_out_l = Synth2.GetPan() * synth2_buf[current_out_buf][i];
-      synth2_out_r = (1.0f - Synth2.GetPan()) * synth2_buf[current_out_buf][i];
-
+      drums_out_l = block.drums_l[i];
+      drums_out_r = block.drums_r[i];
+
+      synths_l = synths_r = dly_l = dly_r = rvb_l = rvb_r = 0.0f;
+      for (int v = 0; v < SYNTH_VOICES; v++) {
+        synth_out_l = pan[v] * block.synth[v][i];
+        synth_out_r = (1.0f - pan[v]) * block.synth[v][i];
+        synths_l += synth_out_l;
+        synths_r += synth_out_r;
+        dly_l += dly_k[v] * synth_out_l; // delay bus
+        dly_r += dly_k[v] * synth_out_r;
+        rvb_l += rvb_k[v] * synth_out_l; // reverb bus
+        rvb_r += rvb_k[v] * synth_out_r;
+      }
       
-      dly_l = dly_k1 * synth1_out_l + dly_k2 * synth2_out_l + dly_k3 * drums_out_l; // delay bus
-      dly_r = dly_k1 * synth1_out_r + dly_k2 * synth2_out_r + dly_k3 * drums_out_r;
+      dly_l += block.drums_dly_l[i];  // the drum buses' sends, each bus with its own levels
+      dly_r += block.drums_dly_r[i];
       Delay.Process( &dly_l, &dly_r );
-#ifndef NO_PSRAM
-      rvb_l = rvb_k1 * synth1_out_l + rvb_k2 * synth2_out_l + rvb_k3 * drums_out_l; // reverb bus
-      rvb_r = rvb_k1 * synth1_out_r + rvb_k2 * synth2_out_r + rvb_k3 * drums_out_r;
-      Reverb.Process( &rvb_l, &rvb_r );
+      rvb_buf_l[i] = rvb_l + block.drums_rvb_l[i];
+      rvb_buf_r[i] = rvb_r + block.drums_rvb_r[i];
 
-      mix_buf_l[current_out_buf][i] = (synth1_out_l + synth2_out_l + drums_out_l + dly_l + rvb_l);
-      mix_buf_r[current_out_buf][i] = (synth1_out_r + synth2_out_r + drums_out_r + dly_r + rvb_r);
-#else
-      mix_buf_l[current_out_buf][i] = (synth1_out_l + synth2_out_l + drums_out_l + dly_l);
-      mix_buf_r[current_out_buf][i] = (synth1_out_r + synth2_out_r + drums_out_r + dly_r);
+      mix_buf_l[i] = (synths_l + drums_out_l + dly_l);
+      mix_buf_r[i] = (synths_r + drums_out_r + dly_r);
+    }
+#ifndef NO_PSRAM
+    Reverb.Process( rvb_buf_l, rvb_buf_r, DMA_BUF_LEN ); // the reverb bus for the whole block
 #endif
-      mono_mix = 0.5f * (mix_buf_l[current_out_buf][i] + mix_buf_r[current_out_buf][i]);
-  //    Comp.Process(mono_mix);     // calculate gain based on a mono mix
+    for (int i=0; i < DMA_BUF_LEN; i++) { 
+#ifndef NO_PSRAM
+      mix_buf_l[i] += rvb_buf_l[i];
+      mix_buf_r[i] += rvb_buf_r[i];
+#endif
+  //    Comp.Process(0.5f * (mix_buf_l[i] + mix_buf_r[i]));     // calculate gain based on a mono mix
 
-      Comp.Process(drums_out_l*0.25f);  // calc compressor gain, side-chain driven by drums
+      Comp.Process(block.drums_side[i]*0.25f);  // calc compressor gain, side-chain driven by the drum buses that tap it
 
 
-      mix_buf_l[current_out_buf][i] = (Comp.Apply( 0.25f * mix_buf_l[current_out_buf][i]));
-      mix_buf_r[current_out_buf][i] = (Comp.Apply( 0.25f * mix_buf_r[current_out_buf][i]));
+      mix_buf_l[i] = (Comp.Apply( 0.25f * mix_buf_l[i]));
+      mix_buf_r[i] = (Comp.Apply( 0.25f * mix_buf_r[i]));
 
       
 #ifdef DEBUG_MASTER_OUT
-      if ( i % 16 == 0) meter = meter * 0.95f + fabs( mono_mix); 
+      if ( i % 16 == 0) meter = meter * 0.95f + fabs( 0.5f * (mix_buf_l[i] + mix_buf_r[i])); 
 #endif
-  //    mix_buf_l[current_out_buf][i] = fclamp(mix_buf_l[current_out_buf][i] , -1.0f, 1.0f); // clipper
-  //    mix_buf_r[current_out_buf][i] = fclamp(mix_buf_r[current_out_buf][i] , -1.0f, 1.0f);
-     mix_buf_l[current_out_buf][i] = fast_shape( mix_buf_l[current_out_buf][i]); // soft limitter/saturator
-     mix_buf_r[current_out_buf][i] = fast_shape( mix_buf_r[current_out_buf][i]);
+  //    mix_buf_l[i] = fclamp(mix_buf_l[i] , -1.0f, 1.0f); // clipper
+  //    mix_buf_r[i] = fclamp(mix_buf_r[i] , -1.0f, 1.0f);
+     mix_buf_l[i] = fast_shape( mix_buf_l[i]); // soft limitter/saturator
+     mix_buf_r[i] = fast_shape( mix_buf_r[i]);
    }
 #ifdef DEBUG_MASTER_OUT
   meter *= 0.95f;
-  meter += fabs(mono_mix); 
+  meter += fabs(0.5f * (mix_buf_l[DMA_BUF_LEN - 1] + mix_buf_r[DMA_BUF_LEN - 1])); 
   DEBF("out= %0.5f\r\n", meter);
 #endif
 }
 
 
-inline float bilinearLookup(float (&table)[16][16], float x, float y) {
-  static float kmap = 0.1181f; // map from 0-127 to 0-14.99
-  int32_t i,j;
-  float fi,fj;
-  float v1,v2,v3,v4;
-  float res1,res2,res3;
-  x *= kmap;
-  y *= kmap;
-  i = (int32_t)x;
-  j = (int32_t)y;
-  fi = (float)x - i;
-  fj = (float)y - j;
-  v1 = table[i][j];
-  v2 = table[i+1][j];
-  v3 = table[i][j+1];
-  v4 = table[i+1][j+1];  
-  res1 = (float)fi * (float)(v2-v1) + v1;
-  res2 = (float)fi * (float)(v4-v3) + v3;
-  res3 = (float)fj * (float)(res2-res1) + res1;
-  return res3;
-}
-
-inline float lookupTable(float (&table)[TABLE_SIZE+1], float index ) { // lookup value in a table by float index, using linear interpolation
-  static float v1, v2, res;
-  static int32_t i;
-  static float f;
- // if (index >= TABLE_SIZE) return table[TABLE_SIZE];
-  i = (int32_t)index;
-  f = (float)index - i;
-  v1 = (table)[i];
-  v2 = (table)[i+1];
-  res = (float)f * (float)(v2-v1) + v1;
- // DEBF("i %0.6f mantissa %0.6f v1 %0.6f v2 %0.6f \r\n" , index , f , v1, v2  );
-  return res;
+// Table lookup kernels. They keep no state (no statics), so Core0 and Core1 may run them at the same time,
+// and everything stays in registers. The block variants give exactly the same results as their scalar versions.
+
+// linear interpolation, 0 <= index <= TABLE_SIZE, the table's guard point [TABLE_SIZE] is used at the top
+inline float lookupLinear(const float (&table)[TABLE_SIZE+1], float index) {
+  int32_t i = (int32_t)index;
+  float f = index - (float)i;
+  float v1 = table[i];
+  float v2 = table[i+1];
+  return f * (v2 - v1) + v1;
+}
+
+// linear interpolation of a periodic table, any index, wrapped with TABLE_MASK (guard point [TABLE_SIZE] == [0])
+inline float lookupCyclic(const float (&table)[TABLE_SIZE+1], float index) {
+  int32_t i = (int32_t)index;
+  i -= (index < (float)i);            // floor() for negative indices
+  float f = index - (float)i;
+  i &= TABLE_MASK;
+  float v1 = table[i];
+  float v2 = table[i+1];
+  return f * (v2 - v1) + v1;
+}
+
+// bilinear interpolation, 0 <= x, y < 15 in table cells
+inline float lookupBilinear(const float (&table)[16][16], float x, float y) {
+  int32_t i = (int32_t)x;
+  int32_t j = (int32_t)y;
+  float fi = x - (float)i;
+  float fj = y - (float)j;
+  float v1 = table[i][j];
+  float v2 = table[i+1][j];
+  float v3 = table[i][j+1];
+  float v4 = table[i+1][j+1];
+  float res1 = fi * (v2 - v1) + v1;
+  float res2 = fi * (v4 - v3) + v3;
+  return fj * (res2 - res1) + res1;
+}
+
+// Band-limited oscillator, see buildMipmaps(). The phase step selects one level, o = floor(log2(step)). Level o
+// keeps the harmonics below TABLE_SIZE/4 >> o, so up to the top of the octave, a step of 2^(o+1), they all stay
+// below Nyquist and nothing folds back: the band ends between fs/4 and fs/2. What's left is the linear
+// interpolation's own images, about -65 dB re signal at 800 Hz against -24 dB with the naive table
+// (host/check.cpp prints the figures).
+inline int32_t mipmapOctave(float step) {
+  union { float f; uint32_t u; } s;
+  s.f = step;
+  int32_t oct = (int32_t)(s.u >> 23) - 127;
+  if (oct < 0) return 0;
+  if (oct > (int32_t)WAVE_MIPMAPS - 1) return WAVE_MIPMAPS - 1;
+  return oct;
+}
+
+// level oct in saw_mipmaps: the first WAVE_MIPMAP_FULL levels are TABLE_SIZE+1 floats, each one above is half
+// the size of the one below plus its guard point
+inline const float* mipmapTable(int32_t oct) {
+  if (oct < WAVE_MIPMAP_FULL) return saw_mipmaps + oct * (TABLE_SIZE + 1);
+  int32_t k = oct - WAVE_MIPMAP_FULL;
+  return saw_mipmaps + WAVE_MIPMAP_FULL * (TABLE_SIZE + 1) + TABLE_SIZE - (TABLE_SIZE >> k) + k;
+}
+
+// length of level oct - 1, a power of 2 - 1
+inline int32_t mipmapMask(int32_t oct) {
+  if (oct < WAVE_MIPMAP_FULL) return TABLE_MASK;
+  return (TABLE_SIZE >> (oct - WAVE_MIPMAP_FULL + 1)) - 1;
+}
+
+// the oscillator at index, 0 <= index < TABLE_SIZE, read from a level of mask+1 floats, see mipmapTable(): the
+// blend kSaw * saw(x) - kSquare * saw(x + half a period), linearly interpolated. scale = (mask+1) / TABLE_SIZE is
+// a power of 2, so the phase maps onto the level exactly. All voices read the same saw_mipmaps.
+inline float lookupWave(const float* table, int32_t mask, float scale, float kSaw, float kSquare, float index) {
+  float x = index * scale;
+  int32_t i = (int32_t)x;
+  int32_t j = (i + (mask >> 1) + 1) & mask;
+  float f = x - (float)i;
+  float v1 = kSaw * table[i] - kSquare * table[j];
+  float v2 = kSaw * table[i+1] - kSquare * table[j+1];
+  return f * (v2 - v1) + v1;
+}
+
+inline void lookupLinearBlock(const float (&table)[TABLE_SIZE+1], const float* index, float* out, int n) {
+  for (int k = 0; k < n; k++) out[k] = lookupLinear(table, index[k]);
+}
+
+inline void lookupCyclicBlock(const float (&table)[TABLE_SIZE+1], const float* index, float* out, int n) {
+  for (int k = 0; k < n; k++) out[k] = lookupCyclic(table, index[k]);
+}
+
+inline void lookupWaveBlock(const float* table, int32_t mask, float scale, float kSaw, float kSquare, const float* index, float* out, int n) {
+  for (int k = 0; k < n; k++) out[k] = lookupWave(table, mask, scale, kSaw, kSquare, index[k]);
+}
+
+inline void lookupBilinearBlock(const float (&table)[16][16], const float* x, const float* y, float* out, int n) {
+  for (int k = 0; k < n; k++) out[k] = lookupBilinear(table, x[k], y[k]);
 }
 
 inline float fclamp(float in, float min, float max){
@@ -133,22 +259,18 @@ inline float fast_shape(float x){
     }
 
   //  if (x<=0.4f) return float(x*sign) * 0.9498724f; // smooth region borders; tanh(x) ~= x, when |x| < 0.4 
-    return  sign * lookupTable(shaper_tbl, (x*SHAPER_LOOKUP_COEF)); // lookup table contains tanh(x), 0 <= x <= 5
+    return  sign * lookupLinear(shaper_tbl, (x*SHAPER_LOOKUP_COEF)); // lookup table contains tanh(x), 0 <= x <= 5
   // float poly = (2.12f-2.88f*x+4.0f*x*x);
    // return sign * x * (poly * one_div(poly * x + 1.0f)); // very good approximation found here https://www.musicdsp.org/en/latest/Other/178-reasonably-accurate-fastish-tanh-approximation.html
                                                     // but it uses float division which is not that fast on esp32
 }
 
 inline float fast_sin(const float x) {
-  const float argument = ((x * ONE_DIV_TWOPI) * TABLE_SIZE);
-  const float res = lookupTable(sin_tbl, CICLE_INDEX(argument)+((float)argument-(int32_t)argument));
-  return res;
+  return lookupCyclic(sin_tbl, (x * ONE_DIV_TWOPI) * TABLE_SIZE);
 }
 
 inline float fast_cos(const float x) {  
-  const float argument = ((x * ONE_DIV_TWOPI + 0.25f) * TABLE_SIZE);
-  const float res = lookupTable(sin_tbl, CICLE_INDEX(argument)+((float)argument-(int32_t)argument));
-  return res;
+  return lookupCyclic(sin_tbl, (x * ONE_DIV_TWOPI + 0.25f) * TABLE_SIZE);
 }
 
 inline void fast_sincos(const float x, float* sinRes, float* cosRes){
@@ -159,6 +281,9 @@ inline void fast_sincos(const float x, float* sinRes, float* cosRes){
 
 // reciprocal asm injection for xtensa LX6 FPU
 static __attribute__((always_inline)) inline float one_div(float a) {
+#ifndef __XTENSA__
+    return 1.0f / a; // host builds
+#else
     float result;
     asm volatile (
         "wfr f1, %1"          "\n\t"
@@ -175,6 +300,7 @@ static __attribute__((always_inline)) inline float one_div(float a) {
         : "f0","f1","f2"
     );
     return result;
+#endif
 }
 
 inline float dB2amp(float dB){
@@ -215,5 +341,5 @@ inline float expToLin(float in, float inMin, float inMax, float outMin, float ou
 }
 
 inline float knobMap(float in, float outMin, float outMax) {
-  return outMin + lookupTable(knob_tbl, (int)(in * TABLE_SIZE)) * (outMax - outMin);
+  return outMin + lookupLinear(knob_tbl, (int)(in * TABLE_SIZE)) * (outMax - outMin);
 }
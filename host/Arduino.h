@@ -0,0 +1,197 @@
+/*
+ * Host (Linux) stand-in for the bits of Arduino-ESP32 / FreeRTOS that the AcidBox DSP code touches.
+ * It is only used by the host render target (see host/README.md), the firmware never sees it.
+ *
+ * Time is virtual: millis() and micros() follow the number of rendered samples, so the JUKEBOX
+ * sequencer runs at the right tempo no matter how fast we render, and two renders with the same
+ * seed produce bit-identical output.
+ */
+#pragma once
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#define HOST_RENDER
+
+#ifndef ESP_ARDUINO_VERSION_MAJOR
+#define ESP_ARDUINO_VERSION_MAJOR 3
+#endif
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW  0
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+#define INPUT_PULLDOWN  0x09
+#define SERIAL_8N1      0x800001c
+
+// classic Arduino helpers, as macros, after all the std headers are in
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// =============================================================== virtual time ===============================================================
+
+extern uint64_t host_sample_clock;    // samples rendered so far, advanced by the render loop
+extern const uint32_t host_sample_rate;
+
+inline unsigned long micros() { return (unsigned long)(host_sample_clock * 1000000ULL / host_sample_rate); }
+inline unsigned long millis() { return (unsigned long)(host_sample_clock * 1000ULL / host_sample_rate); }
+inline void delay(uint32_t) {}
+inline void delayMicroseconds(uint32_t) {}
+
+// =============================================================== GPIO, ADC ===============================================================
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int  digitalRead(uint8_t) { return HIGH; } // buttons are pulled up, i.e. released
+inline uint16_t analogRead(uint8_t) { return 0; }
+inline void btStop() {}
+
+// =============================================================== random ===============================================================
+
+extern uint32_t host_random_state;
+
+inline void randomSeed(unsigned long seed) { host_random_state = (uint32_t)seed ? (uint32_t)seed : 1; }
+inline long random(long howbig) {
+  if (howbig <= 0) return 0;
+  host_random_state ^= host_random_state << 13; // xorshift32, deterministic across hosts
+  host_random_state ^= host_random_state >> 17;
+  host_random_state ^= host_random_state << 5;
+  return (long)(host_random_state % (uint32_t)howbig);
+}
+inline long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+// =============================================================== String ===============================================================
+
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+    String(char c) : std::string(1, c) {}
+    String(unsigned char v) : std::string(std::to_string(v)) {}
+    String(int v) : std::string(std::to_string(v)) {}
+    String(unsigned int v) : std::string(std::to_string(v)) {}
+    String(long v) : std::string(std::to_string(v)) {}
+    String(unsigned long v) : std::string(std::to_string(v)) {}
+    String substring(size_t from, size_t to) const { return String(substr(from, to - from)); }
+    String substring(size_t from) const { return String(substr(from)); }
+};
+
+inline String operator+(const String& a, const String& b) { return String((const std::string&)a + (const std::string&)b); }
+inline String operator+(const String& a, const char* b) { return String((const std::string&)a + b); }
+inline String operator+(const char* a, const String& b) { return String(a + (const std::string&)b); }
+inline String operator+(const String& a, char b) { return String((const std::string&)a + b); }
+
+// =============================================================== Serial ===============================================================
+
+class HostSerial {
+  public:
+    void begin(unsigned long, ...) {}
+    template <typename T> void print(T v) { fputs(toStr(v).c_str(), stderr); }
+    template <typename T> void println(T v) { print(v); fputc('\n', stderr); }
+    void println() { fputc('\n', stderr); }
+    void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+      va_list args;
+      va_start(args, fmt);
+      vfprintf(stderr, fmt, args);
+      va_end(args);
+    }
+  private:
+    static std::string toStr(const char* v) { return v; }
+    static std::string toStr(const std::string& v) { return v; }
+    static std::string toStr(char v) { return std::string(1, v); }
+    template <typename T> static std::string toStr(T v) { return std::to_string(v); }
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial2;
+typedef HostSerial HardwareSerial;
+
+// =============================================================== memory ===============================================================
+
+#define MALLOC_CAP_8BIT     (1<<2)
+#define MALLOC_CAP_SPIRAM   (1<<10)
+#define MALLOC_CAP_INTERNAL (1<<11)
+
+inline void* ps_malloc(size_t size) { return malloc(size); }
+inline void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline void  heap_caps_print_heap_info(uint32_t) {}
+inline size_t heap_caps_get_free_size(uint32_t) { return 1UL << 30; }
+inline bool psramFound() { return true; }
+inline bool psramInit() { return true; }
+
+// =============================================================== FreeRTOS ===============================================================
+// Tasks are never started on the host: the render loop calls the generators itself, in the order the two
+// audio tasks would run them.
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          1
+#define portMAX_DELAY   0xffffffffUL
+#define portPRIVILEGE_BIT 0
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+  if (handle) *handle = NULL;
+  return pdPASS;
+}
+inline BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle) {
+  if (handle) *handle = NULL;
+  return pdPASS;
+}
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t) {}
+inline void taskYIELD() {}
+inline void xTaskNotifyGive(TaskHandle_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 1; }
+inline BaseType_t xPortGetCoreID() { return 0; }
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(m)     do { (void)(m); } while (0)
+#define portEXIT_CRITICAL(m)      do { (void)(m); } while (0)
+#define portENTER_CRITICAL_ISR(m) do { (void)(m); } while (0)
+#define portEXIT_CRITICAL_ISR(m)  do { (void)(m); } while (0)
+
+// =============================================================== timers ===============================================================
+
+typedef struct hw_timer_s { int dummy; } hw_timer_t;
+inline hw_timer_t* timerBegin(uint32_t) { static hw_timer_t t; return &t; }
+inline void timerAttachInterrupt(hw_timer_t*, void (*)()) {}
+inline void timerAlarm(hw_timer_t*, uint64_t, bool, uint64_t) {}
+
+#endif
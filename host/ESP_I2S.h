@@ -0,0 +1,70 @@
+/*
+ * Host stand-in for the Arduino-ESP32 v3 I2S driver: whatever i2s_output() pushes to the "DAC"
+ * goes to a 16 bit stereo WAV file, or nowhere at all (null sink, for profiling).
+ */
+#pragma once
+#ifndef HOST_ESP_I2S_H
+#define HOST_ESP_I2S_H
+
+#include "Arduino.h"
+
+typedef enum { I2S_MODE_STD } i2s_mode_t;
+typedef enum { I2S_DATA_BIT_WIDTH_16BIT = 16 } i2s_data_bit_width_t;
+typedef enum { I2S_SLOT_MODE_MONO = 1, I2S_SLOT_MODE_STEREO = 2 } i2s_slot_mode_t;
+
+class I2SClass {
+  public:
+    /** Sets the output file, NULL or "" selects the null sink. Call before begin(). */
+    void setOutputFile(const char* path) { _path = path ? path : ""; }
+
+    void setPins(int8_t, int8_t, int8_t, int8_t = -1, int8_t = -1) {}
+
+    bool begin(i2s_mode_t, uint32_t rate, i2s_data_bit_width_t bits, i2s_slot_mode_t slots) {
+      _rate = rate;
+      _bits = bits;
+      _channels = slots;
+      _dataBytes = 0;
+      if (_path.empty()) return true;
+      _fp = fopen(_path.c_str(), "wb");
+      if (_fp == NULL) return false;
+      writeHeader(); // placeholder, sizes are patched in end()
+      return true;
+    }
+
+    size_t write(const uint8_t* buf, size_t len) {
+      _dataBytes += len;
+      if (_fp) return fwrite(buf, 1, len, _fp);
+      return len;
+    }
+
+    void end() {
+      if (_fp == NULL) return;
+      fseek(_fp, 0, SEEK_SET);
+      writeHeader();
+      fclose(_fp);
+      _fp = NULL;
+    }
+
+    uint64_t bytesWritten() const { return _dataBytes; }
+
+  private:
+    void put32(uint32_t v) { uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)}; fwrite(b, 1, 4, _fp); }
+    void put16(uint16_t v) { uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)}; fwrite(b, 1, 2, _fp); }
+    void writeHeader() {
+      uint32_t data = (_dataBytes > 0xFFFFFFDBULL) ? 0xFFFFFFDBUL : (uint32_t)_dataBytes;
+      uint16_t frame = _channels * (_bits / 8);
+      fwrite("RIFF", 1, 4, _fp); put32(36 + data);
+      fwrite("WAVEfmt ", 1, 8, _fp); put32(16);
+      put16(1); put16(_channels); put32(_rate); put32(_rate * frame); put16(frame); put16(_bits);
+      fwrite("data", 1, 4, _fp); put32(data);
+    }
+
+    std::string _path;
+    FILE* _fp = NULL;
+    uint32_t _rate = 44100;
+    uint16_t _bits = 16;
+    uint16_t _channels = 2;
+    uint64_t _dataBytes = 0;
+};
+
+#endif
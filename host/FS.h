@@ -0,0 +1,129 @@
+/*
+ * Host stand-in for the Arduino-ESP32 fs::FS / fs::File API, backed by a plain directory.
+ * The root directory plays the role of the flash partition, normally it is the repo's /data folder,
+ * i.e. exactly what gets uploaded to LittleFS.
+ */
+#pragma once
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include "Arduino.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File {
+  public:
+    File() {}
+    File(const std::string& fullPath, const std::string& name, const char* mode) : _path(fullPath), _name(name) {
+      struct stat st;
+      if (stat(fullPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        _isDir = true;
+        _valid = true;
+        DIR* d = opendir(fullPath.c_str());
+        if (d) {
+          struct dirent* e;
+          while ((e = readdir(d)) != NULL) {
+            if (e->d_name[0] == '.') continue;
+            _entries.push_back(e->d_name);
+          }
+          closedir(d);
+        }
+        std::sort(_entries.begin(), _entries.end()); // LittleFS lists in name order as well
+      } else {
+        _fp = fopen(fullPath.c_str(), (mode[0] == 'r') ? "rb" : (mode[0] == 'a') ? "ab" : "wb");
+        _valid = (_fp != NULL);
+      }
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    File(File&& o) { *this = std::move(o); }
+    File& operator=(File&& o) {
+      close();
+      _fp = o._fp; o._fp = NULL;
+      _valid = o._valid; o._valid = false;
+      _isDir = o._isDir;
+      _path = o._path;
+      _name = o._name;
+      _entries = o._entries;
+      _next = o._next;
+      return *this;
+    }
+    ~File() { close(); }
+
+    operator bool() const { return _valid; }
+    bool isDirectory() const { return _isDir; }
+    const char* name() const { return _name.c_str(); }
+    const char* path() const { return _path.c_str(); }
+
+    size_t size() {
+      if (!_fp) return 0;
+      long pos = ftell(_fp);
+      fseek(_fp, 0, SEEK_END);
+      long sz = ftell(_fp);
+      fseek(_fp, pos, SEEK_SET);
+      return (size_t)sz;
+    }
+    size_t read(uint8_t* buf, size_t len) { return _fp ? fread(buf, 1, len, _fp) : 0; }
+    size_t write(const uint8_t* buf, size_t len) { return _fp ? fwrite(buf, 1, len, _fp) : 0; }
+    bool seek(uint32_t pos) { return _fp && fseek(_fp, pos, SEEK_SET) == 0; }
+    size_t position() { return _fp ? (size_t)ftell(_fp) : 0; }
+    int available() { return _fp ? (int)(size() - position()) : 0; }
+
+    File openNextFile(const char* mode = FILE_READ) {
+      if (!_isDir || _next >= _entries.size()) return File();
+      const std::string& n = _entries[_next++];
+      return File(_path + "/" + n, n, mode);
+    }
+
+    void close() {
+      if (_fp) fclose(_fp);
+      _fp = NULL;
+      _valid = false;
+    }
+
+  private:
+    FILE* _fp = NULL;
+    bool _valid = false;
+    bool _isDir = false;
+    std::string _path;
+    std::string _name;
+    std::vector<std::string> _entries;
+    size_t _next = 0;
+};
+
+class FS {
+  public:
+    void setRoot(const char* root) { _root = root; }
+    const char* getRoot() const { return _root.c_str(); }
+    bool begin(bool formatOnFail = false) {
+      struct stat st;
+      return stat(_root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    File open(const char* path, const char* mode = FILE_READ) {
+      std::string p = path;
+      std::string name = p.substr(p.find_last_of('/') + 1);
+      return File(_root + p, name, mode);
+    }
+    bool exists(const char* path) {
+      struct stat st;
+      return stat((_root + path).c_str(), &st) == 0;
+    }
+    bool mkdir(const String& path) { return ::mkdir((_root + path.c_str()).c_str(), 0755) == 0; }
+
+  private:
+    std::string _root = "data";
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+extern fs::FS LittleFS;
+
+#endif
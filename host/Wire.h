@@ -0,0 +1,2 @@
+#pragma once
+// nothing on the I2C bus is used by the host render target
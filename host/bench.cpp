@@ -0,0 +1,270 @@
+/*
+ * acidbox_bench: host micro-benchmarks of the DSP code, wall clock time per DMA_BUF_LEN block.
+ *
+ * Figures are relative, like the render report: compare two code paths or two versions on the same machine.
+ *
+ * usage: acidbox_bench [-t seconds] [-n max_voices] [-d data_dir]
+ */
+#include "sketch.h"
+
+static double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================ SynthKernel vs. voice by voice ============================================
+
+#define BENCH_VOICES 16
+
+// sixteenths on every voice, each a few samples apart and on its own root, with slides and accents
+static void bench_events(MidiQueue& q, int v, int step, uint32_t time) {
+  static const uint8_t notes[] = {36, 48, 39, 36, 51, 43, 36, 46};
+  int n = step % 8, prev = (step + 7) % 8;
+  bool slide = (n == 2 || n == 5);
+  if (!slide) q.Push({time, MIDI_EVENT_NOTE_OFF, (uint8_t)(notes[prev] + v), 0});
+  q.Push({time, MIDI_EVENT_NOTE_ON, (uint8_t)(notes[n] + v), (int16_t)((n & 1) ? 127 : 80)});
+  if (slide) q.Push({time, MIDI_EVENT_NOTE_OFF, (uint8_t)(notes[prev] + v), 0});
+  q.Push({time, MIDI_EVENT_CC, CC_303_CUTOFF, (int16_t)((step * 13 + v * 17) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_RESO, (int16_t)((step * 29 + 64) & 127)});
+}
+
+// renders the same tune with n voices, one by one or through the kernel, returns us per block
+static double bench_voices(int n, bool kernel, uint32_t blocks) {
+  static SynthVoice voices[BENCH_VOICES];
+  MidiQueue events[BENCH_VOICES];
+  static float bufs[BENCH_VOICES][DMA_BUF_LEN];
+  static SynthKernel k;
+  SynthVoice* synths[BENCH_VOICES];
+  MidiQueue* queues[BENCH_VOICES];
+  float* outs[BENCH_VOICES];
+  int step[BENCH_VOICES];
+  for (int v = 0; v < n; v++) {
+    voices[v].Init();
+    synths[v] = &voices[v];
+    queues[v] = &events[v];
+    outs[v] = bufs[v];
+    step[v] = 0;
+  }
+  const uint32_t stepLen = (uint32_t)(15.0f * SAMPLE_RATE / bpm);
+  double total = 0.0;
+  for (uint32_t clock = 0; clock < blocks * DMA_BUF_LEN; clock += DMA_BUF_LEN) {
+    for (int v = 0; v < n; v++) {
+      uint32_t time = step[v] * stepLen + v * 7;
+      if (time < clock + DMA_BUF_LEN) bench_events(events[v], v, step[v]++, time);
+    }
+    double t = now_us();
+    if (kernel) {
+      for (int v = 0; v < n; v += SYNTH_KERNEL_LANES) {
+        kernel_generate(k, synths + v, queues + v, outs + v, (n - v < SYNTH_KERNEL_LANES) ? n - v : SYNTH_KERNEL_LANES, clock);
+      }
+    } else {
+      for (int v = 0; v < n; v++) synth_generate(voices[v], events[v], bufs[v], clock);
+    }
+    total += now_us() - t;
+  }
+  return total / blocks;
+}
+
+static void bench_synth_kernel(float seconds, int maxVoices) {
+  uint32_t blocks = (uint32_t)(seconds * SAMPLE_RATE / DMA_BUF_LEN);
+  printf("SynthKernel (%d lanes) vs. voice by voice, %.1f s per figure, us per %d-sample block (budget %.0f us)\n",
+         SYNTH_KERNEL_LANES, seconds, DMA_BUF_LEN, 1e6 * DMA_BUF_LEN / SAMPLE_RATE);
+  printf("voices   one by one  per voice    kernel  per voice   speedup\n");
+  for (int n = 1; n <= maxVoices; n++) {
+    double one = bench_voices(n, false, blocks);
+    double ker = bench_voices(n, true, blocks);
+    printf("%6d  %10.2f %10.2f %9.2f %10.2f %8.2fx\n", n, one, one / n, ker, ker / n, one / ker);
+  }
+}
+
+// ============================================ Oscillator: two naive tables vs. one mipmap level ============================================
+
+// the baseline oscillator: exp-square and exp-saw tables, each linearly interpolated, then blended
+static float bench_square_tbl[TABLE_SIZE+1];
+
+static void bench_osc_naive(const float* ph, float* out, float mix, int n) {
+  float sq[DMA_BUF_LEN];
+  lookupLinearBlock(bench_square_tbl, ph, sq, n);
+  lookupLinearBlock(saw_tbl, ph, out, n);
+  for (int i = 0; i < n; i++) out[i] = (1.0f - mix) * sq[i] + mix * out[i];
+}
+
+// phases of a tone at step, returns ns per sample of the naive tables or of lookupWaveBlock()
+static double bench_osc(bool mipmaps, float step, uint32_t blocks) {
+  static float ph[DMA_BUF_LEN], out[DMA_BUF_LEN];
+  const float mix = 0.3f, kSquare = 0.66f * (1.0f - mix), kSaw = mix + kSquare;
+  int32_t oct = mipmapOctave(step), mask = mipmapMask(oct);
+  const float* t = mipmapTable(oct);
+  float scale = (float)(mask + 1) / TABLE_SIZE, phase = 0.0f, sink = 0.0f;
+  double total = 0.0;
+  for (uint32_t b = 0; b < blocks; b++) {
+    for (int i = 0; i < DMA_BUF_LEN; i++) {
+      ph[i] = phase;
+      phase += step;
+      if (phase >= (float)TABLE_SIZE) phase -= (float)TABLE_SIZE;
+    }
+    double t0 = now_us();
+    if (mipmaps) lookupWaveBlock(t, mask, scale, kSaw, kSquare, ph, out, DMA_BUF_LEN);
+    else bench_osc_naive(ph, out, mix, DMA_BUF_LEN);
+    total += now_us() - t0;
+    sink += out[b % DMA_BUF_LEN];
+  }
+  if (sink == 12345.0f) printf(" "); // keeps the lookups from being optimized away
+  return 1e3 * total / blocks / DMA_BUF_LEN;
+}
+
+static void bench_oscillator(float seconds) {
+  for (int i = 0; i <= TABLE_SIZE; i++) { // exp-square as the baseline built it from the saw
+    bench_square_tbl[i] = 0.66f * (saw_tbl[i & TABLE_MASK] - saw_tbl[(i + TABLE_SIZE / 2) & TABLE_MASK]);
+  }
+  uint32_t blocks = (uint32_t)(seconds * SAMPLE_RATE / DMA_BUF_LEN);
+  printf("\nOscillator, %.1f s per figure, ns per sample\n", seconds);
+  printf("  note  level  naive tables  mipmap level   ratio\n");
+  for (int note : {24, 48, 72, 96, 120}) {
+    float step = midi_tbl_steps[note];
+    double naive = bench_osc(false, step, blocks);
+    double band = bench_osc(true, step, blocks);
+    printf("%6d %6d %13.3f %13.3f %7.2f\n", note, (int)mipmapOctave(step), naive, band, band / naive);
+  }
+}
+
+// ============================================ Sampler: int16 vs. ADPCM store ============================================
+
+#define BENCH_HITS 8
+
+// BENCH_HITS voices through the read loop of Sampler::ProcessBlock(), from int16 frames or decoding ADPCM
+// (SAMPLER_ADPCM), each restarting at its own offset when it runs out. Returns us per block and voice.
+static double bench_store(bool adpcm, float pitch, uint32_t blocks) {
+  static std::vector<int16_t> pcm;
+  static std::vector<uint8_t> store;
+  if (pcm.empty()) {
+    uint32_t r = 1;
+    pcm.resize(SAMPLE_RATE);
+    for (size_t i = 0; i < pcm.size(); i++) {
+      r = r * 1664525u + 1013904223u;
+      pcm[i] = (int16_t)((sinf(i * 0.02f) * 12000.0f + (int16_t)(r >> 16) * 0.3f) * expf(-3.0f * i / pcm.size()));
+    }
+    store.resize(AdpcmBytes(pcm.size()));
+    AdpcmEncoder enc;
+    enc.Begin(store.data());
+    for (int16_t x : pcm) enc.Push(x);
+    enc.End();
+  }
+  static float left[DMA_BUF_LEN], right[DMA_BUF_LEN];
+  const uint32_t size = pcm.size();
+  float pos[BENCH_HITS];
+  AdpcmDecoder dec[BENCH_HITS];
+  for (int v = 0; v < BENCH_HITS; v++) {
+    pos[v] = v * 254.0f;
+    dec[v].Seek(store.data(), pos[v], size);
+  }
+  double total = 0.0;
+  for (uint32_t b = 0; b < blocks; b++) {
+    double t = now_us();
+    for (int i = 0; i < DMA_BUF_LEN; i++) left[i] = right[i] = 0.0f;
+    for (int v = 0; v < BENCH_HITS; v++) {
+      float samplePosF = pos[v], vel = 1.0f;
+      AdpcmDecoder d = dec[v];
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        uint32_t samplePos = samplePosF;
+        int32_t x;
+        if (adpcm) x = d.Get(store.data(), samplePos);
+        else x = pcm[samplePos < size ? samplePos : 0];
+        float signal = 0.7f * ((float)x) * 0.00005f;
+        left[i] += signal * vel * 0.4f;
+        right[i] += signal * vel * 0.6f;
+        vel *= 0.99999f;
+        samplePosF += pitch;
+        if (samplePos + 1 >= size) {
+          samplePosF = v * 254.0f;
+          d.Seek(store.data(), samplePosF, size);
+        }
+      }
+      pos[v] = samplePosF;
+      dec[v] = d;
+    }
+    total += now_us() - t;
+  }
+  return total / blocks / BENCH_HITS;
+}
+
+static void bench_sampler_store(float seconds) {
+  uint32_t blocks = (uint32_t)(seconds * SAMPLE_RATE / DMA_BUF_LEN);
+  printf("\nSampler store, %d hits, %.1f s per figure, us per %d-sample block and voice (budget %.0f us)\n",
+         BENCH_HITS, seconds, DMA_BUF_LEN, 1e6 * DMA_BUF_LEN / SAMPLE_RATE);
+  printf(" pitch      int16      ADPCM   decode cost\n");
+  for (float pitch : {0.5f, 1.0f, 2.0f, 4.0f}) {
+    double pcm = bench_store(false, pitch, blocks);
+    double adpcm = bench_store(true, pitch, blocks);
+    printf("%6.1f %10.3f %10.3f %10.3f\n", pitch, pcm, adpcm, adpcm - pcm);
+  }
+}
+
+// ============================================ Sampler: interpolation modes ============================================
+
+// kit 6 with all its hits retriggered every 50 ms at changing pitches, through Sampler::ProcessBlock() with
+// the kit's interpolation set to mode. Returns us per block, voices gets the average number of sounding hits.
+static double bench_interp(int mode, uint32_t blocks, double& voices) {
+  static Sampler d(6);
+  static bool loaded = false;
+  if (!loaded) {
+    d.Init();
+    loaded = true;
+  }
+  d.SetInterpolation(mode);
+  static float left[DMA_BUF_LEN], right[DMA_BUF_LEN];
+  const uint32_t every = SAMPLE_RATE / 20 / DMA_BUF_LEN;
+  double total = 0.0, sounding = 0.0;
+  for (uint32_t b = 0; b < blocks; b++) {
+    if (b % every == 0) {
+      int hit = b / every;
+      for (int note = 0; note < d.GetSamplesCount(); note++) {
+        d.ParseCC(CC_808_NOTE_SEL, note);
+        d.ParseCC(CC_808_PITCH, (hit * 37 + note * 11) & 127);
+        d.NoteOn(note, 100);
+      }
+    }
+    sounding += d.GetActiveCount();
+    double t = now_us();
+    d.ProcessBlock(left, right, DMA_BUF_LEN);
+    total += now_us() - t;
+  }
+  voices = sounding / blocks;
+  return total / blocks;
+}
+
+static void bench_sampler_interp(float seconds) {
+  static const char* names[INTERP_MODES] = {"none", "linear", "Hermite", "sinc"};
+  uint32_t blocks = (uint32_t)(seconds * SAMPLE_RATE / DMA_BUF_LEN);
+  printf("\nSampler interpolation, kit 6, %.1f s per figure, us per %d-sample block (budget %.0f us)\n",
+         seconds, DMA_BUF_LEN, 1e6 * DMA_BUF_LEN / SAMPLE_RATE);
+  printf("mode       block  voices  per voice  over none, ns per voice and sample\n");
+  double none = 0.0;
+  for (int mode = INTERP_NONE; mode < INTERP_MODES; mode++) {
+    double voices;
+    double us = bench_interp(mode, blocks, voices);
+    if (mode == INTERP_NONE) none = us;
+    printf("%-8s %7.2f %7.1f %10.3f %10.2f\n", names[mode], us, voices, us / voices, 1e3 * (us - none) / voices / DMA_BUF_LEN);
+  }
+}
+
+// ==================================================================================================================================
+
+int main(int argc, char** argv) {
+  float seconds = 2.0f;
+  int maxVoices = 12;
+  const char* dataDir = "../data";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) maxVoices = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc) dataDir = argv[++i];
+    else { fprintf(stderr, "usage: %s [-t seconds] [-n max_voices] [-d data_dir]\n", argv[0]); return 1; }
+  }
+  if (maxVoices < 1 || maxVoices > BENCH_VOICES) maxVoices = BENCH_VOICES;
+  LittleFS.setRoot(dataDir);
+  buildTables();
+  bench_synth_kernel(seconds, maxVoices);
+  bench_oscillator(seconds);
+  bench_sampler_store(seconds);
+  bench_sampler_interp(seconds);
+  return 0;
+}
@@ -0,0 +1,1624 @@
+/*
+ * acidbox_check: host regression checks for the DSP code.
+ *
+ * Each check drives the real engine classes with a fixed script and compares two code paths that
+ * must agree (e.g. per-sample vs. block processing). Exit code is the number of failed checks.
+ *
+ * usage: acidbox_check [-d data_dir]
+ */
+#include "sketch.h"
+#include "kitpack.h"
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { failures++; fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } \
+  } while (0)
+
+// ============================================ SynthVoice: getSample() vs ProcessBlock() ============================================
+
+// a short acid line with slides, accents and knob moves, so every stage of the voice is exercised
+static void synth_script(SynthVoice& v, int step) {
+  static const uint8_t notes[] = {36, 48, 39, 36, 51, 43, 36, 46};
+  int n = step % 8;
+  if (n == 2 || n == 5) v.SetSlideOn(); else v.SetSlideOff();
+  v.on_midi_noteON(notes[n], (n & 1) ? 127 : 80);
+  v.ParseCC(CC_303_CUTOFF, (step * 13) & 127);
+  v.ParseCC(CC_303_RESO, (step * 29 + 64) & 127);
+  v.ParseCC(CC_303_ENVMOD_LVL, (step * 7 + 30) & 127);
+  v.ParseCC(CC_303_OVERDRIVE, (step * 5) & 127);
+  v.ParseCC(CC_303_DISTORTION, (step * 3) & 127);
+  v.ParseCC(CC_303_WAVEFORM, (step & 4) ? 0 : 127);
+}
+
+static void check_synth_block() {
+  SynthVoice ref(0), blk(0);
+  ref.Init();
+  blk.Init();
+  static const size_t sizes[] = {DMA_BUF_LEN, 1, 7, 64, 100, 3};
+  const int stepLen = SAMPLE_RATE / 8;
+  float buf[128];
+  int mismatches = 0;
+  float worst = 0.0f;
+  double energy = 0.0, err = 0.0;
+  for (int i = 0; i < SAMPLE_RATE / 10; i += DMA_BUF_LEN) { // idle for a while first, as after boot
+    blk.ProcessBlock(buf, DMA_BUF_LEN);
+    for (int j = 0; j < DMA_BUF_LEN; j++) ref.getSample();
+  }
+  for (int step = 0; step < 24; step++) {
+    synth_script(ref, step);
+    synth_script(blk, step);
+    if (step % 4 == 3) { ref.on_midi_noteOFF(36, 0); blk.on_midi_noteOFF(36, 0); }
+    int done = 0;
+    for (int k = 0; done < stepLen; k++) {
+      size_t n = sizes[k % 6];
+      if (n > (size_t)(stepLen - done)) n = stepLen - done;
+      blk.ProcessBlock(buf, n);
+      for (size_t i = 0; i < n; i++) {
+        float r = ref.getSample();
+        energy += (double)r * r;
+        if (r != buf[i]) {
+          mismatches++;
+          err += (double)(r - buf[i]) * (r - buf[i]);
+          if (fabsf(r - buf[i]) > worst) worst = fabsf(r - buf[i]);
+        }
+      }
+      done += n;
+    }
+  }
+  CHECK(energy > 1.0, "SynthVoice script renders silence");
+#if FILTER_CONTROL_RATE == 1
+  CHECK(mismatches == 0, "SynthVoice::ProcessBlock() differs from getSample() in %d samples, worst %g", mismatches, worst);
+#else
+  // getSample() updates the filter every sample, ProcessBlock() at the control rate. The difference
+  // right after the filter is what check_filter_decimation() bounds, here the distortion stage at high
+  // drive magnifies it, so the bound is looser.
+  float err_dB = (float)(10.0 * log10((err + 1e-30) / (energy + 1e-30)));
+  fprintf(stderr, "  SynthVoice at filter control rate %d: error %6.1f dB re signal\n", FILTER_CONTROL_RATE, err_dB);
+  CHECK(err_dB < -36.0f, "SynthVoice::ProcessBlock() is off by %.1f dB, worst sample %g", err_dB, worst);
+#endif
+}
+
+// ============================================ lookup kernels ============================================
+
+// the lookups as they were, with function-level statics, single threaded reference
+static float old_lookupTable(float (&table)[TABLE_SIZE+1], float index) {
+  static float v1, v2, res;
+  static int32_t i;
+  static float f;
+  i = (int32_t)index;
+  f = (float)index - i;
+  v1 = (table)[i];
+  v2 = (table)[i+1];
+  res = (float)f * (float)(v2-v1) + v1;
+  return res;
+}
+
+static float old_bilinearLookup(float (&table)[16][16], float x, float y) {
+  static float kmap = 0.1181f;
+  int32_t i, j;
+  float fi, fj, v1, v2, v3, v4, res1, res2, res3;
+  x *= kmap;
+  y *= kmap;
+  i = (int32_t)x;
+  j = (int32_t)y;
+  fi = (float)x - i;
+  fj = (float)y - j;
+  v1 = table[i][j];
+  v2 = table[i+1][j];
+  v3 = table[i][j+1];
+  v4 = table[i+1][j+1];
+  res1 = (float)fi * (float)(v2-v1) + v1;
+  res2 = (float)fi * (float)(v4-v3) + v3;
+  res3 = (float)fj * (float)(res2-res1) + res1;
+  return res3;
+}
+
+static float old_fast_sin(const float x) {
+  const float argument = ((x * ONE_DIV_TWOPI) * TABLE_SIZE);
+  return old_lookupTable(sin_tbl, CICLE_INDEX(argument)+((float)argument-(int32_t)argument));
+}
+
+static void check_lookup_kernels() {
+  const int n = 4096;
+  std::vector<float> idx(n), cyc(n), bx(n), by(n), a(n), b(n);
+  for (int k = 0; k < n; k++) {
+    idx[k] = (float)random(0, TABLE_SIZE * 1000) * 0.001f;            // 0 .. TABLE_SIZE
+    cyc[k] = (float)random(-8 * TABLE_SIZE * 256, 8 * TABLE_SIZE * 256) / 256.0f; // several periods either way
+    bx[k]  = (float)random(0, 127 * 100) * 0.01f;                     // MIDI 0 .. 127
+    by[k]  = (float)random(0, 127 * 100) * 0.01f;
+  }
+
+  // linear: same as before, block == scalar
+  int diff = 0;
+  lookupLinearBlock(exp_tbl, idx.data(), b.data(), n);
+  for (int k = 0; k < n; k++) {
+    a[k] = lookupLinear(exp_tbl, idx[k]);
+    diff += (a[k] != old_lookupTable(exp_tbl, idx[k])) + (a[k] != b[k]);
+  }
+  CHECK(diff == 0, "lookupLinear: %d mismatches against the old lookupTable() or the block variant", diff);
+
+  // bilinear: same as before, block == scalar
+  diff = 0;
+  for (int k = 0; k < n; k++) { bx[k] *= NORM_TBL_KMAP; by[k] *= NORM_TBL_KMAP; }
+  lookupBilinearBlock(norm1_tbl, bx.data(), by.data(), b.data(), n);
+  for (int k = 0; k < n; k++) {
+    a[k] = lookupBilinear(norm1_tbl, bx[k], by[k]);
+    diff += (a[k] != b[k]);
+  }
+  for (int c1 = 0; c1 < 128; c1++)
+    for (int c2 = 0; c2 < 128; c2++)
+      diff += (lookupBilinear(norm1_tbl, c1 * NORM_TBL_KMAP, c2 * NORM_TBL_KMAP) != old_bilinearLookup(norm1_tbl, c1, c2));
+  CHECK(diff == 0, "lookupBilinear: %d mismatches against the old bilinearLookup() or the block variant", diff);
+
+  // cyclic: block == scalar, one period shift changes nothing, matches the plain lookup inside the table
+  diff = 0;
+  lookupCyclicBlock(sin_tbl, cyc.data(), b.data(), n);
+  for (int k = 0; k < n; k++) {
+    a[k] = lookupCyclic(sin_tbl, cyc[k]);
+    diff += (a[k] != b[k]);
+    diff += (a[k] != lookupCyclic(sin_tbl, cyc[k] + (float)TABLE_SIZE));
+    float inside = cyc[k] - (float)TABLE_SIZE * floorf(cyc[k] / (float)TABLE_SIZE);
+    diff += (a[k] != lookupLinear(sin_tbl, inside));
+  }
+  CHECK(diff == 0, "lookupCyclic: %d mismatches against the block variant, shifted period or plain lookup", diff);
+
+  // fast_sin() moved from the old two step index to lookupCyclic(), which keeps the full fraction
+  float worst = 0.0f;
+  for (int k = 0; k < n; k++) {
+    float x = (float)k * (4.0f * TWOPI / (float)n);
+    worst = fmax(worst, fabs(fast_sin(x) - old_fast_sin(x)));
+  }
+  CHECK(worst < 1e-5f, "fast_sin() moved by %g", worst);
+
+  // reentrancy: both "cores" hammer the kernels at once, results must match the single threaded ones
+  std::atomic<int> bad(0);
+  auto worker = [&](const float (*table)[TABLE_SIZE+1], const std::vector<float>* ref) {
+    for (int pass = 0; pass < 200; pass++)
+      for (int k = 0; k < n; k++)
+        if (lookupLinear(*table, idx[k]) != (*ref)[k]) bad++;
+  };
+  std::vector<float> refExp(n), refSaw(n);
+  for (int k = 0; k < n; k++) { refExp[k] = lookupLinear(exp_tbl, idx[k]); refSaw[k] = lookupLinear(saw_tbl, idx[k]); }
+  std::thread core0(worker, &exp_tbl, &refExp), core1(worker, &saw_tbl, &refSaw);
+  core0.join();
+  core1.join();
+  CHECK(bad == 0, "lookupLinear() gave %d wrong results when called from two threads", bad.load());
+}
+
+// ============================================ band-limited oscillator mipmaps ============================================
+
+// DFT bin energy of x[] (Goertzel, double precision)
+static double bin_energy(const std::vector<float>& x, int bin) {
+  double w = 2.0 * M_PI * bin / (double)x.size(), c = 2.0 * cos(w), s1 = 0.0, s2 = 0.0;
+  for (float v : x) { double s0 = v + c * s1 - s2; s2 = s1; s1 = s0; }
+  return s1 * s1 + s2 * s2 - c * s1 * s2;
+}
+
+// Energy outside the harmonics of a tone that does exactly K cycles in x.size() samples, dB re the harmonics,
+// counted below bin maxBin only (0 = whole band). Whatever the oscillator produces is a function of the
+// phase, so the only non-harmonic energy is aliasing.
+static double alias_dB(const std::vector<float>& x, int K, int maxBin = 0) {
+  const int n = x.size();
+  double harm = bin_energy(x, 0), alias = 0.0;
+  for (int b = K; b < n / 2; b += K) harm += 2.0 * bin_energy(x, b);
+  if (maxBin == 0) {
+    for (float v : x) alias += (double)v * v;
+    alias -= harm / n;
+  } else {
+    for (int b = 1; b < maxBin; b++) if (b % K) alias += 2.0 * bin_energy(x, b);
+    alias /= n;
+  }
+  return 10.0 * log10(fmax(alias, 1e-30) / (harm / n));
+}
+
+static void check_mipmaps() {
+  // the levels tile saw_mipmaps, each holds nothing at or above its harmonic limit, and the same harmonics as
+  // saw_tbl below it
+  std::vector<float> lvl, ref(saw_tbl, saw_tbl + TABLE_SIZE);
+  double fund = bin_energy(ref, 1), worstOut = 0.0, worstIn = 0.0;
+  const float* next = saw_mipmaps;
+  for (int k = 0; k < WAVE_MIPMAPS; k++) {
+    const float* t = mipmapTable(k);
+    int size = mipmapMask(k) + 1, top = (TABLE_SIZE / 4) >> k;
+    CHECK(t == next && (size & (size - 1)) == 0 && size >= min(TABLE_SIZE, 16 * top), "mipmap level %d: at %d, %d long, %d harmonics",
+          k, (int)(t - saw_mipmaps), size, top);
+    next = t + size + 1;
+    lvl.assign(t, t + size);
+    for (int h = 1; h < size / 2; h++) {
+      double e = bin_energy(lvl, h) * TABLE_SIZE / size * TABLE_SIZE / size; // scaled to saw_tbl's length
+      if (h >= top) worstOut = fmax(worstOut, e / fund);
+      else worstIn = fmax(worstIn, fabs(sqrt(e) - sqrt(bin_energy(ref, h))) / sqrt(fund));
+    }
+    CHECK(t[size] == t[0], "mipmap level %d: guard point", k);
+  }
+  CHECK(next == saw_mipmaps + WAVE_MIPMAP_FLOATS, "mipmaps: levels end at %d of %d floats",
+        (int)(next - saw_mipmaps), (int)WAVE_MIPMAP_FLOATS);
+  CHECK(worstOut < 1e-8, "mipmaps: harmonics above the level limit at %.1f dB re fundamental", 10.0 * log10(worstOut));
+  CHECK(worstIn < 1e-4, "mipmaps: harmonics below the level limit differ from saw_tbl by %g", worstIn);
+
+  // the level follows the octave of the step: level o from 2^o up to 2^(o+1)
+  int bad = 0;
+  for (int o = 0; o < WAVE_MIPMAPS; o++) {
+    float base = (float)(1 << o);
+    bad += mipmapOctave(base) != o;
+    bad += mipmapOctave(base * 1.5f) != o;
+    bad += mipmapOctave(base * 1.99f) != o;
+  }
+  bad += mipmapOctave(0.3f) != 0;
+  bad += mipmapOctave(2000.0f) != WAVE_MIPMAPS - 1;
+  CHECK(bad == 0, "mipmapOctave(): %d wrong results", bad);
+
+  // block == scalar, and both == the blend written out: one blended table, linearly interpolated. Level 4 is
+  // a quarter of TABLE_SIZE, so the phase gets scaled.
+  const int n = 4096, oct = 4;
+  const float kSquare = 0.66f * 0.7f, kSaw = 0.3f + kSquare;
+  const float* t = mipmapTable(oct);
+  int32_t mask = mipmapMask(oct);
+  float scale = (float)(mask + 1) / TABLE_SIZE;
+  std::vector<float> blend(mask + 2);
+  for (int i = 0; i <= mask + 1; i++) blend[i] = kSaw * t[i] - kSquare * t[(i + (mask + 1) / 2) & mask];
+  std::vector<float> ph(n), b(n);
+  for (int i = 0; i < n; i++) {
+    ph[i] = (float)random(0, TABLE_SIZE * 1000) * 0.001f;
+    if (ph[i] >= (float)TABLE_SIZE) ph[i] = 0.0f;
+  }
+  int diff = 0;
+  float worst = 0.0f;
+  lookupWaveBlock(t, mask, scale, kSaw, kSquare, ph.data(), b.data(), n);
+  for (int i = 0; i < n; i++) {
+    diff += (lookupWave(t, mask, scale, kSaw, kSquare, ph[i]) != b[i]);
+    double x = ph[i] * (mask + 1.0) / TABLE_SIZE, f = x - floor(x);
+    int j = (int)x;
+    float want = (float)(blend[j] + f * (blend[j + 1] - blend[j]));
+    worst = fmaxf(worst, fabsf(b[i] - want));
+  }
+  CHECK(diff == 0, "lookupWaveBlock: %d mismatches against the scalar version", diff);
+  CHECK(worst < 1e-5f, "lookupWave: off the blended table by %g", worst);
+
+  // aliasing of free running tones at exact pitch, against the naive tables; K cycles per 8192 samples
+  // gives a phase step of K/8, which float holds exactly, so no rounding drift blurs the spectrum
+  static const int tones[] = {37, 149, 409, 1021};   // ~200 Hz .. ~5.5 kHz at 44.1 kHz
+  const int len = 8192;
+  std::vector<float> naive(len), band(len);
+  for (int K : tones) {
+    for (int w = 0; w < 2; w++) {                     // exp-saw, exp-square
+      float kSquare = w ? 0.66f : 0.0f, kSaw = w ? 0.66f : 1.0f;
+      float step = (float)K / 8.0f, phase = 0.0f;
+      int32_t oct = mipmapOctave(step), mask = mipmapMask(oct);
+      const float* t = mipmapTable(oct);
+      for (int i = 0; i < len; i++) {
+        float j = phase + (float)(TABLE_SIZE / 2);
+        if (j >= (float)TABLE_SIZE) j -= (float)TABLE_SIZE;
+        naive[i] = kSaw * lookupLinear(saw_tbl, phase) - kSquare * lookupLinear(saw_tbl, j);
+        band[i] = lookupWave(t, mask, (float)(mask + 1) / TABLE_SIZE, kSaw, kSquare, phase);
+        phase += step;
+        if (phase >= (float)TABLE_SIZE) phase -= (float)TABLE_SIZE;
+      }
+      double an = alias_dB(naive, K), ab = alias_dB(band, K), low = alias_dB(band, K, len / 4);
+      fprintf(stderr, "  %s %7.1f Hz: aliasing naive %6.1f dB, mipmaps %6.1f dB, below fs/4 %6.1f dB re signal\n",
+              w ? "exp-square" : "exp-saw   ", (double)K * SAMPLE_RATE / len, an, ab, low);
+      CHECK(ab < -55.0 && low < -60.0, "mipmaps: aliasing %.1f dB, %.1f dB below fs/4, at K=%d (naive %.1f dB)", ab, low, K, an);
+    }
+  }
+}
+
+// ============================================ TeeBeeFilter: control rate decimation ============================================
+
+// Cutoff trajectory like the one SynthVoice produces: filter envelope hits every 1/8 s, decays, then goes
+// through the 200 Hz declicker. The input is a naive saw.
+static void filter_trajectory(float* in, float* cut, int n) {
+  BiquadFilter declick;
+  declick.setMode(BiquadFilter::LOWPASS12);
+  declick.setGain(amp2dB(sqrt(0.5f)));
+  declick.setFrequency(200.0f);
+  const int noteLen = SAMPLE_RATE / 8;
+  float phase = 0.0f;
+  for (int i = 0; i < n; i++) {
+    int note = i / noteLen;
+    float t = (float)(i % noteLen) * DIV_SAMPLE_RATE;
+    float env = expf(-t * ((note & 1) ? 20.0f : 5.0f));
+    float base = 300.0f + 200.0f * (float)(note % 5);
+    cut[i] = declick.getSample(base * (0.9f * (env - 0.2f) + ((note % 3 == 0) ? 1.3f : 0.0f) + 1.0f));
+    in[i] = 2.0f * phase - 1.0f;
+    phase += (55.0f + 27.5f * (float)(note % 4)) * DIV_SAMPLE_RATE;
+    if (phase >= 1.0f) phase -= 1.0f;
+  }
+}
+
+template <int RATE> static float filter_error_dB(const float* in, const float* cut, int n, float reso) {
+  TeeBeeFilter ref, dec;
+  ref.Init((float)SAMPLE_RATE); ref.SetMode(TeeBeeFilter::TB_303); ref.SetResonance(reso);
+  dec.Init((float)SAMPLE_RATE); dec.SetMode(TeeBeeFilter::TB_303); dec.SetResonance(reso);
+  ref.SetCutoff(cut[0]); // start both on the trajectory, not on Init()'s 1 kHz
+  dec.SetCutoff(cut[0]);
+  std::vector<float> a(in, in + n), b(in, in + n);
+  for (int i = 0; i < n; i += DMA_BUF_LEN) ref.ProcessBlockDecimated<1>(&a[i], &cut[i], DMA_BUF_LEN);
+  for (int i = 0; i < n; i += DMA_BUF_LEN) dec.ProcessBlockDecimated<RATE>(&b[i], &cut[i], DMA_BUF_LEN);
+
+  double sig = 0.0, err = 0.0;
+  for (int i = 0; i < n; i++) {
+    sig += (double)a[i] * a[i];
+    err += (double)(a[i] - b[i]) * (a[i] - b[i]);
+  }
+  return (float)(10.0 * log10((err + 1e-30) / (sig + 1e-30)));
+}
+
+template <int RATE> static void check_filter_rate(const float* in, const float* cut, int n, float bound_dB) {
+  static const float resos[] = {0.0f, 0.5f, 0.9f, 1.0f};
+  float worst = -1000.0f;
+  for (float r : resos) {
+    float e = filter_error_dB<RATE>(in, cut, n, r);
+    if (e > worst) worst = e;
+  }
+  fprintf(stderr, "  TeeBeeFilter rate %2d: error %6.1f dB re signal\n", RATE, worst);
+  CHECK(worst < bound_dB, "TeeBeeFilter at control rate %d is off by %.1f dB (bound %.1f dB)", RATE, worst, bound_dB);
+}
+
+static void check_filter_decimation() {
+  const int n = SAMPLE_RATE * 4 / DMA_BUF_LEN * DMA_BUF_LEN;
+  std::vector<float> in(n), cut(n);
+  filter_trajectory(in.data(), cut.data(), n);
+  check_filter_rate<4>(in.data(), cut.data(), n, -70.0f);
+  check_filter_rate<8>(in.data(), cut.data(), n, -58.0f);
+  check_filter_rate<16>(in.data(), cut.data(), n, -46.0f);
+}
+
+#ifdef FILTER_COEF_LATTICE
+// ============================================ TeeBeeFilter: coefficient lattice ============================================
+
+static void check_filter_lattice() {
+  const int n = SAMPLE_RATE * 4;
+  std::vector<float> in(n), cut(n);
+  filter_trajectory(in.data(), cut.data(), n);
+  static const float resos[] = {0.0f, 0.3f, 0.5f, 0.9f, 1.0f};
+  float worst = -1000.0f;
+  for (float r : resos) {
+    TeeBeeFilter poly, lat;
+    poly.Init((float)SAMPLE_RATE); poly.SetMode(TeeBeeFilter::TB_303); poly.SetResonance(r);
+    lat.Init((float)SAMPLE_RATE);  lat.SetMode(TeeBeeFilter::TB_303);  lat.SetResonance(r);
+    double sig = 0.0, err = 0.0;
+    for (int i = 0; i < n; i++) {
+      poly.SetCutoff(cut[i], false);
+      poly.calculateCoefficientsApprox4();     // the polynomials, every sample
+      lat.SetCutoff(cut[i]);                   // the lattice, every sample
+      float a = poly.Process(in[i]);
+      float b = lat.Process(in[i]);
+      sig += (double)a * a;
+      err += (double)(a - b) * (a - b);
+    }
+    float e = (float)(10.0 * log10((err + 1e-30) / (sig + 1e-30)));
+    if (e > worst) worst = e;
+  }
+  float b0Err, kErr, gErr;
+  size_t bytes = TeeBeeFilter::latticeReport(&b0Err, &kErr, &gErr);
+  fprintf(stderr, "  TeeBeeFilter lattice %dx%d: %u bytes, worst rel. error b0 %.2e k %.2e g %.2e, output error %6.1f dB re signal\n",
+          FILTER_LATTICE_CUTOFFS, FILTER_LATTICE_RESOS, (unsigned)bytes, b0Err, kErr, gErr, worst);
+  CHECK(worst < -50.0f, "TeeBeeFilter lattice output is off by %.1f dB", worst); // bound for the default 16 steps x 8 resonances
+}
+#endif
+
+// ============================================ MIDI event queue ============================================
+
+static void check_midi_queue() {
+  // ordering, capacity, due time
+  static MidiQueue q;
+  MidiEvent e;
+  int bad = 0;
+  for (int i = 0; i < MIDI_QUEUE_SIZE; i++) bad += !q.Push({(uint32_t)(100 + i), MIDI_EVENT_CC, (uint8_t)i, 0});
+  bad += q.Push({500, MIDI_EVENT_CC, 0, 0});                    // full
+  bad += q.GetDropped() != 1;
+  bad += q.PopDue(100, e);                                      // not due yet
+  for (int i = 0; i < MIDI_QUEUE_SIZE; i++) bad += !q.PopDue(200, e) || e.data1 != i;
+  bad += q.PopDue(2000, e);                                     // empty
+  q.Push({1000, MIDI_EVENT_CC, 1, 0});
+  q.Push({990, MIDI_EVENT_CC, 2, 0});                           // an earlier stamp never overtakes
+  bad += !q.PopDue(1001, e) || e.data1 != 1 || !q.PopDue(1001, e) || e.data1 != 2 || e.time != 1000;
+  CHECK(bad == 0, "MidiQueue: %d wrong results in the single threaded sequence", bad);
+
+  // one producer and one consumer thread, every event must arrive once and in order
+  static MidiQueue spsc;
+  const uint32_t total = 1000000;
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < total; ) {
+      if (spsc.Push({i, MIDI_EVENT_NOTE_ON, (uint8_t)(i & 127), (int16_t)(i >> 7)})) i++;
+      else std::this_thread::yield();
+    }
+  });
+  uint32_t next = 0, wrong = 0;
+  while (next < total) {
+    if (spsc.PopDue(total, e)) {
+      wrong += (e.time != next) || (e.data1 != (next & 127)) || (e.data2 != (int16_t)(next >> 7));
+      next++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  CHECK(wrong == 0, "MidiQueue: %u events corrupted or out of order between two threads", wrong);
+
+  // a note on stamped k samples into the block starts the voice exactly there, and not a sample before
+  for (int k : {0, 1, 13, DMA_BUF_LEN - 1}) {
+    SynthVoice v(0), ref(0);
+    v.Init();
+    ref.Init();
+    static MidiQueue events;
+    float buf[DMA_BUF_LEN], expect[DMA_BUF_LEN];
+    set_gen_clock(gen_clock + DMA_BUF_LEN);
+    events.Push({gen_clock + k, MIDI_EVENT_NOTE_ON, 48, 100});
+    synth_generate(v, events, buf, gen_clock);
+    ref.ProcessBlock(expect, k);
+    ref.on_midi_noteON(48, 100);
+    ref.ProcessBlock(expect + k, DMA_BUF_LEN - k);
+    int silent = 0;
+    while (silent < DMA_BUF_LEN && buf[silent] == 0.0f) silent++;
+    CHECK(!memcmp(buf, expect, sizeof(buf)) && silent > k, "note on stamped at offset %d: output differs, sounds from offset %d", k, silent);
+    applySynthEvent(v, {0, MIDI_EVENT_NOTES_OFF, 0, 0});
+  }
+}
+
+// ============================================ SynthKernel: voices at once vs. one by one ============================================
+
+// an acid line per voice as MIDI events: legato notes slide, some across an octave
+static void kernel_script(MidiQueue& q, int step, uint32_t time) {
+  static const uint8_t notes[] = {36, 48, 39, 36, 51, 43, 36, 46};
+  int n = step % 8, prev = (step + 7) % 8;
+  bool slide = (n == 2 || n == 5);
+  if (!slide) q.Push({time, MIDI_EVENT_NOTE_OFF, notes[prev], 0});
+  q.Push({time, MIDI_EVENT_NOTE_ON, notes[n], (int16_t)((n & 1) ? 127 : 80)});
+  if (slide) q.Push({time, MIDI_EVENT_NOTE_OFF, notes[prev], 0});
+  q.Push({time, MIDI_EVENT_CC, CC_303_CUTOFF, (int16_t)((step * 13) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_RESO, (int16_t)((step * 29 + 64) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_ENVMOD_LVL, (int16_t)((step * 7 + 30) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_OVERDRIVE, (int16_t)((step * 5) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_DISTORTION, (int16_t)((step * 3) & 127)});
+  q.Push({time, MIDI_EVENT_CC, CC_303_WAVEFORM, (int16_t)((step & 4) ? 0 : 127)});
+}
+
+static void check_synth_kernel() {
+  // one full group and one with a single voice and shadow lanes, every voice has its events elsewhere in the block
+  const int voices = SYNTH_KERNEL_LANES + 1;
+  static SynthVoice ref[voices], blk[voices];
+  static MidiQueue refEvents[voices], blkEvents[voices];
+  static SynthKernel kernel;
+  static float refBuf[voices][DMA_BUF_LEN], blkBuf[voices][DMA_BUF_LEN];
+  SynthVoice* synths[voices];
+  MidiQueue* events[voices];
+  float* bufs[voices];
+  for (int v = 0; v < voices; v++) {
+    ref[v].Init();
+    blk[v].Init();
+    synths[v] = &blk[v];
+    events[v] = &blkEvents[v];
+    bufs[v] = blkBuf[v];
+  }
+  const uint32_t stepLen = SAMPLE_RATE / 8;
+  int step[voices] = {0};
+  int mismatches = 0;
+  float worst = 0.0f;
+  double energy = 0.0;
+  for (uint32_t clock = 0; clock < 24 * stepLen; clock += DMA_BUF_LEN) {
+    for (int v = 0; v < voices; v++) {
+      uint32_t time = step[v] * stepLen + v * 37 + 5;
+      if (time < clock + DMA_BUF_LEN) {
+        kernel_script(refEvents[v], step[v], time);
+        kernel_script(blkEvents[v], step[v], time);
+        step[v]++;
+      }
+      synth_generate(ref[v], refEvents[v], refBuf[v], clock);
+    }
+    kernel_generate(kernel, synths, events, bufs, SYNTH_KERNEL_LANES, clock);
+    kernel_generate(kernel, synths + SYNTH_KERNEL_LANES, events + SYNTH_KERNEL_LANES, bufs + SYNTH_KERNEL_LANES, voices - SYNTH_KERNEL_LANES, clock);
+    for (int v = 0; v < voices; v++) {
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        float r = refBuf[v][i], b = blkBuf[v][i];
+        energy += (double)r * r;
+        if (r != b) {
+          mismatches++;
+          if (fabsf(r - b) > worst) worst = fabsf(r - b);
+        }
+      }
+    }
+  }
+  CHECK(energy > 1.0, "SynthKernel script renders silence");
+  CHECK(mismatches == 0, "SynthKernel differs from SynthVoice::ProcessBlock() in %d samples, worst %g", mismatches, worst);
+}
+
+// ============================================ audio ring ============================================
+
+template <int STAGES> static void check_ring_stages() {
+  // Core0 and Core1 run the ring like the audio tasks do, every block is stamped with its clock:
+  // the mixer must see each block complete, in order, and never while a producer could still write it
+  static AudioRing<STAGES> ring;
+  const uint32_t total = 200000;
+  std::atomic<uint32_t> ahead{0};
+  std::thread core0([&]() {
+    uint32_t clock;
+    for (uint32_t n = 0; n < total; ) {
+      AudioBlock* b = ring.GetFree(AUDIO_CORE0, clock);
+      if (b == NULL) { std::this_thread::yield(); continue; }
+      for (int i = 0; i < DMA_BUF_LEN; i++) b->synth[0][i] = b->drums_l[i] = b->drums_r[i] = (float)(clock + i);
+      ring.Produced(AUDIO_CORE0);
+      n++;
+    }
+  });
+  uint32_t mixed = 0, synth2 = 0, torn = 0, order = 0, clock;
+  while (mixed < total) {
+    AudioBlock* b = ring.GetReady(clock);
+    if (b != NULL) {
+      order += clock != mixed * DMA_BUF_LEN;
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        float v = (float)(clock + i);
+        torn += b->synth[0][i] != v || b->synth[SYNTH_VOICES - 1][i] != v || b->drums_l[i] != v || b->drums_r[i] != v;
+      }
+      ring.Mixed();
+      mixed++;
+    } else if ((b = ring.GetFree(AUDIO_CORE1, clock)) != NULL) {
+      for (int i = 0; i < DMA_BUF_LEN; i++) b->synth[SYNTH_VOICES - 1][i] = (float)(clock + i);
+      ring.Produced(AUDIO_CORE1);
+      synth2++;
+      if (synth2 - mixed > ahead) ahead = synth2 - mixed;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  core0.join();
+  CHECK(torn == 0 && order == 0, "AudioRing<%d>: %u torn samples, %u blocks out of order", STAGES, torn, order);
+  CHECK(ahead <= STAGES, "AudioRing<%d>: synth2 ran %u blocks ahead of the mixer", STAGES, ahead.load());
+  CHECK(ring.GetLatency() == (STAGES - 1) * DMA_BUF_LEN, "AudioRing<%d>: latency %u", STAGES, ring.GetLatency());
+}
+
+static void check_audio_ring() {
+  check_ring_stages<2>();
+  check_ring_stages<3>();
+  check_ring_stages<4>();
+}
+
+// ============================================ load balancer ============================================
+
+// the checks name the first two voices of the bank after the classic pair
+static_assert(SYNTH_VOICES >= 2, "the checks need two voices at least");
+enum {ENGINE_SYNTH1 = 0, ENGINE_SYNTH2 = 1};
+
+static void check_balancer_plan() {
+  // the split follows the measured costs, once per bar, and only for a real gain
+  static LoadBalancer lb;
+  lb.Init(1 << ENGINE_SYNTH2);
+  const uint32_t bar = (uint32_t)(4.0f * 60.0f * (float)SAMPLE_RATE / bpm);
+  int bad = 0;
+  bad += lb.Plan(100, 100 * DMA_BUF_LEN);                             // nothing measured yet, keep the classic split
+  for (int i = 0; i < 1000; i++) {
+    lb.AddCost(ENGINE_SYNTH1, 300);
+    lb.AddCost(ENGINE_DRUMS, 300);
+    lb.AddCost(ENGINE_SYNTH2, 100);
+    lb.AddMixerCost(100);
+  }
+  bad += lb.Plan(101, 101 * DMA_BUF_LEN);                             // mid-bar
+  uint32_t n = 100 + bar / DMA_BUF_LEN + 1;
+  float before = lb.CriticalPath(lb.GetCore1Engines(n));
+  bad += !lb.Plan(n, n * DMA_BUF_LEN);                                // Core0 at 600us, Core1 at 200us: move something
+  uint32_t sw = n + AUDIO_STAGES + 1;
+  bad += lb.GetCore1Engines(sw - 1) != (1 << ENGINE_SYNTH2);         // out of reach of both producers
+  uint8_t after = lb.GetCore1Engines(sw);
+  float path = lb.CriticalPath(after);
+  bad += fabsf(path - 400.0f) > 1.0f || path > before * BALANCER_HYSTERESIS;
+  bad += lb.MayStart(sw, sw - 1) || !lb.MayStart(sw, sw) || !lb.MayStart(sw + 1, sw - 1);
+  CHECK(bad == 0, "LoadBalancer: %d wrong decisions, critical path %.0fus -> %.0fus", bad, before, path);
+
+  for (int i = 0; i < 1000; i++) lb.AddCost(ENGINE_SYNTH1, 330);   // 10% off, not worth a move
+  n += bar / DMA_BUF_LEN + 1;
+  CHECK(!lb.Plan(n, n * DMA_BUF_LEN) && lb.GetSwitches() == 1, "LoadBalancer: switched for a small gain");
+}
+
+static void check_balancer_handoff() {
+  // both cores run the ring with synthetic engines whose costs change every bar, so the engines keep moving:
+  // every engine must still render every block exactly once and in order, whichever core does it
+  static AudioRing<AUDIO_STAGES> ring;
+  static LoadBalancer lb;
+  lb.Init(1 << ENGINE_SYNTH2);
+  const uint32_t total = 100000;
+  const uint32_t barBlocks = (uint32_t)(4.0f * 60.0f * (float)SAMPLE_RATE / bpm) / DMA_BUF_LEN;
+  std::atomic<uint32_t> next[ENGINES];
+  for (auto& x : next) x = 0;
+  std::atomic<uint32_t> skipped{0};
+  auto generate = [&](uint8_t core) {
+    uint32_t clock;
+    AudioBlock* b = ring.GetFree(core, clock);
+    if (b == NULL) return false;
+    uint32_t n = ring.GetProduced(core);
+    if (!lb.MayStart(n, ring.GetProduced(1 - core))) return false;
+    if (core == AUDIO_CORE0) lb.Plan(n, clock);
+    uint8_t core1Engines = lb.GetCore1Engines(n);
+    for (uint8_t e = 0; e < ENGINES; e++) {
+      if (((core1Engines >> e) & 1) != core) continue;
+      skipped += next[e].exchange(n + 1) != n;
+      float* out = (e == ENGINE_DRUMS) ? b->drums_l : b->synth[e];
+      for (int i = 0; i < DMA_BUF_LEN; i++) out[i] = (float)(clock + i);
+      lb.AddCost(e, (e == (n / barBlocks) % ENGINES) ? 500 : 100);   // the heavy engine changes every bar
+    }
+    ring.Produced(core);
+    return true;
+  };
+  std::thread core0([&]() {
+    while (ring.GetProduced(AUDIO_CORE0) < total) {
+      if (!generate(AUDIO_CORE0)) std::this_thread::yield();
+    }
+  });
+  uint32_t mixed = 0, torn = 0, clock;
+  while (mixed < total) {
+    AudioBlock* b = ring.GetReady(clock);
+    if (b != NULL) {
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        float v = (float)(clock + i);
+        torn += b->drums_l[i] != v;
+        for (int s = 0; s < SYNTH_VOICES; s++) torn += b->synth[s][i] != v;
+      }
+      lb.AddMixerCost(100);
+      ring.Mixed();
+      mixed++;
+    } else if (ring.GetProduced(AUDIO_CORE1) >= total || !generate(AUDIO_CORE1)) {
+      std::this_thread::yield();
+    }
+  }
+  core0.join();
+  CHECK(lb.GetSwitches() >= 10, "LoadBalancer: only %u switches while the load kept moving", lb.GetSwitches());
+  CHECK(torn == 0 && skipped == 0, "LoadBalancer: %u samples missing, %u blocks out of order across %u switches",
+        torn, skipped.load(), lb.GetSwitches());
+}
+
+static void check_load_balancer() {
+  check_balancer_plan();
+  check_balancer_handoff();
+}
+
+// ============================================ JUKEBOX clock ============================================
+
+static void check_jukebox_timing() {
+  // loop() calls run_tick() at ragged intervals, every tick must still land on the sample grid of the tempo
+  init_midi();
+  const float tick = midi_tick_samples;
+  int32_t first = -1;
+  int notes = 0, late = 0, offGrid = 0;
+  float worst = 0.0f;
+  uint32_t seed = 12345;
+  int nextCall = 0;
+  for (int block = 0; block < 20000; block++) {
+    host_sample_clock += DMA_BUF_LEN;
+    set_gen_clock(gen_clock + DMA_BUF_LEN);
+    if (block == nextCall) {                                      // 1 to 4 blocks apart, well within MIDI_TICK_LOOKAHEAD
+      run_tick();
+      seed = seed * 1664525u + 1013904223u;
+      nextCall = block + 1 + (seed >> 30);
+    }
+    MidiEvent e;
+    MidiQueue* queues[SYNTH_VOICES + 2] = {&DrumsEvents, &FxEvents};
+    for (int v = 0; v < SYNTH_VOICES; v++) queues[v + 2] = &Synths.Events(v);
+    for (MidiQueue* q : queues) {
+      while (q->PopDue(gen_clock + DMA_BUF_LEN, e)) {
+        if (e.type != MIDI_EVENT_NOTE_ON) continue;
+        late += (int32_t)(e.time - gen_clock) < 0;                // arrived after its block had been rendered
+        if (first < 0) first = e.time;
+        float ticks = (float)(e.time - (uint32_t)first) / tick;
+        float err = fabsf(ticks - roundf(ticks)) * tick;
+        worst = fmaxf(worst, err);
+        offGrid += err > 1.0f;
+        notes++;
+      }
+    }
+  }
+  do_midi_stop();
+  CHECK(notes > 100, "JUKEBOX played only %d notes", notes);
+  CHECK(late == 0 && offGrid == 0, "JUKEBOX: %d notes late, %d off the tick grid, worst by %.2f samples", late, offGrid, worst);
+}
+
+// ============================================ Sampler: Process() vs ProcessBlock() ============================================
+
+// a drum pattern with overlapping hits, hat chokes and knob moves on the kit, the buses, the filter and the crusher
+static void sampler_script(Sampler& d, int step) {
+  static const uint8_t notes[] = {0, 6, 1, 7, 0, 6, 4, 9};
+  d.NoteOn(notes[step % 8], (step & 1) ? 127 : 90);
+  if (step % 3 == 0) d.NoteOn(notes[(step + 3) % 8] + 12, 100);
+  d.ParseCC(CC_808_CUTOFF, (step * 19) & 127);
+  d.ParseCC(CC_808_RESO, (step * 11) & 127);
+  d.ParseCC(CC_808_DISTORTION, (step & 8) ? (step * 7) & 127 : 0);
+  d.ParseCC(CC_808_NOTE_SEL, step % 12);
+  d.ParseCC(CC_808_NOTE_DECAY, (step * 23 + 40) & 127);
+  d.ParseCC(CC_808_PITCH, (step * 5 + 50) & 127);
+  d.ParseCC(CC_808_NOTE_PAN, (step * 31) & 127);
+  d.ParseCC(CC_808_INTERPOLATION, (step * 40) & 127); // a new mode every hit, sounding hits keep theirs
+  d.ParseCC(CC_808_NOTE_BUS, (step * 37) & 127);
+  d.ParseCC(CC_808_BUS_PAN, (step * 29) & 127);
+}
+
+static void check_sampler_block() {
+  static Sampler ref(0), blk(0);
+  ref.Init();
+  blk.Init();
+  static const int sizes[] = {DMA_BUF_LEN, 1, 7, 64, 100, 3};
+  const int stepLen = SAMPLE_RATE / 9;
+  float bl[128], br[128];
+  int mismatches = 0, busiest = 0;
+  double energy = 0.0;
+  for (int step = 0; step < 48; step++) {
+    sampler_script(ref, step);
+    sampler_script(blk, step);
+    int done = 0;
+    for (int k = 0; done < stepLen; k++) {
+      int n = sizes[k % 6];
+      if (n > stepLen - done) n = stepLen - done;
+      if (blk.GetActiveCount() > busiest) busiest = blk.GetActiveCount();
+      blk.ProcessBlock(bl, br, n);
+      for (int i = 0; i < n; i++) {
+        float l, r;
+        ref.Process(&l, &r);
+        energy += (double)l * l + (double)r * r;
+        mismatches += (l != bl[i]) || (r != br[i]);
+      }
+      done += n;
+    }
+  }
+  CHECK(energy > 1.0, "Sampler script renders silence");
+  CHECK(busiest > 1, "Sampler script never overlaps hits");
+  CHECK(ref.GetActiveCount() == blk.GetActiveCount(), "Sampler: %d players still sounding per sample, %d per block", ref.GetActiveCount(), blk.GetActiveCount());
+  CHECK(mismatches == 0, "Sampler::ProcessBlock() differs from Process() in %d samples", mismatches);
+}
+
+// ============================================ Sampler: kit switching ============================================
+
+static int sampler_diff(Sampler& a, Sampler& b, int blocks, float tolerance) {
+  float al[DMA_BUF_LEN], ar[DMA_BUF_LEN], bl[DMA_BUF_LEN], br[DMA_BUF_LEN];
+  int mismatches = 0;
+  for (int k = 0; k < blocks; k++) {
+    a.CheckKit();
+    b.CheckKit();
+    a.ProcessBlock(al, ar, DMA_BUF_LEN);
+    b.ProcessBlock(bl, br, DMA_BUF_LEN);
+    for (int i = 0; i < DMA_BUF_LEN; i++) mismatches += fabsf(al[i] - bl[i]) > tolerance || fabsf(ar[i] - br[i]) > tolerance;
+  }
+  return mismatches;
+}
+
+// hits started before a program change ring out from the old kit, the next ones play the new kit, and the
+// loader doesn't touch a region while a voice still plays from it
+static void check_sampler_kits() {
+  static Sampler ref(0), sw(0), kit4(4);
+  ref.Init();
+  sw.Init();
+  kit4.Init();
+  CHECK(sw.GetKitCount() >= 3, "Sampler found %d kits on LittleFS", sw.GetKitCount());
+  ref.NoteOn(0, 127);
+  sw.NoteOn(0, 127);
+  int mismatches = sampler_diff(ref, sw, 4, 0.0f);
+  sw.SetProgram(6);
+  mismatches += sampler_diff(ref, sw, 1, 0.0f);
+  CHECK(sw.GetProgram() == 6, "Sampler: kit 6 not swapped in at the next block, playing kit %d", sw.GetProgram());
+  sw.SetProgram(4);                                               // region of kit 0 is still in use
+  int blocks = 0, early = 0;
+  while (ref.GetActiveCount() > 0 && blocks < 2000) {
+    early += sw.GetProgram() != 6;
+    mismatches += sampler_diff(ref, sw, 1, 0.0f);
+    blocks++;
+  }
+  CHECK(early == 0, "Sampler: kit 4 loaded over a region that still plays, %d blocks early", early);
+  CHECK(blocks > 10 && ref.GetActiveCount() == 0, "Sampler: the bass drum rang for %d blocks", blocks);
+  CHECK(mismatches == 0, "Sampler: a hit from the old kit changed in %d samples after the program change", mismatches);
+  sampler_diff(kit4, sw, 2, 0.0f);                                // one block to find the region free, one to load and swap
+  CHECK(sw.GetProgram() == 4, "Sampler: kit 4 not loaded once the old voices ended, playing kit %d", sw.GetProgram());
+  sampler_diff(kit4, sw, 4000, 0.0f);                             // until the tail of the bass drum has left the filter
+  kit4.NoteOn(1, 127);
+  sw.NoteOn(1, 127);
+  mismatches = sampler_diff(kit4, sw, 200, 0.0f);
+  CHECK(mismatches == 0, "Sampler: new hit after the kit change differs from kit 4 in %d samples", mismatches);
+}
+
+// ============================================ kit images ============================================
+
+// copies a WAV with a LIST chunk in front of the data, as many editors write them
+static bool copy_with_list_chunk(const std::string& from, const std::string& to) {
+  FILE* f = fopen(from.c_str(), "rb");
+  if (!f) return false;
+  std::vector<uint8_t> d(1 << 20);
+  d.resize(fread(d.data(), 1, d.size(), f));
+  fclose(f);
+  static const uint8_t list[] = {'L', 'I', 'S', 'T', 5, 0, 0, 0, 'I', 'N', 'F', 'O', '!', 0}; // odd size, padded
+  d.insert(d.begin() + 36, list, list + sizeof(list));
+  f = fopen(to.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(d.data(), 1, d.size(), f) == d.size();
+  return (fclose(f) == 0) && ok;
+}
+
+// the same kit from its WAV folder, from a packed image and from WAVs with extra chunks must play the same
+static void check_kit_image() {
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/kits").c_str(), 0755);
+  mkdir((tmp + "/3").c_str(), 0755);
+  std::string err;
+  int packed = kitpack((data + "/6").c_str(), (tmp + "/kits/6.kit").c_str(), err);
+  CHECK(packed > 0, "kitpack: %s", err.c_str());
+  std::vector<std::string> wavs;
+  kitpack_list(data + "/6", "/", 0, wavs);
+  for (const std::string& w : wavs) CHECK(copy_with_list_chunk(data + "/6" + w, tmp + "/3" + w), "can't write %s", w.c_str());
+
+  static Sampler folder(6), image(6), chunks(3);
+  folder.Init();
+  LittleFS.setRoot(tmp.c_str());
+  image.Init();
+  chunks.Init();
+  CHECK(image.GetKitCount() == 2, "Sampler found %d kits in the image folder, expected 2", image.GetKitCount());
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+
+  CHECK(packed == folder.GetSamplesCount() && image.GetSamplesCount() == packed && chunks.GetSamplesCount() == packed,
+        "kit 6: %d samples packed, %d from the folder, %d from the image, %d with LIST chunks",
+        packed, folder.GetSamplesCount(), image.GetSamplesCount(), chunks.GetSamplesCount());
+  float fl[DMA_BUF_LEN], fr[DMA_BUF_LEN], il[DMA_BUF_LEN], ir[DMA_BUF_LEN], cl[DMA_BUF_LEN], cr[DMA_BUF_LEN];
+  int mismatches = 0;
+  for (int note = 0; note < folder.GetSamplesCount(); note++) {
+    folder.NoteOn(note, 127);
+    image.NoteOn(note, 127);
+    chunks.NoteOn(note, 127);
+    for (int k = 0; k < 40; k++) {
+      folder.ProcessBlock(fl, fr, DMA_BUF_LEN);
+      image.ProcessBlock(il, ir, DMA_BUF_LEN);
+      chunks.ProcessBlock(cl, cr, DMA_BUF_LEN);
+      for (int i = 0; i < DMA_BUF_LEN; i++) mismatches += (fl[i] != il[i]) + (fr[i] != ir[i]) + (fl[i] != cl[i]) + (fr[i] != cr[i]);
+    }
+  }
+  CHECK(mismatches == 0, "kit 6 from the image or with LIST chunks differs in %d samples", mismatches);
+}
+
+// rewrites the kit image at path with its bytes from 'at' on replaced by 'patch', or cut short at 'at'
+static bool patch_file(const std::string& path, size_t at, const std::vector<uint8_t>& patch, bool cut) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  std::vector<uint8_t> d(1 << 22);
+  d.resize(fread(d.data(), 1, d.size(), f));
+  fclose(f);
+  if (at + patch.size() > d.size()) return false;
+  if (cut) d.resize(at);
+  else std::copy(patch.begin(), patch.end(), d.begin() + at);
+  f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(d.data(), 1, d.size(), f) == d.size();
+  return (fclose(f) == 0) && ok;
+}
+
+// an image whose index points past its payload, or which is cut short, is turned down and the kit comes from its folder
+static void check_kit_image_broken() {
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/kits").c_str(), 0755);
+  mkdir((tmp + "/6").c_str(), 0755);
+  std::vector<std::string> wavs;
+  kitpack_list(data + "/6", "/", 0, wavs);
+  for (const std::string& w : wavs) system(("cp '" + data + "/6" + w + "' '" + tmp + "/6" + w + "'").c_str());
+  const std::string image = tmp + "/kits/6.kit";
+  std::string err;
+  const size_t entry = sizeof(KitImageHeader);
+  const std::vector<uint8_t> huge = {0x00, 0x00, 0x00, 0x40};     // 1 << 30 frames
+  const std::vector<uint8_t> wraps = {0xF8, 0xFF, 0xFF, 0xFF};    // 2^32 - 8 frames, plus the guard wraps to 8
+  struct { const char* what; size_t at; const std::vector<uint8_t>& patch; bool cut; } broken[] = {
+    {"a sample running past the payload", entry + offsetof(KitImageEntry, frames), huge, false},
+    {"a sample starting past the payload", entry + sizeof(KitImageEntry) + offsetof(KitImageEntry, start), huge, false},
+    {"an image cut short", sizeof(KitImageHeader) + 3 * sizeof(KitImageEntry) + 1000, huge, true},
+    {"a sample whose end wraps around", entry + 2 * sizeof(KitImageEntry) + offsetof(KitImageEntry, frames), wraps, false},
+  };
+  static Sampler folder(6), past(6), start(6), cut(6), wrap(6);
+  Sampler* loaded[] = {&past, &start, &cut, &wrap};
+  const int n = sizeof(loaded) / sizeof(loaded[0]);
+  folder.Init();
+  LittleFS.setRoot(tmp.c_str());
+  for (int b = 0; b < n; b++) {
+    int packed = kitpack((data + "/6").c_str(), image.c_str(), err);
+    CHECK(packed > 0, "kitpack: %s", err.c_str());
+    CHECK(patch_file(image, broken[b].at, broken[b].patch, broken[b].cut), "can't patch %s", image.c_str());
+    loaded[b]->Init();
+  }
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+
+  for (int b = 0; b < n; b++) {
+    CHECK(loaded[b]->GetSamplesCount() == folder.GetSamplesCount(), "%s: %d samples, the folder has %d",
+          broken[b].what, loaded[b]->GetSamplesCount(), folder.GetSamplesCount());
+  }
+  float fl[DMA_BUF_LEN], fr[DMA_BUF_LEN], bl[DMA_BUF_LEN], br[DMA_BUF_LEN];
+  int mismatches[n] = {};
+  for (int note = 0; note < folder.GetSamplesCount(); note++) {
+    folder.NoteOn(note, 127);
+    for (int b = 0; b < n; b++) loaded[b]->NoteOn(note, 127);
+    for (int k = 0, active = 1; k < 4000 && active > 0; k++) {     // to the end, so a longer sample shows
+      folder.ProcessBlock(fl, fr, DMA_BUF_LEN);
+      active = folder.GetActiveCount();
+      for (int b = 0; b < n; b++) {
+        active += loaded[b]->GetActiveCount();
+        loaded[b]->ProcessBlock(bl, br, DMA_BUF_LEN);
+        for (int i = 0; i < DMA_BUF_LEN; i++) mismatches[b] += (fl[i] != bl[i]) + (fr[i] != br[i]);
+      }
+    }
+  }
+  for (int b = 0; b < n; b++) {
+    CHECK(mismatches[b] == 0, "kit 6 with %s differs from the folder in %d samples", broken[b].what, mismatches[b]);
+  }
+}
+
+// ============================================ velocity layers and round robin ============================================
+
+// kit 6 plus a copy of its low tom as a hard bass drum from velocity 100 (96 rounded) and a copy of its high tom
+// taking turns with the snare. Hits on the layered kit play what the plain kit plays on the sample the layer
+// copies, from the folder with its layers.txt and from a packed image of it alike.
+static void check_layers() {
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/3").c_str(), 0755);
+  mkdir((tmp + "/kits").c_str(), 0755);
+  system(("cp " + data + "/6/*.wav " + tmp + "/3/").c_str());
+  system(("cp " + data + "/6/603_808_LT1.wav " + tmp + "/3/690_hard.wav").c_str());
+  system(("cp " + data + "/6/604_808_HT1.wav " + tmp + "/3/691_rr.wav").c_str());
+  FILE* f = fopen((tmp + "/3/" KIT_LAYERS_FILE).c_str(), "w");
+  CHECK(f != NULL, "can't write %s", KIT_LAYERS_FILE);
+  if (!f) return;
+  fprintf(f, "# note velocity file\n  0 100 690_hard.wav\n1 0 691_rr.wav\n\n2 0 missing.wav\n");
+  fclose(f);
+
+  static Sampler plain(6), folder(3), image(3);
+  plain.Init();
+  LittleFS.setRoot(tmp.c_str());
+  folder.Init();
+  std::string err;
+  int packed = kitpack((tmp + "/3").c_str(), (tmp + "/kits/3.kit").c_str(), err);
+  CHECK(packed == 14, "kitpack: %d samples %s", packed, err.c_str());
+  system(("rm -rf " + tmp + "/3").c_str());
+  image.Init();
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+  CHECK(folder.GetSamplesCount() == 14 && image.GetSamplesCount() == 14, "layered kit: %d samples from the folder, %d from the image",
+        folder.GetSamplesCount(), image.GetSamplesCount());
+
+  // note, velocity on the layered kit -> note on kit 6
+  static const int hits[][3] = {{0, 127, 2}, {0, 96, 2}, {0, 95, 0}, {0, 20, 0}, {1, 64, 1}, {1, 127, 3}, {1, 10, 1}, {1, 80, 3}, {2, 127, 2}};
+  int wrong = 0;
+  for (auto& h : hits) {
+    float pl[DMA_BUF_LEN], pr[DMA_BUF_LEN], fl[DMA_BUF_LEN], fr[DMA_BUF_LEN], il[DMA_BUF_LEN], ir[DMA_BUF_LEN];
+    plain.NoteOn(h[2], h[1]);
+    folder.NoteOn(h[0], h[1]);
+    image.NoteOn(h[0], h[1]);
+    int mismatches = 0;
+    for (int k = 0; k < 4000 && plain.GetActiveCount() + folder.GetActiveCount() + image.GetActiveCount() > 0; k++) {
+      plain.ProcessBlock(pl, pr, DMA_BUF_LEN);
+      folder.ProcessBlock(fl, fr, DMA_BUF_LEN);
+      image.ProcessBlock(il, ir, DMA_BUF_LEN);
+      for (int i = 0; i < DMA_BUF_LEN; i++) mismatches += (pl[i] != fl[i]) + (pr[i] != fr[i]) + (pl[i] != il[i]) + (pr[i] != ir[i]);
+    }
+    wrong += mismatches > 0;
+    CHECK(mismatches == 0, "layered kit: note %d at velocity %d doesn't play sample %d, %d samples differ", h[0], h[1], h[2], mismatches);
+  }
+  fprintf(stderr, "  %d layered hits, %d wrong\n", (int)(sizeof(hits) / sizeof(hits[0])), wrong);
+}
+
+// kit 6 with every sample a layer of the note before it. Layers of layers would sit in two groups, so
+// they play their own notes: the odd notes alone, each even note taking turns with the next sample.
+static void check_layer_chains() {
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/3").c_str(), 0755);
+  system(("cp " + data + "/6/*.wav " + tmp + "/3/").c_str());
+  std::vector<std::string> wavs;
+  kitpack_list(data + "/6", "/", 0, wavs);
+  FILE* f = fopen((tmp + "/3/" KIT_LAYERS_FILE).c_str(), "w");
+  CHECK(f != NULL, "can't write %s", KIT_LAYERS_FILE);
+  if (!f) return;
+  for (size_t i = 1; i < wavs.size(); i++) fprintf(f, "%d 0 %s\n", (int)i - 1, wavs[i].c_str() + 1);
+  fclose(f);
+
+  static Sampler plain(6), chained(3);
+  plain.Init();
+  LittleFS.setRoot(tmp.c_str());
+  chained.Init();
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+  CHECK(chained.GetSamplesCount() == plain.GetSamplesCount(), "chained kit: %d samples, kit 6 has %d",
+        chained.GetSamplesCount(), plain.GetSamplesCount());
+
+  int wrong = 0, n = plain.GetSamplesCount() & ~1;
+  for (int note = 0; note < n; note++) {
+    for (int turn = 0; turn < 2; turn++) {
+      int expect = note + (note % 2 == 0 && turn == 1);
+      float pl[DMA_BUF_LEN], pr[DMA_BUF_LEN], cl[DMA_BUF_LEN], cr[DMA_BUF_LEN];
+      plain.NoteOn(expect, 127);
+      chained.NoteOn(note, 127);
+      int mismatches = 0;
+      for (int k = 0; k < 4000 && plain.GetActiveCount() + chained.GetActiveCount() > 0; k++) {
+        plain.ProcessBlock(pl, pr, DMA_BUF_LEN);
+        chained.ProcessBlock(cl, cr, DMA_BUF_LEN);
+        for (int i = 0; i < DMA_BUF_LEN; i++) mismatches += (pl[i] != cl[i]) + (pr[i] != cr[i]);
+      }
+      wrong += mismatches > 0;
+      CHECK(mismatches == 0, "chained kit: hit %d of note %d doesn't play sample %d, %d samples differ", turn, note, expect, mismatches);
+    }
+  }
+  fprintf(stderr, "  %d hits on a chain of %d layers, %d wrong\n", 2 * n, (int)wavs.size() - 1, wrong);
+}
+
+// ============================================ Sampler: choke groups and voice stealing ============================================
+
+static void sampler_run(Sampler& s, int samples, std::vector<float>* out = NULL) {
+  float l[DMA_BUF_LEN], r[DMA_BUF_LEN];
+  for (int done = 0; done < samples; done += DMA_BUF_LEN) {
+    s.ProcessBlock(l, r, DMA_BUF_LEN);
+    if (out) out->insert(out->end(), l, l + DMA_BUF_LEN);
+  }
+}
+
+// the hats choke each other with a fade instead of a cut, any instrument can join a group, and a kit of 24
+// bass drums never sounds more than SAMPLER_MAX_VOICES hits (plus the ones fading out) however fast they come
+static void check_sampler_voices() {
+  static Sampler hats(6), open(6), cap(3);
+  hats.Init();
+  open.Init();
+  for (int n : {CH_NUMBER, OH_NUMBER}) {
+    open.ParseCC(CC_808_NOTE_SEL, n);
+    open.ParseCC(CC_808_NOTE_CHOKE, 0);
+  }
+  std::vector<float> a, b;
+  hats.NoteOn(OH_NUMBER, 127);
+  open.NoteOn(OH_NUMBER, 127);
+  sampler_run(hats, 2048);
+  sampler_run(open, 2048);
+  hats.NoteOn(CH_NUMBER, 127);
+  open.NoteOn(CH_NUMBER, 127);
+  CHECK(hats.IsPlaying(OH_NUMBER) && hats.GetActiveCount() == 2, "Sampler: the open hat stopped dead on the closed one");
+  sampler_run(hats, SAMPLE_RATE * SAMPLER_FADE_MS / 1000 + DMA_BUF_LEN, &a);
+  sampler_run(open, SAMPLE_RATE * SAMPLER_FADE_MS / 1000 + DMA_BUF_LEN, &b);
+  CHECK(!hats.IsPlaying(OH_NUMBER) && hats.IsPlaying(CH_NUMBER), "Sampler: the closed hat didn't choke the open one");
+  CHECK(open.IsPlaying(OH_NUMBER), "Sampler: the open hat got choked outside of a choke group");
+  float peak = 0.0f, jump = 0.0f;
+  for (size_t i = 0; i < a.size(); i++) peak = fmaxf(peak, fabsf(b[i]));
+  for (size_t i = 0; i < 4; i++) jump = fmaxf(jump, fabsf(a[i] - b[i]));
+  fprintf(stderr, "  choke: first samples off by %.3f of the peak\n", jump / peak);
+  CHECK(jump < 0.1f * peak, "Sampler: the choke cuts the open hat by %.2f of the peak at once", jump / peak);
+
+  hats.ParseCC(CC_808_NOTE_SEL, 0);
+  hats.ParseCC(CC_808_NOTE_CHOKE, 3 << 4);
+  hats.ParseCC(CC_808_NOTE_SEL, 1);
+  hats.ParseCC(CC_808_NOTE_CHOKE, 3 << 4);
+  hats.NoteOn(0, 127);
+  sampler_run(hats, 512);
+  hats.NoteOn(1, 127);
+  sampler_run(hats, SAMPLE_RATE * SAMPLER_FADE_MS / 1000 + DMA_BUF_LEN);
+  CHECK(!hats.IsPlaying(0) && hats.IsPlaying(1), "Sampler: the snare didn't choke the bass drum in group 3");
+
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/3").c_str(), 0755);
+  for (int i = 0; i < 24; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "/3/%03d_BD.wav", i);
+    system(("cp " + data + "/6/601_808_BD1.wav " + tmp + name).c_str());
+  }
+  LittleFS.setRoot(tmp.c_str());
+  cap.Init();
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+  CHECK(cap.GetSamplesCount() == 24, "Sampler: %d samples in the kit of bass drums", cap.GetSamplesCount());
+  for (int n : {CH_NUMBER, OH_NUMBER}) {
+    cap.ParseCC(CC_808_NOTE_SEL, n);
+    cap.ParseCC(CC_808_NOTE_CHOKE, 0);
+  }
+  for (int n = 0; n < SAMPLER_MAX_VOICES; n++) {
+    cap.NoteOn(n, n == 9 ? 20 : 100);
+    sampler_run(cap, DMA_BUF_LEN);
+  }
+  CHECK(cap.GetActiveCount() == SAMPLER_MAX_VOICES, "Sampler: %d bass drums sounding, expected %d", cap.GetActiveCount(), SAMPLER_MAX_VOICES);
+  cap.NoteOn(SAMPLER_MAX_VOICES, 100);      // the quiet one goes
+  sampler_run(cap, DMA_BUF_LEN);
+  cap.NoteOn(SAMPLER_MAX_VOICES + 1, 100);  // then the oldest
+  sampler_run(cap, SAMPLE_RATE * SAMPLER_FADE_MS / 1000 + DMA_BUF_LEN);
+  CHECK(!cap.IsPlaying(9) && !cap.IsPlaying(0) && cap.IsPlaying(1) && cap.IsPlaying(SAMPLER_MAX_VOICES) && cap.IsPlaying(SAMPLER_MAX_VOICES + 1),
+        "Sampler: stole the wrong hits, 9 %d, 0 %d, 1 %d", cap.IsPlaying(9), cap.IsPlaying(0), cap.IsPlaying(1));
+  int most = 0;
+  for (int n = 0; n < 500; n++) {
+    cap.NoteOn(n % 24, 64 + n % 64);
+    if (cap.GetActiveCount() > most) most = cap.GetActiveCount();
+    if (n % 50 == 0) sampler_run(cap, DMA_BUF_LEN);
+  }
+  fprintf(stderr, "  voices: at most %d sounding for a cap of %d\n", most, SAMPLER_MAX_VOICES);
+  CHECK(most <= SAMPLER_MAX_VOICES + Sampler::FADE_VOICES, "Sampler: %d hits sounding at once for a cap of %d", most, SAMPLER_MAX_VOICES);
+  sampler_run(cap, SAMPLE_RATE * SAMPLER_FADE_MS / 1000 + DMA_BUF_LEN);
+  CHECK(cap.GetActiveCount() <= SAMPLER_MAX_VOICES, "Sampler: %d hits left after the fades", cap.GetActiveCount());
+}
+
+#ifdef SAMPLER_STREAM
+// ============================================ streaming from flash ============================================
+
+// the audio task rewrites a stream's request as fast as it can while the prefetch task takes copies of it:
+// every copy Take() accepts must be one whole request, never fields of two
+static void check_stream_request() {
+  static SampleStream st;
+  const uint32_t total = 2000000;
+  std::atomic<bool> done{false};
+  std::thread audio([&]() {
+    for (uint32_t n = 1; n <= total; n++) st.Request(n & 1, n % 200, n, n * 3);
+    done = true;
+  });
+  uint32_t taken = 0, torn = 0;
+  while (!done) {
+    uint8_t kit, sample;
+    uint32_t from, end, g;
+    if (!st.Take(kit, sample, from, end, g)) continue;
+    taken++;
+    torn += from != 0 && (kit != (from & 1) || sample != from % 200 || end != from * 3);
+  }
+  audio.join();
+  fprintf(stderr, "  %u requests taken while they changed, %u torn\n", taken, torn);
+  CHECK(torn == 0 && st.gen.load() == 2 * total, "SampleStream: %u of %u requests taken torn, gen %u", torn, taken, st.gen.load());
+  uint8_t kit, sample;
+  uint32_t from, end, g;
+  st.gen.store(2 * total + 1);                                    // as seen in the middle of Request()
+  CHECK(!st.Take(kit, sample, from, end, g), "SampleStream: a request is taken while it changes");
+}
+
+// kit 6 from an image keeps only the heads of its long samples in the cache. Four long hits at a time, the
+// tails streaming, at twice the speed and per sample as well, play exactly what the folder plays. A fifth
+// long hit finds no stream and stops at the end of its head.
+static void check_sample_stream() {
+  const std::string data = LittleFS.getRoot();
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  mkdir((tmp + "/kits").c_str(), 0755);
+  std::string err;
+  int packed = kitpack((data + "/6").c_str(), (tmp + "/kits/6.kit").c_str(), err);
+  CHECK(packed > 0, "kitpack: %s", err.c_str());
+  static Sampler folder(6), image(6);
+  folder.Init();
+  LittleFS.setRoot(tmp.c_str());
+  image.Init();
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str()); // the sampler keeps the image open
+
+  std::vector<int> longs;
+  uint32_t head = 0;
+  for (int note = 0; note < image.GetSamplesCount(); note++) {
+    image.SelectNote(note);
+    if (image.GetSoundResident() < image.GetSoundSize()) {
+      longs.push_back(note);
+      head = image.GetSoundResident();
+    }
+  }
+  fprintf(stderr, "  stream: %d of %d samples stream, heads of %u frames\n", (int)longs.size(), image.GetSamplesCount(), head);
+  CHECK(longs.size() > SAMPLER_STREAM_VOICES, "stream: only %d samples of kit 6 are longer than the head", (int)longs.size());
+  if (longs.size() <= SAMPLER_STREAM_VOICES) return;
+
+  int mismatches = 0;
+  for (float speed : {0.5f, 0.75f}) {
+    folder.SetPlaybackSpeed(speed);
+    image.SetPlaybackSpeed(speed);
+    for (size_t k = 0; k < longs.size(); k += SAMPLER_STREAM_VOICES) {
+      for (size_t v = k; v < k + SAMPLER_STREAM_VOICES && v < longs.size(); v++) {
+        folder.NoteOn(longs[v], 127);
+        image.NoteOn(longs[v], 127);
+        mismatches += sampler_diff(folder, image, 3, 0.0f);
+      }
+      while (folder.GetActiveCount() > 0 || image.GetActiveCount() > 0) mismatches += sampler_diff(folder, image, 1, 0.0f);
+    }
+  }
+  folder.NoteOn(longs[0], 127);
+  image.NoteOn(longs[0], 127);
+  for (int i = 0; i < 4 * (int)head; i++) {
+    float fl, fr, il, ir;
+    folder.Process(&fl, &fr);
+    image.Process(&il, &ir);
+    mismatches += (fl != il) + (fr != ir);
+    if (i == 2 * (int)head) { // a retrigger keeps its stream
+      folder.NoteOn(longs[0], 100);
+      image.NoteOn(longs[0], 100);
+    }
+  }
+  CHECK(mismatches == 0, "stream: the image differs from the folder in %d samples", mismatches);
+  CHECK(image.GetStreamUnderruns() == 0, "stream: %u frames came late", image.GetStreamUnderruns());
+
+  while (image.GetActiveCount() > 0) sampler_run(image, DMA_BUF_LEN);
+  image.SetPlaybackSpeed(0.5f);
+  for (int n : {CH_NUMBER, OH_NUMBER}) {
+    image.ParseCC(CC_808_NOTE_SEL, n);
+    image.ParseCC(CC_808_NOTE_CHOKE, 0);
+  }
+  for (int v = 0; v <= SAMPLER_STREAM_VOICES; v++) image.NoteOn(longs[v], 127);
+  sampler_run(image, head + DMA_BUF_LEN);
+  CHECK(image.GetActiveCount() == SAMPLER_STREAM_VOICES, "stream: %d hits left after the head, expected %d",
+        image.GetActiveCount(), SAMPLER_STREAM_VOICES);
+}
+#endif
+
+// ============================================ Sampler: drum buses ============================================
+
+struct BusRun {
+  double dl = 0, dr = 0, rl = 0, rr = 0, side = 0, outL = 0; // energies
+  int reverbOff = 0;                                          // samples where the reverb send isn't reverb / delay times k
+};
+
+// one hit through ProcessBlock() with the sends, until it has ended
+static BusRun bus_hit(Sampler& d, int note, float k) {
+  float l[DMA_BUF_LEN], r[DMA_BUF_LEN], dl[DMA_BUF_LEN], dr[DMA_BUF_LEN], rl[DMA_BUF_LEN], rr[DMA_BUF_LEN], sc[DMA_BUF_LEN];
+  DrumSends sends = {dl, dr, rl, rr, sc};
+  BusRun run;
+  d.NoteOn(note, 127);
+  for (int b = 0; b < 4000 && d.GetActiveCount() > 0; b++) {
+    d.ProcessBlock(l, r, DMA_BUF_LEN, &sends);
+    for (int i = 0; i < DMA_BUF_LEN; i++) {
+      run.dl += dl[i] * dl[i];
+      run.dr += dr[i] * dr[i];
+      run.rl += rl[i] * rl[i];
+      run.rr += rr[i] * rr[i];
+      run.side += sc[i] * sc[i];
+      run.outL += l[i] * l[i];
+      run.reverbOff += fabsf(rl[i] - k * dl[i]) > 1e-6f || fabsf(rr[i] - k * dr[i]) > 1e-6f;
+    }
+  }
+  return run;
+}
+
+// the kick and the snare on their own buses: the kick sends less to the reverb and drives the side-chain, the
+// snare doesn't, a bus panned hard right sends nothing left, and a note moved to another bus takes its settings
+static void check_drum_buses() {
+  static Sampler d(6);
+  d.Init();
+  d.ParseCC(CC_808_DELAY_SEND, 127);
+  d.ParseCC(CC_808_REVERB_SEND, 127);
+  BusRun kick = bus_hit(d, 0, 0.25f);
+  CHECK(kick.dl > 0.0 && kick.side > 0.0 && kick.reverbOff == 0, "drum buses: kick sends %g to the delay, %g to the side-chain, reverb off in %d samples",
+        kick.dl, kick.side, kick.reverbOff);
+  BusRun snare = bus_hit(d, 1, 1.0f);
+  CHECK(snare.dl > 0.0 && snare.side == 0.0 && snare.reverbOff == 0, "drum buses: snare sends %g to the delay, %g to the side-chain, reverb off in %d samples",
+        snare.dl, snare.side, snare.reverbOff);
+  d.ParseCC(CC_808_NOTE_SEL, 1);
+  d.ParseCC(CC_808_BUS_PAN, 127);
+  snare = bus_hit(d, 1, 1.0f);
+  CHECK(snare.dl == 0.0 && snare.rl == 0.0 && snare.dr > 0.0, "drum buses: snare bus panned right sends %g left, %g right", snare.dl, snare.dr);
+  CHECK(snare.outL < 1e-3 * snare.dr, "drum buses: snare bus panned right plays %g left", snare.outL);
+  d.ParseCC(CC_808_NOTE_SEL, 0);
+  d.ParseCC(CC_808_NOTE_BUS, BUS_SNARE << 5);
+  kick = bus_hit(d, 0, 1.0f);
+  CHECK(kick.dl == 0.0 && kick.dr > 0.0 && kick.side == 0.0 && kick.reverbOff == 0, "drum buses: kick on the snare bus sends %g left, %g to the side-chain",
+        kick.dl, kick.side);
+}
+
+// ============================================ Sampler: interpolation ============================================
+
+// a sine read at fractional positions through each interpolation, error re the exact sine. Each mode is
+// within its bound, towards Nyquist every mode beats the one before it, and the sinc is never worse than Hermite.
+// At 0.01 cycles per frame both are down at the rounding of the 16 bit sine.
+static void check_interpolation() {
+  BuildSincTable();
+  static const double bounds[INTERP_MODES] = {-10.0, -35.0, -60.0, -75.0}; // at 0.05 cycles per frame
+  std::vector<int16_t> x(4096 + 16);
+  int order = 0;
+  for (double f : {0.01, 0.05, 0.2}) {
+    for (size_t i = 0; i < x.size(); i++) x[i] = (int16_t)lrint(30000.0 * sin(2.0 * M_PI * f * i));
+    double last = 1e9, hermite = 0.0;
+    for (int mode = INTERP_NONE; mode < INTERP_MODES; mode++) {
+      double sig = 0.0, err = 0.0;
+      uint32_t r = 12345;
+      for (int k = 0; k < 20000; k++) {
+        r = r * 1664525u + 1013904223u;
+        double pos = 8.0 + (r >> 8) * (4000.0 / (1 << 24));
+        uint32_t p = pos;
+        double want = 30000.0 * sin(2.0 * M_PI * f * pos);
+        double got = Interpolate(mode, &x[p], (float)(pos - p));
+        sig += want * want;
+        err += (got - want) * (got - want);
+      }
+      double err_dB = 10.0 * log10(err / sig);
+      fprintf(stderr, "  interpolation %d at %.2f cycles per frame: error %6.1f dB re signal\n", mode, f, err_dB);
+      if (f == 0.2) order += err_dB >= last;
+      last = err_dB;
+      if (f == 0.05) CHECK(err_dB < bounds[mode], "interpolation %d is off by %.1f dB at 0.05 cycles per frame", mode, err_dB);
+      if (mode == INTERP_HERMITE) hermite = err_dB;
+      if (mode == INTERP_SINC) CHECK(err_dB <= hermite, "interpolation: sinc %.1f dB, Hermite %.1f dB at %.2f cycles per frame", err_dB, hermite, f);
+    }
+  }
+  CHECK(order == 0, "interpolation: a better mode is worse than the one before it %d times", order);
+}
+
+// ============================================ FxReverb: block vs. per sample, instances apart ============================================
+
+// a noise burst through the reverb sample by sample and in blocks must give the same tail, with a second
+// reverb on other input running in between: the instances share no state
+static void check_reverb() {
+  static FxReverb single, block, other;
+  single.Init();
+  block.Init();
+  other.Init();
+  const int len = 16384;
+  std::vector<float> sl(len), sr(len), bl(len), br(len), ol(len), orr(len);
+  uint32_t seed = 1;
+  for (int i = 0; i < len; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    float x = i < 2048 ? ((int32_t)seed >> 8) * (1.0f / 8388608.0f) : 0.0f;
+    sl[i] = bl[i] = x;
+    sr[i] = br[i] = 0.5f * x;
+    ol[i] = orr[i] = (i % 100 == 0) ? 1.0f : 0.0f;
+  }
+  for (int i = 0; i < len; i++) single.Process(&sl[i], &sr[i]);
+  for (int i = 0; i < len; i += DMA_BUF_LEN) {
+    block.Process(&bl[i], &br[i], DMA_BUF_LEN);
+    other.Process(&ol[i], &orr[i], DMA_BUF_LEN);
+  }
+  int mismatches = 0;
+  float tail = 0.0f;
+  for (int i = 0; i < len; i++) {
+    mismatches += (sl[i] != bl[i]) + (sr[i] != br[i]);
+    if (i >= 4096) tail = fmaxf(tail, fabsf(bl[i]));
+  }
+  CHECK(tail > 1e-3f, "FxReverb: no tail after the burst, peak %g", tail);
+  CHECK(mismatches == 0, "FxReverb: blocks next to a second reverb differ from one reverb per sample in %d samples", mismatches);
+}
+
+// ============================================ WAV conversion ============================================
+
+// a WAV of x (16 bit scale) in any format the converter takes, every channel the same
+static bool write_wav(const std::string& path, const std::vector<float>& x, int format, int channels, int bits, uint32_t rate, bool extensible = false) {
+  std::vector<uint8_t> d;
+  for (float v : x) {
+    for (int c = 0; c < channels; c++) {
+      uint32_t u;
+      if (format == WAV_FORMAT_FLOAT) { float f = v / 32768.0f; memcpy(&u, &f, 4); }
+      else if (bits == 8) u = (uint8_t)(lrintf(v / 256.0f) + 128);
+      else u = (uint32_t)((int32_t)lrintf(v) << (bits - 16));
+      for (int b = 0; b < bits / 8; b++) d.push_back(u >> (8 * b));
+    }
+  }
+  std::vector<uint8_t> h;
+  auto put = [&h](uint32_t v, int n) { for (int b = 0; b < n; b++) h.push_back(v >> (8 * b)); };
+  auto tag = [&h](const char* t) { h.insert(h.end(), t, t + 4); };
+  uint32_t fmtLen = extensible ? 40 : 16;
+  tag("RIFF"); put(4 + 8 + fmtLen + 8 + d.size(), 4); tag("WAVE");
+  tag("fmt "); put(fmtLen, 4); put(extensible ? WAV_FORMAT_EXTENSIBLE : format, 2); put(channels, 2);
+  put(rate, 4); put(rate * channels * bits / 8, 4); put(channels * bits / 8, 2); put(bits, 2);
+  if (extensible) {
+    put(22, 2); put(bits, 2); put(channels == 1 ? 4 : 3, 4); put(format, 2);
+    static const uint8_t guid[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    h.insert(h.end(), guid, guid + 14);
+  }
+  tag("data"); put(d.size(), 4);
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(h.data(), 1, h.size(), f) == h.size() && fwrite(d.data(), 1, d.size(), f) == d.size();
+  return (fclose(f) == 0) && ok;
+}
+
+// a WAV through the converter to mono 16 bit at rate
+static std::vector<int16_t> convert_wav(const std::string& path, uint32_t rate) {
+  static WavConverter conv;
+  std::vector<int16_t> out;
+  KitPackFile f = {fopen(path.c_str(), "rb")};
+  if (!f.fp) return out;
+  WavInfo wav;
+  if (ReadWavInfo(f, wav) && conv.Begin(wav, wav.dataBytes, rate)) {
+    out.resize(conv.Frames());
+    if (!conv.Read(f, out.data(), out.size())) out.clear();
+    conv.End();
+  }
+  fclose(f.fp);
+  return out;
+}
+
+static double error_dB(const std::vector<double>& want, const std::vector<int16_t>& got, size_t from, size_t to) {
+  double sig = 0.0, err = 0.0;
+  for (size_t i = from; i < to && i < got.size(); i++) {
+    sig += want[i] * want[i];
+    err += (got[i] - want[i]) * (got[i] - want[i]);
+  }
+  return 10.0 * log10((err + 1e-30) / (sig + 1e-30));
+}
+
+// every format the sampler takes turns into the same 16 bit mono frames (8 bit within its resolution), a
+// resampled tone stays in tune and clean, a tone above the new Nyquist frequency is gone, and a kit at mixed
+// rates loads the same from its WAV folder and from an image at the original rates
+static void check_wav_convert() {
+  char tmpl[] = "/tmp/acidbox_check_XXXXXX";
+  const std::string tmp = mkdtemp(tmpl);
+  std::vector<float> x(5000);
+  for (size_t i = 0; i < x.size(); i++) x[i] = (float)lrint(20000.0 * sin(0.01 * i * i / x.size()) * (1.0 - (double)i / x.size()));
+  struct { int format, channels, bits; bool ext; } formats[] = {
+    {WAV_FORMAT_PCM, 1, 16, false}, {WAV_FORMAT_PCM, 2, 16, false}, {WAV_FORMAT_PCM, 1, 24, false}, {WAV_FORMAT_PCM, 2, 24, true},
+    {WAV_FORMAT_PCM, 1, 32, false}, {WAV_FORMAT_FLOAT, 1, 32, false}, {WAV_FORMAT_FLOAT, 2, 32, true}, {WAV_FORMAT_PCM, 1, 8, false},
+  };
+  int mismatches = 0;
+  for (auto& f : formats) {
+    std::string path = tmp + "/f.wav";
+    write_wav(path, x, f.format, f.channels, f.bits, SAMPLE_RATE, f.ext);
+    std::vector<int16_t> y = convert_wav(path, SAMPLE_RATE);
+    if (y.size() != x.size()) {
+      CHECK(false, "WAV format %d, %d channels, %d bits: %d frames instead of %d", f.format, f.channels, f.bits, (int)y.size(), (int)x.size());
+      continue;
+    }
+    int wrong = 0;
+    for (size_t i = 0; i < x.size(); i++) wrong += (f.bits == 8) ? fabsf(y[i] - x[i]) > 128.0f : y[i] != x[i];
+    mismatches += wrong;
+  }
+  CHECK(mismatches == 0, "WAV conversion: %d frames differ from the 16 bit mono original", mismatches);
+
+  // 1 kHz from 22050 up to 44100 Hz and back down, 15 kHz from 44100 Hz down to 22050 Hz
+  std::vector<float> tone(22050);
+  std::vector<double> want(88200);
+  for (size_t i = 0; i < tone.size(); i++) tone[i] = 16000.0f * sinf(2.0f * (float)M_PI * 1000.0f * i / 22050.0f);
+  write_wav(tmp + "/up.wav", tone, WAV_FORMAT_PCM, 1, 16, 22050);
+  std::vector<int16_t> up = convert_wav(tmp + "/up.wav", 44100);
+  for (size_t i = 0; i < want.size(); i++) want[i] = 16000.0 * sin(2.0 * M_PI * 1000.0 * i / 44100.0);
+  double upErr = error_dB(want, up, 100, 44000);
+  write_wav(tmp + "/down.wav", std::vector<float>(up.begin(), up.end()), WAV_FORMAT_PCM, 1, 16, 44100);
+  std::vector<int16_t> down = convert_wav(tmp + "/down.wav", 22050);
+  for (size_t i = 0; i < want.size(); i++) want[i] = 16000.0 * sin(2.0 * M_PI * 1000.0 * i / 22050.0);
+  double downErr = error_dB(want, down, 100, 22000);
+  for (size_t i = 0; i < tone.size(); i++) tone[i] = 16000.0f * sinf(2.0f * (float)M_PI * 15000.0f * i / 44100.0f);
+  write_wav(tmp + "/high.wav", tone, WAV_FORMAT_PCM, 1, 16, 44100);
+  std::vector<int16_t> high = convert_wav(tmp + "/high.wav", 22050);
+  double residue = 0.0;
+  for (size_t i = 100; i < 11000 && i < high.size(); i++) residue += (double)high[i] * high[i];
+  double alias = 10.0 * log10(residue / 10900.0 / (0.5 * 16000.0 * 16000.0) + 1e-30); // re the tone
+  fprintf(stderr, "  WAV resampling: 22050 -> 44100 Hz %6.1f dB, 44100 -> 22050 Hz %6.1f dB, 15 kHz left %6.1f dB\n", upErr, downErr, alias);
+  CHECK(up.size() == 44100 && down.size() == 22050, "WAV resampling: %d and %d frames", (int)up.size(), (int)down.size());
+  CHECK(upErr < -60.0 && downErr < -60.0, "WAV resampling is off by %.1f dB up, %.1f dB down", upErr, downErr);
+  CHECK(alias < -50.0, "WAV resampling lets %.1f dB of a 15 kHz tone through to 22050 Hz", alias);
+
+  // 4 and 8 times the rate down take a kernel as many times wider, or what's above the new Nyquist frequency folds back
+  for (uint32_t ratio : {4u, 8u}) {
+    std::vector<float> hf(22050 * ratio);
+    for (size_t i = 0; i < hf.size(); i++) hf[i] = 16000.0f * sinf(2.0f * (float)M_PI * 0.7f * i / ratio); // 15435 Hz, folds to 6615 Hz
+    write_wav(tmp + "/hf.wav", hf, WAV_FORMAT_PCM, 1, 16, 22050 * ratio);
+    std::vector<int16_t> low = convert_wav(tmp + "/hf.wav", 22050);
+    residue = 0.0;
+    for (size_t i = 100; i < 22000 && i < low.size(); i++) residue += (double)low[i] * low[i];
+    alias = 10.0 * log10(residue / 21900.0 / (0.5 * 16000.0 * 16000.0) + 1e-30);
+    fprintf(stderr, "  WAV resampling: %d times down, a tone at 1.4 times the new Nyquist frequency left %6.1f dB\n", ratio, alias);
+    CHECK(low.size() == 22050 && alias < -50.0, "WAV resampling %d times down: %d frames, %.1f dB of the tone left", ratio, (int)low.size(), alias);
+  }
+  static WavConverter conv;
+  WavInfo far = {WAV_FORMAT_PCM, 1, 16, 2, 22050 * (WAV_CONVERT_MAX_RATIO + 1), 1000};
+  CHECK(!conv.Begin(far, far.dataBytes, 22050) && conv.Refused() != NULL, "WAV resampling takes %d times the rate down", WAV_CONVERT_MAX_RATIO + 1);
+  CHECK(sizeof(WavConverter) < 128, "WavConverter holds %d bytes between conversions", (int)sizeof(WavConverter));
+
+  // kit 4 mixes 44100, 32000 and 22050 Hz
+  const std::string data = LittleFS.getRoot();
+  mkdir((tmp + "/kits").c_str(), 0755);
+  std::string err;
+  int packed = kitpack((data + "/4").c_str(), (tmp + "/kits/4.kit").c_str(), err);
+  CHECK(packed > 0, "kitpack: %s", err.c_str());
+  static Sampler folder(4), image(4);
+  folder.Init();
+  LittleFS.setRoot(tmp.c_str());
+  image.Init();
+  LittleFS.setRoot(data.c_str());
+  system(("rm -rf " + tmp).c_str());
+  CHECK(image.GetSamplesCount() == packed && folder.GetSamplesCount() == packed, "kit 4: %d samples packed, %d from the folder, %d from the image",
+        packed, folder.GetSamplesCount(), image.GetSamplesCount());
+  for (int note = 0; note < folder.GetSamplesCount(); note++) {
+    folder.SelectNote(note);
+    CHECK(folder.GetSoundSamplerate() == SAMPLE_RATE, "kit 4 sample %d plays at %d Hz", note, folder.GetSoundSamplerate());
+    folder.NoteOn(note, 127);
+    image.NoteOn(note, 127);
+  }
+  mismatches = sampler_diff(folder, image, 400, 0.0f);
+  CHECK(mismatches == 0, "kit 4 from an image at the original rates differs from the folder in %d samples", mismatches);
+}
+
+// ============================================ ADPCM sample store ============================================
+
+// the 16 bit PCM of a WAV, empty if it isn't one the sampler takes
+static std::vector<int16_t> read_pcm(const std::string& path) {
+  std::vector<int16_t> pcm;
+  KitPackFile f = {fopen(path.c_str(), "rb")};
+  if (!f.fp) return pcm;
+  WavInfo wav;
+  if (ReadWavInfo(f, wav) && wav.format == 1 && wav.channels == 1 && wav.bits == 16) {
+    pcm.resize(wav.dataBytes / 2);
+    pcm.resize(fread(pcm.data(), 2, pcm.size(), f.fp));
+  }
+  fclose(f.fp);
+  return pcm;
+}
+
+// every sample of two kits through the encoder: the decoded sound stays close to the PCM, and a decoder
+// that starts from a seek point (an offset_midi start) gives the same frames as one that played through
+static void check_adpcm() {
+  const std::string data = LittleFS.getRoot();
+  double worst = -999.0;
+  std::string worstName;
+  int samples = 0, seekMismatches = 0;
+  for (const char* kit : {"/0", "/6"}) {
+    std::vector<std::string> wavs;
+    kitpack_list(data + kit, "/", 5, wavs);
+    for (const std::string& w : wavs) {
+      std::vector<int16_t> pcm = read_pcm(data + kit + w);
+      if (pcm.empty()) continue;
+      samples++;
+      std::vector<uint8_t> store(AdpcmBytes(pcm.size()));
+      AdpcmEncoder enc;
+      enc.Begin(store.data());
+      for (int16_t x : pcm) enc.Push(x);
+      enc.End();
+
+      AdpcmDecoder dec;
+      dec.Seek(store.data(), 0, pcm.size());
+      std::vector<int32_t> out(pcm.size());
+      double sig = 0.0, err = 0.0;
+      for (size_t i = 0; i < pcm.size(); i++) {
+        out[i] = dec.Get(store.data(), i);
+        sig += (double)pcm[i] * pcm[i];
+        err += (double)(out[i] - pcm[i]) * (out[i] - pcm[i]);
+      }
+      double err_dB = 10.0 * log10((err + 1e-30) / (sig + 1e-30));
+      if (err_dB > worst) { worst = err_dB; worstName = kit + w; }
+
+      for (uint32_t start : {0u, 2u, 100u, 254u, 255u, 256u, 257u, 1000u, 4097u}) {
+        if (start >= pcm.size()) continue;
+        dec.Seek(store.data(), start, pcm.size());
+        for (uint32_t i = start; i < pcm.size() && i < start + 700; i += 1 + (i & 1)) {
+          seekMismatches += dec.Get(store.data(), i) != out[i];
+        }
+      }
+    }
+  }
+  CHECK(samples > 10, "ADPCM: only %d samples found in kits 0 and 6", samples);
+  fprintf(stderr, "  ADPCM: %d samples, worst error %6.1f dB re signal (%s)\n", samples, worst, worstName.c_str());
+  // 4 bits per frame can't follow noise: hats and cymbals come out around -11 dB, the tonal drums below -30 dB
+  CHECK(worst < -10.0, "ADPCM: %s is off by %.1f dB", worstName.c_str(), worst);
+  CHECK(seekMismatches == 0, "ADPCM: starts from a seek point differ from playing through in %d frames", seekMismatches);
+}
+
+// ==================================================================================================================================
+
+int main(int argc, char** argv) {
+  const char* dataDir = "../data";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc) dataDir = argv[++i];
+    else { fprintf(stderr, "usage: %s [-d data_dir]\n", argv[0]); return 1; }
+  }
+  LittleFS.setRoot(dataDir);
+  buildTables();
+
+  struct { const char* name; void (*fn)(); } checks[] = {
+    {"lookup kernels", check_lookup_kernels},
+    {"oscillator mipmaps band-limited", check_mipmaps},
+    {"synth block == per-sample", check_synth_block},
+    {"filter control rate within bound", check_filter_decimation},
+    {"MIDI queue in order, sample accurate", check_midi_queue},
+    {"synth kernel == voice by voice", check_synth_kernel},
+    {"JUKEBOX ticks on the sample grid", check_jukebox_timing},
+    {"sampler block == per-sample", check_sampler_block},
+    {"sampler kit switch, old hits ring out", check_sampler_kits},
+    {"kit image == WAV folder", check_kit_image},
+    {"broken kit image -> WAV folder", check_kit_image_broken},
+#ifdef SAMPLER_STREAM
+    {"streamed tails == cached samples", check_sample_stream},
+    {"stream requests never torn", check_stream_request},
+#endif
+    {"velocity layers and round robin", check_layers},
+    {"layers of layers play their own note", check_layer_chains},
+    {"sampler chokes fade, voices capped", check_sampler_voices},
+    {"drum buses pan, send and tap", check_drum_buses},
+    {"reverb block == per-sample, apart", check_reverb},
+    {"WAV formats and rates convert", check_wav_convert},
+    {"ADPCM within bound, seeks exact", check_adpcm},
+    {"sampler interpolation within bound", check_interpolation},
+    {"audio ring in order, never torn", check_audio_ring},
+    {"load balancer splits and hands off", check_load_balancer},
+#ifdef FILTER_COEF_LATTICE
+    {"filter lattice within bound", check_filter_lattice},
+#endif
+  };
+  for (auto& c : checks) {
+    int before = failures;
+    c.fn();
+    fprintf(stderr, "%-40s %s\n", c.name, failures == before ? "ok" : "FAILED");
+  }
+  return failures;
+}
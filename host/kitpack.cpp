@@ -0,0 +1,31 @@
+/*
+ * acidbox_kitpack: packs a drum kit folder into one kit image (../kit_image.h) for the sampler.
+ *
+ * usage: acidbox_kitpack [-r rate] kit_folder out.kit
+ *
+ * Put the images into /kits/ on LittleFS, named by program number (/kits/6.kit). A kit with an image loads
+ * with one read instead of a folder scan, if all its samples are at the board's SAMPLE_RATE: -r resamples
+ * them to it while packing. Packing the data folder itself gives /kits/all.kit for PRELOAD_ALL.
+ */
+#include "kitpack.h"
+
+int main(int argc, char** argv) {
+  uint32_t rate = 0;
+  int a = 1;
+  if (argc == 5 && !strcmp(argv[1], "-r")) {
+    rate = atoi(argv[2]);
+    a = 3;
+  }
+  if (argc != a + 2) {
+    fprintf(stderr, "usage: %s [-r rate] kit_folder out.kit\n", argv[0]);
+    return 1;
+  }
+  std::string err;
+  int n = kitpack(argv[a], argv[a + 1], err, rate);
+  if (n < 0) {
+    fprintf(stderr, "%s\n", err.c_str());
+    return 1;
+  }
+  printf("%s: %d samples\n", argv[a + 1], n);
+  return 0;
+}
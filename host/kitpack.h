@@ -0,0 +1,122 @@
+/*
+ * Kit image packer, see ../kit_image.h for the format. Used by acidbox_kitpack and by the checks.
+ *
+ * The samples are taken in the order the sampler's own folder scan finds them: name order, subfolders
+ * where they sort in. They go through the sampler's WavConverter (../wav_convert.h), so any WAV the sampler
+ * takes ends up as 16 bit mono, at its own rate or resampled to rate if that isn't 0. An image at the board's
+ * SAMPLE_RATE loads with a single read, any other one gets resampled while it loads. A layers.txt in the
+ * folder goes into the entries' layerNote and layerVelocity.
+ */
+#pragma once
+#ifndef HOST_KITPACK_H
+#define HOST_KITPACK_H
+
+#include "../kit_image.h"
+#include "../wav_convert.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct KitPackFile {
+  FILE* fp;
+  size_t read(uint8_t* buf, size_t len) { return fread(buf, 1, len, fp); }
+};
+
+// the WAVs below dir, depth first in name order, as Sampler::ScanContents() walks them
+static void kitpack_list(const std::string& dir, const std::string& rel, int levels, std::vector<std::string>& out) {
+  std::vector<std::string> names;
+  if (DIR* d = opendir(dir.c_str())) {
+    while (struct dirent* e = readdir(d)) {
+      if (e->d_name[0] != '.') names.push_back(e->d_name);
+    }
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+  for (const std::string& n : names) {
+    struct stat st;
+    if (stat((dir + "/" + n).c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (levels > 0) kitpack_list(dir + "/" + n, rel + n + "/", levels - 1, out);
+    } else if (n.size() > 4 && strcasecmp(n.c_str() + n.size() - 4, ".wav") == 0) {
+      out.push_back(rel + n);
+    }
+  }
+}
+
+// packs the kit folder dir into the image out, returns the number of samples or -1, with the reason in err
+static int kitpack(const char* dir, const char* out, std::string& err, uint32_t rate = 0) {
+  static WavConverter conv;
+  std::vector<std::string> files;
+  kitpack_list(dir, "/", 5, files);
+  std::vector<KitImageEntry> index;
+  std::vector<int16_t> payload;
+  for (const std::string& name : files) {
+    std::string path = std::string(dir) + name;
+    KitPackFile f = {fopen(path.c_str(), "rb")};
+    if (!f.fp) { err = "can't open " + path; return -1; }
+    WavInfo wav;
+    size_t len = 0;
+    if (ReadWavInfo(f, wav)) {
+      long at = ftell(f.fp);
+      fseek(f.fp, 0, SEEK_END);
+      len = ftell(f.fp) - at;
+      fseek(f.fp, at, SEEK_SET);
+    }
+    if (len == 0 || !conv.Begin(wav, wav.dataBytes < len ? wav.dataBytes : len, rate ? rate : wav.sampleRate)) { // some samples have wrong header info
+      fprintf(stderr, "%s skipped: %s\n", path.c_str(), len == 0 ? "no sample data" : conv.Refused());
+      fclose(f.fp);
+      continue;
+    }
+    KitImageEntry e = {};
+    e.start = (payload.size() + KIT_IMAGE_ALIGN - 1) / KIT_IMAGE_ALIGN * KIT_IMAGE_ALIGN;
+    e.frames = conv.Frames();
+    e.sampleRate = rate ? rate : wav.sampleRate;
+    strncpy(e.name, name.c_str(), KIT_IMAGE_NAME - 1);
+    payload.resize(e.start + e.frames + KIT_IMAGE_GUARD, 0);
+    bool ok = conv.Read(f, &payload[e.start], e.frames);
+    conv.End();
+    fclose(f.fp);
+    if (!ok) { err = "short read in " + path; return -1; }
+    index.push_back(e);
+  }
+  if (index.empty()) { err = std::string("no samples in ") + dir; return -1; }
+
+  if (FILE* l = fopen((std::string(dir) + "/" KIT_LAYERS_FILE).c_str(), "r")) {
+    char line[128], name[KIT_IMAGE_NAME];
+    int note, velocity;
+    while (fgets(line, sizeof(line), l)) {
+      if (!ParseLayerLine(line, note, velocity, name)) continue;
+      for (KitImageEntry& e : index) {
+        if (LayerNameMatches(e.name, name) && note < (int)index.size()) {
+          e.layerNote = note + 1;
+          e.layerVelocity = velocity;
+        }
+      }
+    }
+    fclose(l);
+  }
+
+  KitImageHeader hdr = {};
+  hdr.magic = KIT_IMAGE_MAGIC;
+  hdr.version = KIT_IMAGE_VERSION;
+  hdr.count = index.size();
+  hdr.dataOffset = (sizeof(hdr) + index.size() * sizeof(KitImageEntry) + 15) & ~15u;
+  hdr.dataFrames = payload.size();
+  FILE* o = fopen(out, "wb");
+  if (!o) { err = std::string("can't write ") + out; return -1; }
+  static const uint8_t zeros[16] = {};
+  size_t pad = hdr.dataOffset - sizeof(hdr) - index.size() * sizeof(KitImageEntry);
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, o) == 1
+         && fwrite(index.data(), sizeof(KitImageEntry), index.size(), o) == index.size()
+         && fwrite(zeros, 1, pad, o) == pad
+         && fwrite(payload.data(), 2, payload.size(), o) == payload.size();
+  ok = (fclose(o) == 0) && ok;
+  if (!ok) { err = std::string("can't write ") + out; return -1; }
+  return index.size();
+}
+
+#endif
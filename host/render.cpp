@@ -0,0 +1,92 @@
+/*
+ * acidbox_render: runs the real AcidBox engine on a workstation, faster than real time.
+ *
+ * The sketch is set up exactly like on the board (setup()), then the render loop plays both audio
+ * tasks in turn through the audio ring: Core0 renders its engines as far ahead as the ring allows,
+ * Core1 renders its own, mixes and "outputs" one block. The load balancer decides which engine is whose.
+ * The I2S output is either a 16 bit stereo WAV file or a null sink.
+ *
+ * usage: acidbox_render [-t seconds] [-o out.wav] [-d data_dir] [-s seed] [-q]
+ */
+#include "sketch.h"
+#include <time.h>
+
+static double now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct EngineStat {
+  const char* name;
+  double total_us = 0.0;
+  double peak_us = 0.0;
+  void add(double us) { total_us += us; if (us > peak_us) peak_us = us; }
+};
+
+static void usage(const char* self) {
+  fprintf(stderr, "usage: %s [-t seconds] [-o out.wav] [-d data_dir] [-s seed] [-q]\n", self);
+  fprintf(stderr, "  -t  length of the render in seconds (default 60)\n");
+  fprintf(stderr, "  -o  16 bit stereo WAV output, omit for the null sink\n");
+  fprintf(stderr, "  -d  folder that stands in for the LittleFS partition (default ../data)\n");
+  fprintf(stderr, "  -s  random seed, same seed gives the same tune (default 1)\n");
+  fprintf(stderr, "  -q  no report\n");
+}
+
+int main(int argc, char** argv) {
+  float seconds = 60.0f;
+  const char* outFile = NULL;
+  const char* dataDir = "../data";
+  unsigned long seed = 1;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc)       seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)  outFile = argv[++i];
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc)  dataDir = argv[++i];
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)  seed = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "-q"))                  quiet = true;
+    else { usage(argv[0]); return 1; }
+  }
+
+  LittleFS.setRoot(dataDir);
+  I2S.setOutputFile(outFile);
+  randomSeed(seed);
+  myRandomState = (uint16_t)random(1, 0xffff);
+
+  setup();
+
+  EngineStat st_core0 = {"Core0 engines"}, st_core1 = {"Core1 engines"}, st_mixer = {"mixer+out"};
+  const uint64_t blocks = (uint64_t)(seconds * (float)SAMPLE_RATE / (float)DMA_BUF_LEN);
+  double t, t_start = now_us();
+
+  for (uint64_t b = 0; b < blocks; b++) {
+    loop();
+
+    // Core0: audio_task1 fills every free block of the ring
+    for (t = now_us(); core0_generate(); t = now_us()) st_core0.add(now_us() - t);
+
+    // Core1: audio_task2 catches up with synth2, then plays one block
+    for (t = now_us(); core1_generate(); t = now_us()) st_core1.add(now_us() - t);
+    t = now_us(); core1_mix(); st_mixer.add(now_us() - t);
+
+    host_sample_clock += DMA_BUF_LEN;
+  }
+
+  double wall_s = (now_us() - t_start) * 1e-6;
+  i2sDeinit();
+
+  if (!quiet) {
+    double audio_s = (double)host_sample_clock / (double)SAMPLE_RATE;
+    fprintf(stderr, "rendered %.2f s of audio in %.3f s (%.1fx real time) to %s\n",
+            audio_s, wall_s, audio_s / wall_s, outFile ? outFile : "null sink");
+    fprintf(stderr, "per %d-sample block (budget %u us):\n", DMA_BUF_LEN, DMA_BUF_TIME);
+    EngineStat* all[] = {&st_core0, &st_core1, &st_mixer};
+    for (EngineStat* e : all) {
+      fprintf(stderr, "  %-13s avg %8.3f us  peak %8.3f us\n", e->name, e->total_us / (double)blocks, e->peak_us);
+    }
+    uint8_t core1 = Balancer.GetCore1Engines(Audio.GetProduced(AUDIO_CORE0));
+    fprintf(stderr, "%d voices, balancer: %u switches, Core1 renders", SYNTH_VOICES, Balancer.GetSwitches());
+    for (int v = 0; v < SYNTH_VOICES; v++) if ((core1 >> v) & 1) fprintf(stderr, " synth%d", v + 1);
+    fprintf(stderr, "%s + mixer (costs follow the virtual clock, so they read 0 here)\n", ((core1 >> ENGINE_DRUMS) & 1) ? " drums" : "");
+  }
+  return 0;
+}
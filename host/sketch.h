@@ -0,0 +1,93 @@
+/*
+ * The whole AcidBox sketch as one host translation unit.
+ *
+ * The Arduino builder concatenates the .ino files (main sketch first, the rest in name order) and
+ * generates function prototypes, so we do the same here by hand. Only the prototypes that are
+ * actually needed before the definitions are listed.
+ *
+ * Each host program is a single translation unit that includes this file once, so the host globals
+ * (virtual clock, Serial, LittleFS) are defined here as well.
+ */
+#pragma once
+#ifndef HOST_SKETCH_H
+#define HOST_SKETCH_H
+
+#include "Arduino.h"
+#include "../config.h"
+#include "../synthvoice.h"   // types used by the prototypes below
+#include "../midi_queue.h"
+
+// prototypes the Arduino builder would have generated
+static inline void i2s_output();
+void i2sInit();
+void buildTables();
+inline void MidiInit();
+inline void handleNoteOn(uint8_t inChannel, uint8_t inNote, uint8_t inVelocity);
+inline void handleNoteOff(uint8_t inChannel, uint8_t inNote, uint8_t inVelocity);
+inline void handleCC(uint8_t inChannel, uint8_t cc_number, uint8_t cc_value);
+void handleProgramChange(uint8_t inChannel, uint8_t number);
+inline void handlePitchBend(uint8_t inChannel, int number);
+inline uint32_t midiTimestamp();
+inline void midiStampAt(uint32_t time);
+inline void midiStampNow();
+inline MidiQueue* midiQueue(uint8_t inChannel);
+inline void midiPush(MidiQueue* queue, uint8_t type, uint8_t data1, int16_t data2);
+inline void applySynthEvent(SynthVoice& synth, const MidiEvent& e);
+inline void applyDrumsEvent(const MidiEvent& e);
+inline void applyFxEvent(const MidiEvent& e);
+void readPots();
+void paramChange(uint8_t paramNum, float paramVal);
+void regular_checks();
+void run_tick();
+static void init_midi();
+static uint16_t myRandomAddEntropy(uint16_t data);
+static void init_button(struct Button *button, byte pin, uint8_t num);
+static void init_instruments();
+void init_patterns();
+static void do_midi_start();
+static byte flip(byte percent_chance);
+inline float fclamp(float in, float min, float max);
+inline float lookupLinear(const float (&table)[TABLE_SIZE+1], float index);
+inline float lookupCyclic(const float (&table)[TABLE_SIZE+1], float index);
+inline float lookupBilinear(const float (&table)[16][16], float x, float y);
+inline int32_t mipmapOctave(float step);
+inline const float* mipmapTable(int32_t oct);
+inline int32_t mipmapMask(int32_t oct);
+inline float lookupWave(const float* table, int32_t mask, float scale, float kSaw, float kSquare, float index);
+inline void lookupLinearBlock(const float (&table)[TABLE_SIZE+1], const float* index, float* out, int n);
+inline void lookupCyclicBlock(const float (&table)[TABLE_SIZE+1], const float* index, float* out, int n);
+inline void lookupWaveBlock(const float* table, int32_t mask, float scale, float kSaw, float kSquare, const float* index, float* out, int n);
+inline void lookupBilinearBlock(const float (&table)[16][16], const float* x, const float* y, float* out, int n);
+inline void fast_sincos(const float x, float* sinRes, float* cosRes);
+inline float knobMap(float in, float outMin, float outMax);
+inline float linToExp(float in, float inMin, float inMax, float outMin, float outMax);
+inline float dB2amp(float dB);
+inline float amp2dB(float amp);
+
+#include "../AcidBox.ino"
+#include "../AcidBanger.ino"
+#include "../compressor.ino"
+#include "../fx_filtercrusher.ino"
+#include "../general.ino"
+#include "../i2s_setup.ino"
+#include "../krajeski_flt.ino"
+#include "../midi_handler.ino"
+#include "../moogladder.ino"
+#include "../overdrive.ino"
+#include "../rosic_BiquadFilter.ino"
+#include "../rosic_OnePoleFilter.ino"
+#include "../rosic_TeeBeeFilter.ino"
+#include "../sampler.ino"
+#include "../st7701_lcd.ino"
+#include "../synthvoice.ino"
+#include "../tables.ino"
+#include "../wavefolder.ino"
+
+uint64_t host_sample_clock = 0;
+const uint32_t host_sample_rate = SAMPLE_RATE;
+uint32_t host_random_state = 0x2545F491;
+HostSerial Serial;
+HostSerial Serial2;
+fs::FS LittleFS;
+
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifndef KIT_IMAGE_H
+#define KIT_IMAGE_H
+/*
+   Packed drum kit image: all the samples of one kit in a single file, made from a kit folder with the
+   host tool acidbox_kitpack (host/kitpack.cpp). The sampler looks for /kits/<program>.kit on LittleFS
+   (/kits/all.kit with PRELOAD_ALL) before it scans the WAV folder.
+
+     KitImageHeader
+     KitImageEntry  x count       offsets and lengths in frames from the start of the payload
+     padding                      up to dataOffset, a multiple of 16
+     payload                      dataFrames of 16 bit mono PCM, little endian
+
+   The payload is laid out exactly as Sampler keeps a kit in memory: every sample starts on a
+   KIT_IMAGE_ALIGN frame boundary and is followed by KIT_IMAGE_GUARD silent frames. So it goes from the
+   file into the cache region with one read.
+
+   A kit folder may hold a layers.txt that makes some of its samples velocity layers or round robin
+   alternatives of a note, one line per sample, # starts a comment:
+
+     <note> <velocity> <file>     e.g.  0 96 013_BD_hard.wav
+
+   note is the sample number the note plays (0 = the first sample of the kit), velocity the lowest one the
+   layer plays at, rounded down to a multiple of 8. Samples with the same note and velocity take turns, and
+   the note's own sample counts as the layer at velocity 0. The packer puts this into the index entries.
+
+   This file also holds the WAV chunk walker that both the sampler and the packer use, wav_convert.h
+   the converter behind it.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define KIT_IMAGE_MAGIC     0x54494B41UL  // "AKIT"
+#define KIT_IMAGE_VERSION   1
+#define KIT_IMAGE_ALIGN     8             // frames, samples start on 16 byte boundaries
+#define KIT_IMAGE_GUARD     16            // silent frames behind each sample, a voice pitched up may step past its end before it stops
+#define KIT_IMAGE_NAME      32
+#define KIT_LAYERS_FILE     "layers.txt"
+
+#define WAV_FORMAT_PCM        1
+#define WAV_FORMAT_FLOAT      3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+struct KitImageHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;       // number of samples
+  uint32_t dataOffset;  // bytes from the start of the file to the payload
+  uint32_t dataFrames;  // payload size in frames, guards included
+};
+
+struct KitImageEntry {
+  uint32_t start;       // frames from the start of the payload
+  uint32_t frames;      // without the guard
+  uint32_t sampleRate;
+  uint8_t layerNote;    // 0: a sample of its own, n: a layer of note n - 1
+  uint8_t layerVelocity;
+  uint16_t reserved;
+  char name[KIT_IMAGE_NAME]; // file the sample came from, for the debug output
+};
+
+struct WavInfo {
+  uint16_t format;      // WAV_FORMAT_PCM or WAV_FORMAT_FLOAT, the subformat of an extensible one
+  uint16_t channels;
+  uint16_t bits;
+  uint16_t blockAlign;  // bytes per frame
+  uint32_t sampleRate;
+  uint32_t dataBytes;
+};
+
+// one line of layers.txt, false for comments and lines that aren't one
+static inline bool ParseLayerLine( const char *line, int &note, int &velocity, char *name ) {
+  while ( *line == ' ' || *line == '\t' ) line++;
+  if ( *line == '#' ) return false;
+  return sscanf( line, "%d %d %31s", &note, &velocity, name ) == 3 && note >= 0 && velocity >= 0 && velocity < 128;
+}
+
+// whether the sample at path is the file a layers.txt line names, relative to the kit folder
+static inline bool LayerNameMatches( const char *path, const char *name ) {
+  size_t p = strlen( path ), n = strlen( name );
+  return p >= n && strcmp( path + p - n, name ) == 0 && ( p == n || path[p - n - 1] == '/' );
+}
+
+// Reads the RIFF header and walks the chunks up to "data", skipping LIST, fact, cue and whatever else a
+// tool put in front of it. On success the file is left at the first byte of the sample data.
+// F is anything with size_t read(uint8_t*, size_t): fs::File on the board, a FILE wrapper in the packer.
+template <class F>
+bool ReadWavInfo(F &f, WavInfo &info) {
+  uint8_t h[16];
+  bool fmt = false;
+  if (f.read(h, 12) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+  while (f.read(h, 8) == 8) {
+    uint32_t len = h[4] | (h[5] << 8) | (h[6] << 16) | ((uint32_t)h[7] << 24);
+    if (memcmp(h, "data", 4) == 0) {
+      info.dataBytes = len;
+      return fmt;
+    }
+    if (memcmp(h, "fmt ", 4) == 0 && len >= 16) {
+      if (f.read(h, 16) != 16) return false;
+      info.format     = h[0] | (h[1] << 8);
+      info.channels   = h[2] | (h[3] << 8);
+      info.sampleRate = h[4] | (h[5] << 8) | (h[6] << 16) | ((uint32_t)h[7] << 24);
+      info.blockAlign = h[12] | (h[13] << 8);
+      info.bits       = h[14] | (h[15] << 8);
+      fmt = true;
+      len -= 16;
+      if (info.format == WAV_FORMAT_EXTENSIBLE && len >= 10) {
+        // cbSize, valid bits, channel mask, then the subformat GUID, which starts with the format code
+        if (f.read(h, 10) != 10) return false;
+        info.format = h[8] | (h[9] << 8);
+        len -= 10;
+      }
+    }
+    len += len & 1; // chunks are padded to an even size
+    while (len > 0) {
+      size_t n = len < sizeof(h) ? len : sizeof(h);
+      if (f.read(h, n) != n) return false;
+      len -= n;
+    }
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Measured-cost load balancer: which core renders which engine.
+ *
+ * The 303 voices and the drums may be rendered by either core. The mixer always stays on Core1, next to the I2S
+ * output. Whoever renders an engine reports its cost per block, and the balancer keeps a moving average of it.
+ * Once per bar Core0 calls Plan(). It tries every split of the engines over the two cores and keeps the one with
+ * the shortest critical path (the busier core), if that beats the current split by BALANCER_HYSTERESIS.
+ * The new split starts AUDIO_STAGES+1 blocks later, out of reach of both producers. At that block each core
+ * waits until the other one has finished the block before (MayStart()). So an engine that changes cores
+ * never renders two blocks at once, nor out of order, and its MIDI queue keeps one reader at a time.
+ */
+#ifndef LOAD_BALANCER_H
+#define LOAD_BALANCER_H
+
+#include <atomic>
+
+// engines 0 .. SYNTH_VOICES-1 are the voices of the bank
+enum eEngine_t {ENGINE_DRUMS = SYNTH_VOICES, ENGINES};
+
+class LoadBalancer {
+  public:
+    LoadBalancer() {}
+
+    // core1Engines: bit e set = engine e renders on Core1
+    void Init(uint8_t core1Engines) {
+      _before = _after = core1Engines;
+      _switchBlock = 0;
+      _nextBar = 0;
+      _switches = 0;
+      for (int i = 0; i < ENGINES; i++) _cost[i] = 0.0f;
+      _mixerCost = 0.0f;
+    }
+
+    // per-block costs in microseconds, by whichever core did the work
+    inline void AddCost(uint8_t engine, uint32_t us) { _cost[engine] += ((float)us - _cost[engine]) * BALANCER_SMOOTH; }
+    inline void AddMixerCost(uint32_t us) { _mixerCost += ((float)us - _mixerCost) * BALANCER_SMOOTH; }
+
+    // the engines Core1 renders in the block, the rest is Core0's
+    inline uint8_t GetCore1Engines(uint32_t block) {
+      uint32_t seq, sw;
+      uint8_t before, after;
+      do {
+        seq = _seq;
+        sw = _switchBlock;
+        before = _before;
+        after = _after;
+      } while ((seq & 1) || seq != _seq);
+      return ((int32_t)(block - sw) >= 0) ? after : before;
+    }
+
+    // false while the other core has not finished the block before a switch, retry later
+    inline bool MayStart(uint32_t block, uint32_t otherProduced) {
+      return block != _switchBlock || (int32_t)(otherProduced - block) >= 0;
+    }
+
+    // Core0, before it renders the block: at a bar boundary picks the split for the next bar, true if it changes
+    bool Plan(uint32_t block, uint32_t clock) {
+      if ((int32_t)(clock - _nextBar) < 0) return false;
+      _nextBar = clock + (uint32_t)(4.0f * 60.0f * (float)SAMPLE_RATE / bpm);
+#ifdef LOAD_BALANCER
+      uint8_t current = GetCore1Engines(block);
+      uint8_t best = current;
+      float bestPath = CriticalPath(current);
+      for (int split = 0; split < (1 << ENGINES); split++) {
+        float path = CriticalPath((uint8_t)split);
+        if (path < bestPath) {
+          best = (uint8_t)split;
+          bestPath = path;
+        }
+      }
+      if (best != current && bestPath < CriticalPath(current) * BALANCER_HYSTERESIS
+          && (int32_t)(block - _switchBlock) > 2 * (AUDIO_STAGES + 1)) {   // the last switch is long done by both cores
+        _seq = _seq + 1;
+        _before = current;
+        _after = best;
+        _switchBlock = block + AUDIO_STAGES + 1;
+        _seq = _seq + 1;
+        _switches++;
+#ifdef DEBUG_BALANCER
+        Report();
+#endif
+        return true;
+      }
+#endif
+      return false;
+    }
+
+    // the busier core's load per block for a split, microseconds
+    float CriticalPath(uint8_t core1Engines) {
+      float core0 = 0.0f, core1 = _mixerCost;
+      for (int i = 0; i < ENGINES; i++) {
+        if ((core1Engines >> i) & 1) core1 += _cost[i];
+        else core0 += _cost[i];
+      }
+      return (core0 > core1) ? core0 : core1;
+    }
+
+    void Report() {
+      DEBF("balancer:");
+      for (int i = 0; i < SYNTH_VOICES; i++) DEBF(" synth%d=%0.0fus%s", i + 1, _cost[i], ((_after >> i) & 1) ? "(Core1)" : "");
+      DEBF(" drums=%0.0fus%s mixer=%0.0fus, from block %u, critical path %0.0fus of %uus, %u switches\r\n",
+           _cost[ENGINE_DRUMS], ((_after >> ENGINE_DRUMS) & 1) ? "(Core1)" : "", _mixerCost, _switchBlock.load(),
+           CriticalPath(_after), DMA_BUF_TIME, _switches);
+    }
+
+    float GetCost(uint8_t engine) { return _cost[engine]; }
+    float GetMixerCost() { return _mixerCost; }
+    uint32_t GetSwitches() { return _switches; }
+
+  private:
+    float _cost[ENGINES] = {0.0f};
+    float _mixerCost = 0.0f;
+    // the plan: Core1 renders _before until _switchBlock, _after from then on, written by Core0 under _seq
+    std::atomic<uint32_t> _seq{0};
+    std::atomic<uint32_t> _switchBlock{0};
+    std::atomic<uint8_t> _before{0};
+    std::atomic<uint8_t> _after{0};
+    uint32_t _nextBar = 0;     // Core0 only
+    uint32_t _switches = 0;    // Core0 only
+};
+
+#endif
@@ -48,6 +48,13 @@
 #define CC_808_OH_TUNE      80
 #define CC_808_OH_DECAY     81
 #define CC_808_OH_LEVEL     82
+#define CC_808_INTERPOLATION 83 // playback interpolation of the kit: 0 none, 32 linear, 64 Hermite, 96 windowed sinc
+#define CC_808_NOTE_CHOKE   78  // choke group of the selected note, value / 16: 0 none, 1 .. 7 hits fade out the others in the group
+#define CC_808_NOTE_BUS     77  // drum bus of the selected note, value / 32: kick, snare, hats, perc
+#define CC_808_BUS_PAN      79  // the following set the bus of the selected note
+#define CC_808_BUS_DELAY    102 // times CC_808_DELAY_SEND
+#define CC_808_BUS_REVERB   103 // times CC_808_REVERB_SEND
+#define CC_808_BUS_SIDECHAIN 105 // how much the bus drives the compressor
 
 // Global 
 #define CC_ANY_COMPRESSOR   93
@@ -107,6 +114,13 @@
 #define CC_808_OH_TUNE      80
 #define CC_808_OH_DECAY     81
 #define CC_808_OH_LEVEL     82
+#define CC_808_INTERPOLATION 83 // playback interpolation of the kit: 0 none, 32 linear, 64 Hermite, 96 windowed sinc
+#define CC_808_NOTE_CHOKE   78  // choke group of the selected note, value / 16: 0 none, 1 .. 7 hits fade out the others in the group
+#define CC_808_NOTE_BUS     77  // drum bus of the selected note, value / 32: kick, snare, hats, perc
+#define CC_808_BUS_PAN      79  // the following set the bus of the selected note
+#define CC_808_BUS_DELAY    102 // times CC_808_DELAY_SEND
+#define CC_808_BUS_REVERB   103 // times CC_808_REVERB_SEND
+#define CC_808_BUS_SIDECHAIN 105 // how much the bus drives the compressor
 
 
 #define CC_ANY_COMPRESSOR   93
@@ -29,37 +29,71 @@ inline void MidiInit() {
 }
 
 
+// Sample clock "now" as seen from loop(), plus one DMA buffer, so the event lands in the next block to be generated
+// at the same offset it arrived within the current one: event spacing is kept to the sample, whenever loop() runs.
+inline uint32_t midiTimestamp() {
+  uint32_t seq, clk, us;
+  do {
+    seq = gen_clock_seq;
+    clk = gen_clock;
+    us = gen_clock_us;
+  } while ((seq & 1) || seq != gen_clock_seq);
+  uint32_t elapsed = (uint32_t)(((uint64_t)(uint32_t)(micros() - us) * SAMPLE_RATE + 500000ULL) / 1000000ULL);
+  return clk + elapsed + DMA_BUF_LEN;
+}
+
+// The JUKEBOX plays ahead of time: events pushed between midiStampAt() and midiStampNow() carry the given sample time.
+// Only loop() pushes events, so plain statics will do.
+static uint32_t midi_stamp = 0;
+static bool midi_stamp_fixed = false;
+
+inline void midiStampAt(uint32_t time) {
+  midi_stamp = time;
+  midi_stamp_fixed = true;
+}
+
+inline void midiStampNow() {
+  midi_stamp_fixed = false;
+}
+
+inline MidiQueue* midiQueue(uint8_t inChannel) {
+  if (inChannel == DRUM_MIDI_CHAN )         return &DrumsEvents;
+  int v = VoiceBank::GetVoice(inChannel);
+  if (v >= 0)                               return &Synths.Events(v);
+  return NULL;
+}
+
+inline void midiPush(MidiQueue* queue, uint8_t type, uint8_t data1, int16_t data2) {
+  if (queue == NULL) return;
+  MidiEvent e = {midi_stamp_fixed ? midi_stamp : midiTimestamp(), type, data1, data2};
+  if (!queue->Push(e)) {
+    DEBF("MIDI queue full, event %d dropped\r\n", type);
+  }
+}
+
 inline void handleNoteOn(uint8_t inChannel, uint8_t inNote, uint8_t inVelocity) {
 #ifdef DEBUG_MIDI
   DEB("MIDI note on ");
   DEBUG(inNote);
 #endif
-  if (inChannel == DRUM_MIDI_CHAN )         {Drums.NoteOn(inNote, inVelocity);}
-  else if (inChannel == SYNTH1_MIDI_CHAN )  {Synth1.on_midi_noteON(inNote, inVelocity);}
-  else if (inChannel == SYNTH2_MIDI_CHAN )  {Synth2.on_midi_noteON(inNote, inVelocity);}
+  midiPush(midiQueue(inChannel), MIDI_EVENT_NOTE_ON, inNote, inVelocity);
 }
 
 inline void handleNoteOff(uint8_t inChannel, uint8_t inNote, uint8_t inVelocity) {
-  if (inChannel == DRUM_MIDI_CHAN )         {Drums.NoteOff(inNote);}
-  else if (inChannel == SYNTH1_MIDI_CHAN )  {Synth1.on_midi_noteOFF(inNote, inVelocity);}
-  else if (inChannel == SYNTH2_MIDI_CHAN )  {Synth2.on_midi_noteOFF(inNote, inVelocity);}
-
+  midiPush(midiQueue(inChannel), MIDI_EVENT_NOTE_OFF, inNote, inVelocity);
 }
 
 inline void handleCC(uint8_t inChannel, uint8_t cc_number, uint8_t cc_value) {
   switch (cc_number) { // global parameters yet set via ANY channel CCs
     case CC_ANY_COMPRESSOR:
-      Comp.SetRatio(3.0f + cc_value * 0.307081f);
-      DEBF("Set Comp Ratio %d\r\n", cc_value);
-      break;
     case CC_ANY_DELAY_TIME:
-      Delay.SetLength(cc_value * MIDI_NORM);
-      break;
     case CC_ANY_DELAY_FB:
-      Delay.SetFeedback(cc_value * MIDI_NORM);
-      break;
     case CC_ANY_DELAY_LVL:
-      Delay.SetLevel(cc_value * MIDI_NORM);
+#ifndef NO_PSRAM
+    case CC_ANY_REVERB_TIME:
+    case CC_ANY_REVERB_LVL:
+#endif
+      midiPush(&FxEvents, MIDI_EVENT_CC, cc_number, cc_value);
       break;
     case CC_ANY_RESET_CCS:
     case CC_ANY_NOTES_OFF:
@@ -68,32 +102,68 @@ inline void handleCC(uint8_t inChannel, uint8_t cc_number, uint8_t cc_value) {
 #ifdef JUKEBOX
           do_midi_stop();
 #endif
-          Synth1.allNotesOff();
-          Synth2.allNotesOff();
+          for (int v = 0; v < SYNTH_VOICES; v++) midiPush(&Synths.Events(v), MIDI_EVENT_NOTES_OFF, 0, 0);
           last_reset = millis();
         }
       break;
-#ifndef NO_PSRAM
-    case CC_ANY_REVERB_TIME:
-      Reverb.SetTime(cc_value * MIDI_NORM);
-      break;
-    case CC_ANY_REVERB_LVL:
-      Reverb.SetLevel(cc_value * MIDI_NORM);
-      break;
-#endif
     default:
-      if (inChannel == DRUM_MIDI_CHAN )         {Drums.ParseCC(cc_number, cc_value);}
-      else if (inChannel == SYNTH1_MIDI_CHAN )  {Synth1.ParseCC(cc_number, cc_value);}
-      else if (inChannel == SYNTH2_MIDI_CHAN )  {Synth2.ParseCC(cc_number, cc_value);}
+      midiPush(midiQueue(inChannel), MIDI_EVENT_CC, cc_number, cc_value);
   }
 }
 
 void handleProgramChange(uint8_t inChannel, uint8_t number) {
+  // the sampler loads the kit in a background task and swaps it in between two blocks
   if (inChannel == DRUM_MIDI_CHAN) {     Drums.SetProgram(number);  }
 }
 
 inline void handlePitchBend(uint8_t inChannel, int number) {
-  if (inChannel == DRUM_MIDI_CHAN )         {Drums.PitchBend(number);}
-  else if (inChannel == SYNTH1_MIDI_CHAN )  {Synth1.PitchBend(number);}
-  else if (inChannel == SYNTH2_MIDI_CHAN )  {Synth2.PitchBend(number);}
+  midiPush(midiQueue(inChannel), MIDI_EVENT_PITCHBEND, 0, number);
+}
+
+// Consumer side: the audio tasks apply the events to the engines they render
+
+inline void applySynthEvent(SynthVoice& synth, const MidiEvent& e) {
+  switch (e.type) {
+    case MIDI_EVENT_NOTE_ON:    synth.on_midi_noteON(e.data1, e.data2);   break;
+    case MIDI_EVENT_NOTE_OFF:   synth.on_midi_noteOFF(e.data1, e.data2);  break;
+    case MIDI_EVENT_CC:         synth.ParseCC(e.data1, e.data2);          break;
+    case MIDI_EVENT_PITCHBEND:  synth.PitchBend(e.data2);                 break;
+    case MIDI_EVENT_NOTES_OFF:  synth.allNotesOff();                      break;
+  }
+}
+
+inline void applyDrumsEvent(const MidiEvent& e) {
+  switch (e.type) {
+    case MIDI_EVENT_NOTE_ON:    Drums.NoteOn(e.data1, e.data2);   break;
+    case MIDI_EVENT_NOTE_OFF:   Drums.NoteOff(e.data1);           break;
+    case MIDI_EVENT_CC:         Drums.ParseCC(e.data1, e.data2);  break;
+    case MIDI_EVENT_PITCHBEND:  Drums.PitchBend(e.data2);         break;
+  }
+}
+
+inline void applyFxEvent(const MidiEvent& e) {
+  uint8_t cc_value = e.data2;
+  switch (e.data1) {
+    case CC_ANY_COMPRESSOR:
+      Comp.SetRatio(3.0f + cc_value * 0.307081f);
+      DEBF("Set Comp Ratio %d\r\n", cc_value);
+      break;
+    case CC_ANY_DELAY_TIME:
+      Delay.SetLength(cc_value * MIDI_NORM);
+      break;
+    case CC_ANY_DELAY_FB:
+      Delay.SetFeedback(cc_value * MIDI_NORM);
+      break;
+    case CC_ANY_DELAY_LVL:
+      Delay.SetLevel(cc_value * MIDI_NORM);
+      break;
+#ifndef NO_PSRAM
+    case CC_ANY_REVERB_TIME:
+      Reverb.SetTime(cc_value * MIDI_NORM);
+      break;
+    case CC_ANY_REVERB_LVL:
+      Reverb.SetLevel(cc_value * MIDI_NORM);
+      break;
+#endif
+  }
 }
@@ -0,0 +1,63 @@
+/*
+ * Lock-free single-producer / single-consumer MIDI event queue.
+ *
+ * loop() parses MIDI (and runs the JUKEBOX) on Core1, the engines are rendered by the audio tasks.
+ * Instead of writing into the engines directly, the MIDI handlers push events stamped with the sample
+ * clock (see midiTimestamp()) into one queue per engine, and the engine's generator pops them at block
+ * start and applies each one at its exact sample offset. One queue has exactly one writer and one reader,
+ * so no locks are needed: head is only written by the producer, tail only by the consumer.
+ */
+#ifndef MIDI_QUEUE_H
+#define MIDI_QUEUE_H
+
+#include <atomic>
+
+enum eMidiEvent_t {MIDI_EVENT_NOTE_ON, MIDI_EVENT_NOTE_OFF, MIDI_EVENT_CC, MIDI_EVENT_PITCHBEND, MIDI_EVENT_NOTES_OFF};
+
+struct MidiEvent {
+  uint32_t time;    // sample clock of the event, see midiTimestamp()
+  uint8_t  type;    // eMidiEvent_t
+  uint8_t  data1;   // note or CC number
+  int16_t  data2;   // velocity, CC value or pitch bend
+};
+
+class MidiQueue {
+  public:
+    MidiQueue() {}
+
+    // producer side: false if the queue is full, the event is dropped then
+    inline bool Push(MidiEvent e) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      if (head - _tail.load(std::memory_order_acquire) >= MIDI_QUEUE_SIZE) {
+        _dropped++;
+        return false;
+      }
+      if ((int32_t)(e.time - _lastTime) < 0) e.time = _lastTime; // keep the queue sorted, whatever the clock estimate did
+      _lastTime = e.time;
+      _buf[head & (MIDI_QUEUE_SIZE - 1)] = e;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer side: takes the oldest event if it is due before sample clock "until"
+    inline bool PopDue(uint32_t until, MidiEvent& e) {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail == _head.load(std::memory_order_acquire)) return false;
+      const MidiEvent& next = _buf[tail & (MIDI_QUEUE_SIZE - 1)];
+      if ((int32_t)(next.time - until) >= 0) return false;
+      e = next;
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    uint32_t GetDropped() { return _dropped; }
+
+  private:
+    MidiEvent _buf[MIDI_QUEUE_SIZE];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    uint32_t _lastTime = 0;     // producer only
+    uint32_t _dropped = 0;      // producer only
+};
+
+#endif
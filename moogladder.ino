@@ -13,7 +13,7 @@ inline float MoogLadder::my_tanh(float x)
       return sign;
     }
     if (x<=0.4f) return float(x*sign) * 0.9498724f; // smooth region borders    
-    return  sign * lookupTable(shaper_tbl,(x*SHAPER_LOOKUP_COEF)); // lookup table, 5 is max argument value 
+    return  sign * lookupLinear(shaper_tbl,(x*SHAPER_LOOKUP_COEF)); // lookup table, 5 is max argument value 
  //  poly = (2.12-2.88*x+4.0*x*x);
  //  return sign * x * (poly / (poly * x + 1.0f)); // very good approximation found here https://www.musicdsp.org/en/latest/Other/178-reasonably-accurate-fastish-tanh-approximation.html
                                                     // but it uses float division which is not that fast on esp32
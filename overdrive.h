@@ -11,6 +11,8 @@ class Overdrive
     float Process(float in);
     void SetDrive(float drive);
 
+    friend class SynthKernel;  // reads the gains
+
   private:
     float _drive;
     float _pre_gain;
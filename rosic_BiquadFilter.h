@@ -73,6 +73,9 @@ float getBandwidth() const { return bandwidth; }
 /** Calculates a single filtered output-sample. */
 inline float getSample(float in);
 
+/** Filters a block of samples in place, keeping the state in registers for the whole loop. */
+inline void processBlock(float *buf, int length);
+
 //---------------------------------------------------------------------------------------------
 // others:
 
@@ -81,6 +84,8 @@ void reset();
 
 //=============================================================================================
 
+friend class SynthKernel;  // borrows coefficients and state for its multi-voice loops
+
 protected:
 
 // internal functions:
@@ -112,5 +117,23 @@ y1 = y;
 return y;
 }
 
+inline void BiquadFilter::processBlock(float *buf, int length)
+{
+float lx1 = x1, lx2 = x2, ly1 = y1, ly2 = y2;
+for (int n = 0; n < length; n++) {
+  float in = buf[n];
+  float y = b0*in + b1*lx1 + b2*lx2 + a1*ly1 + a2*ly2 + TINY;
+  lx2 = lx1;
+  lx1 = in;
+  ly2 = ly1;
+  ly1 = y;
+  buf[n] = y;
+}
+x1 = lx1;
+x2 = lx2;
+y1 = ly1;
+y2 = ly2;
+}
+
 
 #endif // rosic_BiquadFilter_h
@@ -73,6 +73,9 @@ class OnePoleFilter
     /** Calculates a single filtered output-sample. */
     inline float getSample(float in);
 
+    /** Filters a block of samples in place, keeping the state in registers for the whole loop. */
+    inline void processBlock(float *buf, int length);
+
     //---------------------------------------------------------------------------------------------
     // others:
 
@@ -81,6 +84,8 @@ class OnePoleFilter
 
     //=============================================================================================
 
+    friend class SynthKernel;  // filters several voices in lockstep, with x1, y1 held in its lanes during a block
+
   protected:
 
     // buffering:
@@ -117,4 +122,17 @@ inline float OnePoleFilter::getSample(float in)
 
   return y1;
 }
+
+inline void OnePoleFilter::processBlock(float *buf, int length)
+{
+  float lx1 = x1, ly1 = y1;
+  for (int n = 0; n < length; n++) {
+    float in = buf[n];
+    ly1 = (float)b0 * in + b1 * lx1 + a1 * ly1 + (float)1.1e-38;
+    lx1 = in;
+    buf[n] = ly1;
+  }
+  x1 = lx1;
+  y1 = ly1;
+}
 #endif
@@ -4,6 +4,10 @@
 #define SQRT2 1.4142135623730950488016887242097f
 #define ONE_DIV_SQRT2 0.70710678118654752440084436210485f
 
+#ifdef FILTER_COEF_LATTICE
+#define FILTER_LATTICE_CUTOFFS (7 * FILTER_LATTICE_OCTAVE_STEPS + 1) // 128 Hz .. 16384 Hz
+#endif
+
 #include "rosic_OnePoleFilter.h"
 
 /**
@@ -112,6 +116,14 @@ class TeeBeeFilter
     /** Calculates one output sample at a time. */
     inline float Process(float in);
 
+    /** Filters a block in place, cutoffs[] holds the cutoff frequency for every sample of the block.
+      The coefficients are updated every FILTER_CONTROL_RATE samples. */
+    inline void ProcessBlock(float* buf, const float* cutoffs, int length);
+
+    /** Same as ProcessBlock(), but the coefficients are only calculated for every RATE-th sample and
+      linearly interpolated in between. RATE = 1 is the exact per-sample path. */
+    template <int RATE> inline void ProcessBlockDecimated(float* buf, const float* cutoffs, int length);
+
     //---------------------------------------------------------------------------------------------
     // others:
 
@@ -123,6 +135,27 @@ class TeeBeeFilter
       for normalized radian cutoff frequencies up to pi/4. */
     inline void calculateCoefficientsApprox4();
 
+    /** Re-calculates the coefficients the configured way: lattice lookup in TB_303 mode when
+      FILTER_COEF_LATTICE is defined, calculateCoefficientsApprox4() otherwise. */
+    inline void calculateCoefficients();
+
+    /** The TB_303 mode fits for b0, k and g, wc is the normalized radian cutoff frequency and r the
+      skewed resonance. */
+    static inline void tb303Coefficients(float wc, float r, float* b0, float* k, float* g);
+
+#ifdef FILTER_COEF_LATTICE
+    /** Takes b0, k and g from the precomputed cutoff x resonance lattice (TB_303 mode), bilinear
+      interpolation between the nodes, no branches. */
+    inline void calculateCoefficientsLattice();
+
+    /** Fills the lattice for the current sample rate, unless it has been built for it already. */
+    void buildLattice();
+
+    /** Measures the lattice against tb303Coefficients() halfway between the nodes, where the error
+      peaks. Writes the worst relative errors and returns the lattice size in bytes. */
+    static size_t latticeReport(float* b0Err, float* kErr, float* gErr);
+#endif
+
     /** Calculates sine and cosine of x - this is more efficient than calling sin(x) and
       cos(x) seperately. */
     inline void sinCos(float x, float* sinResult, float* cosResult);
@@ -141,6 +174,8 @@ class TeeBeeFilter
     void Init(float sr);
     //=============================================================================================
 
+    friend class SynthKernel;  // lets SetCutoff() compute b0, k and g, runs the TB_303 ladder itself
+
   protected:
 
     float b0, a1;              // coefficients for the first order sections
@@ -162,6 +197,15 @@ class TeeBeeFilter
 
     OnePoleFilter feedbackHighpass;
 
+#ifdef FILTER_COEF_LATTICE
+    struct LatticeNode { float b0, k, g; };
+    // rows are resonance, columns are log spaced cutoffs, the extra row and column are guards
+    static LatticeNode lattice[FILTER_LATTICE_RESOS + 1][FILTER_LATTICE_CUTOFFS + 1];
+    static float    latticeRate;      // sample rate the lattice was built for
+    int   latticeRow;                 // resonance row, set by SetResonance()
+    float latticeRowFrac;
+#endif
+
 };
 
 
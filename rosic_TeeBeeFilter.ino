@@ -13,6 +13,10 @@ TeeBeeFilter::TeeBeeFilter()
   g                   =     1.0f;
   sampleRate          = SAMPLE_RATE;
   twoPiOverSampleRate = 2.0f*PI/sampleRate;
+#ifdef FILTER_COEF_LATTICE
+  latticeRow          = 0;
+  latticeRowFrac      = 0.0f;
+#endif
 
   feedbackHighpass.setMode(OnePoleFilter::HIGHPASS);
   feedbackHighpass.setCutoff(100.0f);
@@ -38,6 +42,9 @@ void TeeBeeFilter::SetSampleRate(float newSampleRate)
   twoPiOverSampleRate = 2.0*PI/sampleRate;
   highLimit = sampleRate / 4.18f;
   feedbackHighpass.setSampleRate(newSampleRate);
+#ifdef FILTER_COEF_LATTICE
+  buildLattice();
+#endif
   calculateCoefficientsExact();
 }
 
@@ -67,9 +74,82 @@ void TeeBeeFilter::SetMode(int newMode)
     default:        c0 =  1.0f; c1 =  0.0f; c2 =  0.0f; c3 =  0.0f; c4 =  0.0f;  // flat
     }
   }
-  calculateCoefficientsApprox4();
+  calculateCoefficients();
 }
 
+#ifdef FILTER_COEF_LATTICE
+TeeBeeFilter::LatticeNode TeeBeeFilter::lattice[FILTER_LATTICE_RESOS + 1][FILTER_LATTICE_CUTOFFS + 1];
+float TeeBeeFilter::latticeRate = 0.0f;
+
+// The cutoff axis is spaced by the float's bit pattern, i.e. exponent plus mantissa, which is a piecewise
+// linear log2(). So the column index is one integer subtraction and one multiplication away from the cutoff.
+// The nodes sit on every power of 2, so no cell straddles the kinks of that piecewise linear log2().
+static inline uint32_t latticeFloatBits(float x) { union { float f; uint32_t u; } v; v.f = x; return v.u; }
+static inline float latticeBitsFloat(uint32_t x) { union { float f; uint32_t u; } v; v.u = x; return v.f; }
+#define LATTICE_BITS_MIN   0x43000000UL                                  // 128.0f
+#define LATTICE_BITS_STEP  (0x800000UL / FILTER_LATTICE_OCTAVE_STEPS)    // one octave is 2^23
+const float LATTICE_SCALE = 1.0f / (float)LATTICE_BITS_STEP;
+
+void TeeBeeFilter::buildLattice()
+{
+  if ( latticeRate == sampleRate )
+    return;
+  latticeRate = sampleRate;
+
+  for (int i = 0; i <= FILTER_LATTICE_RESOS; i++) {
+    int ri = (i < FILTER_LATTICE_RESOS) ? i : FILTER_LATTICE_RESOS - 1;
+    float r = 1.02f * (float)ri / (float)(FILTER_LATTICE_RESOS - 1); // resonanceSkewed tops at 1.02
+    for (int j = 0; j <= FILTER_LATTICE_CUTOFFS; j++) {
+      int cj = (j < FILTER_LATTICE_CUTOFFS) ? j : FILTER_LATTICE_CUTOFFS - 1;
+      float fc = latticeBitsFloat(LATTICE_BITS_MIN + (uint32_t)cj * LATTICE_BITS_STEP);
+      LatticeNode& node = lattice[i][j];
+      tb303Coefficients(twoPiOverSampleRate * fc, r, &node.b0, &node.k, &node.g);
+    }
+  }
+
+#ifdef DEBUG_ON
+  float b0Err, kErr, gErr;
+  size_t bytes = latticeReport(&b0Err, &kErr, &gErr);
+  DEBF("TeeBeeFilter lattice %dx%d: %d bytes, worst rel. error b0 %.2e k %.2e g %.2e\r\n", FILTER_LATTICE_CUTOFFS, FILTER_LATTICE_RESOS, (int)bytes, b0Err, kErr, gErr);
+#endif
+}
+
+size_t TeeBeeFilter::latticeReport(float* b0Err, float* kErr, float* gErr)
+{
+  const float twoPiOverRate = 2.0f * PI / latticeRate;
+  const float topCutoff = latticeRate / 4.18f; // nodes outside 200 Hz .. highLimit are never looked up
+  *b0Err = *kErr = *gErr = 0.0f;
+  for (int i = 0; i < 2 * FILTER_LATTICE_RESOS - 1; i++) {
+    float rPos  = 0.5f * (float)i;                               // every node and every midpoint
+    int   row   = (int)rPos;
+    float rFrac = rPos - (float)row;
+    float r     = 1.02f * rPos / (float)(FILTER_LATTICE_RESOS - 1);
+    for (int j = 0; j < 2 * FILTER_LATTICE_CUTOFFS - 1; j++) {
+      float cPos  = 0.5f * (float)j;
+      int   col   = (int)cPos;
+      float cFrac = cPos - (float)col;
+      float fc = latticeBitsFloat(LATTICE_BITS_MIN + (uint32_t)(cPos * (float)LATTICE_BITS_STEP));
+      if ( fc < 200.0f || fc > topCutoff )
+        continue;
+      float b0, k, g;
+      tb303Coefficients(twoPiOverRate * fc, r, &b0, &k, &g);
+      const LatticeNode& n00 = lattice[row][col];
+      const LatticeNode& n01 = lattice[row][col + 1];
+      const LatticeNode& n10 = lattice[row + 1][col];
+      const LatticeNode& n11 = lattice[row + 1][col + 1];
+      float lb0 = (1.0f - rFrac) * (n00.b0 + cFrac * (n01.b0 - n00.b0)) + rFrac * (n10.b0 + cFrac * (n11.b0 - n10.b0));
+      float lk  = (1.0f - rFrac) * (n00.k  + cFrac * (n01.k  - n00.k )) + rFrac * (n10.k  + cFrac * (n11.k  - n10.k ));
+      float lg  = (1.0f - rFrac) * (n00.g  + cFrac * (n01.g  - n00.g )) + rFrac * (n10.g  + cFrac * (n11.g  - n10.g ));
+      *b0Err = fmax(*b0Err, fabs(lb0 - b0) / fmax(fabs(b0), 1e-6f));
+      if ( k != 0.0f )
+        *kErr = fmax(*kErr, fabs(lk - k) / fabs(k));
+      *gErr  = fmax(*gErr,  fabs(lg - g)  / fmax(fabs(g),  1e-6f));
+    }
+  }
+  return sizeof(lattice);
+}
+#endif
+
 
 
 //-------------------------------------------------------------------------------------------------
@@ -91,7 +171,7 @@ inline void TeeBeeFilter::SetCutoff(float newCutoff, bool updateCoefficients)
       cutoff = newCutoff;
 
     if ( updateCoefficients == true )
-      calculateCoefficientsApprox4();
+      calculateCoefficients();
   }
 }
 
@@ -100,8 +180,13 @@ inline void TeeBeeFilter::SetResonance(float newResonance, bool updateCoefficien
   resonanceRaw    =  newResonance;
 //  compens = 1.8f * (resonanceRaw + 0.25f) * one_div((resonanceRaw + 0.25f) * 0.75f + 0.113f); // gain compensation; one_div(x) = 1/x
   resonanceSkewed = 1.02f * (1.0f - exp(-3.0f * resonanceRaw)) / (1.0f - exp(-3.0f));
+#ifdef FILTER_COEF_LATTICE
+  float rPos = fclamp(resonanceSkewed * (float)(FILTER_LATTICE_RESOS - 1) * (1.0f / 1.02f), 0.0f, (float)(FILTER_LATTICE_RESOS - 1));
+  latticeRow     = (int)rPos;
+  latticeRowFrac = rPos - (float)latticeRow;
+#endif
   if ( updateCoefficients == true )
-    calculateCoefficientsApprox4();
+    calculateCoefficients();
 }
 
 
@@ -152,6 +237,12 @@ inline void TeeBeeFilter::calculateCoefficientsApprox4()
   float r   = resonanceSkewed;
   float tmp;
 
+  if ( mode == TB_303 ) // the general purpose a1, b0 and k below would be overwritten anyway
+  {
+    tb303Coefficients(wc, r, &b0, &k, &g);
+    return;
+  }
+
   // compute the filter coefficient via a 12th order polynomial approximation (polynomial
   // evaluation is done with a Horner-rule alike scheme with nested quadratic factors in the hope
   // for potentially better parallelization compared to Horner's rule as is):
@@ -193,19 +284,50 @@ inline void TeeBeeFilter::calculateCoefficientsApprox4()
   tmp  = wc2 * tmp + pr1 * wc + pr0; // this is now the scale factor
   k    = r * tmp;
   g    = 1.0f;
+}
 
+inline void TeeBeeFilter::tb303Coefficients(float wc, float r, float* b0, float* k, float* g)
+{
+  float fx = wc * ONE_DIV_SQRT2 * ONE_DIV_TWOPI;
+  float kr, gr;
+  *b0 = (0.00045522346f + 6.1922189f * fx) * one_div(1.0f + 12.358354f * fx + 4.4156345f * (fx * fx));
+  kr  = fx * (fx * (fx * (fx * (fx * (fx + 7198.6997f) - 5837.7917f) - 476.47308f) + 614.95611f) + 213.87126f) + 16.998792f;
+  gr  = kr * 0.05882352f; // 17 reciprocal
+  gr  = (gr - 1.0f) * r + 1.0f;                   // r is 0 to 1.0
+  *g  = (gr * (1.0f + r));
+  *k  = kr * r;                                   // k is ready now
+}
+
+inline void TeeBeeFilter::calculateCoefficients()
+{
+#ifdef FILTER_COEF_LATTICE
   if ( mode == TB_303 )
   {
-    float fx = wc * ONE_DIV_SQRT2 * ONE_DIV_TWOPI;
-    b0 = (0.00045522346f + 6.1922189f * fx) * one_div(1.0f + 12.358354f * fx + 4.4156345f * (fx * fx));
-    k  = fx * (fx * (fx * (fx * (fx * (fx + 7198.6997f) - 5837.7917f) - 476.47308f) + 614.95611f) + 213.87126f) + 16.998792f;
-    g  = k * 0.05882352f; // 17 reciprocal
-    g  = (g - 1.0f) * r + 1.0f;                     // r is 0 to 1.0
-    g  = (g * (1.0f + r));
-    k  = k * r;                                   // k is ready now
+    calculateCoefficientsLattice();
+    return;
   }
+#endif
+  calculateCoefficientsApprox4();
 }
 
+#ifdef FILTER_COEF_LATTICE
+inline void TeeBeeFilter::calculateCoefficientsLattice()
+{
+  float cPos = fclamp((float)(int32_t)(latticeFloatBits(cutoff) - LATTICE_BITS_MIN) * LATTICE_SCALE, 0.0f, (float)(FILTER_LATTICE_CUTOFFS - 1));
+  int   col  = (int)cPos;
+  float cFrac = cPos - (float)col;
+  float rFrac = latticeRowFrac;
+  const LatticeNode& n00 = lattice[latticeRow][col];
+  const LatticeNode& n01 = lattice[latticeRow][col + 1];
+  const LatticeNode& n10 = lattice[latticeRow + 1][col];
+  const LatticeNode& n11 = lattice[latticeRow + 1][col + 1];
+  float lo, hi;
+  lo = n00.b0 + cFrac * (n01.b0 - n00.b0);  hi = n10.b0 + cFrac * (n11.b0 - n10.b0);  b0 = lo + rFrac * (hi - lo);
+  lo = n00.k  + cFrac * (n01.k  - n00.k );  hi = n10.k  + cFrac * (n11.k  - n10.k );  k  = lo + rFrac * (hi - lo);
+  lo = n00.g  + cFrac * (n01.g  - n00.g );  hi = n10.g  + cFrac * (n11.g  - n10.g );  g  = lo + rFrac * (hi - lo);
+}
+#endif
+
 inline float TeeBeeFilter::Process(float in)
 {
   float y0;
@@ -237,6 +359,51 @@ inline float TeeBeeFilter::Process(float in)
     return 8.0f * (c0*y0 + c1*y1 + c2*y2 + c3*y3 + c4*y4);;
 }
 
+inline void TeeBeeFilter::ProcessBlock(float* buf, const float* cutoffs, int length)
+{
+  ProcessBlockDecimated<FILTER_CONTROL_RATE>(buf, cutoffs, length);
+}
+
+template <int RATE> inline void TeeBeeFilter::ProcessBlockDecimated(float* buf, const float* cutoffs, int length)
+{
+  if ( RATE <= 1 )
+  {
+    for (int n = 0; n < length; n++) {
+      SetCutoff(cutoffs[n]);
+      buf[n] = Process(buf[n]);
+    }
+    return;
+  }
+
+  int n = 0;
+  while ( n < length )
+  {
+    int len = length - n;
+    if ( len > RATE )
+      len = RATE;
+
+    // coefficients at the last control point and at the end of this segment
+    float b0s = b0, a1s = a1, ks = k, gs = g;
+    SetCutoff(cutoffs[n + len - 1]);
+    float b0e = b0, a1e = a1, ke = k, ge = g;
+
+    float step = one_div((float)len);
+    float db0 = (b0e - b0s) * step, da1 = (a1e - a1s) * step, dk = (ke - ks) * step, dg = (ge - gs) * step;
+    b0 = b0s; a1 = a1s; k = ks; g = gs;
+    for (int i = 1; i < len; i++) {
+      b0 += db0;
+      a1 += da1;
+      k  += dk;
+      g  += dg;
+      buf[n] = Process(buf[n]);
+      n++;
+    }
+    b0 = b0e; a1 = a1e; k = ke; g = ge;   // land exactly on the control point
+    buf[n] = Process(buf[n]);
+    n++;
+  }
+}
+
 inline void TeeBeeFilter::sinCos(float x, float* sinResult, float* cosResult)
 {
 #ifdef __GNUC__  // \todo assembly-version causes compiler errors on gcc
@@ -0,0 +1,100 @@
+/*
+ * Interpolation for the sampler's pitched playback, selectable per kit (SAMPLER_INTERPOLATION in config.h,
+ * CC_808_INTERPOLATION for the kit that plays now).
+ *
+ *   INTERP_NONE      the frame under the playback position, as the sampler always did
+ *   INTERP_LINEAR    2 frames
+ *   INTERP_HERMITE   4 frames, 3rd order Hermite
+ *   INTERP_SINC      8 frames under a Blackman windowed sinc, blended from the two nearest rows of a
+ *                    polyphase table that BuildSincTable() fills once from Sampler::Init()
+ *
+ * Interpolate() gets a pointer to the frame at the playback position and reads INTERP_SINC_BEFORE frames
+ * before it up to InterpAhead() frames behind it. The sample store keeps silence around each sample for that.
+ */
+#ifndef SAMPLE_INTERP_H
+#define SAMPLE_INTERP_H
+
+#include <math.h>
+
+enum eInterp_t { INTERP_NONE, INTERP_LINEAR, INTERP_HERMITE, INTERP_SINC, INTERP_MODES };
+
+#define INTERP_SINC_TAPS    8
+#define INTERP_SINC_BEFORE  3     // taps in front of the playback position
+#define INTERP_SINC_PHASES  64    // table rows per frame, the taps in between are blended linearly
+#define INTERP_SINC_CUTOFF  0.9f  // of Nyquist
+
+static float sinc_table[INTERP_SINC_PHASES + 1][INTERP_SINC_TAPS];
+
+// frames after the one at the playback position that a mode reads
+static constexpr int InterpAhead( int mode ) {
+  return mode == INTERP_SINC ? INTERP_SINC_TAPS - INTERP_SINC_BEFORE - 1 : mode == INTERP_HERMITE ? 2 : mode == INTERP_LINEAR ? 1 : 0;
+}
+
+// Each row is the windowed sinc scaled to unity gain at DC, plus the smallest change shaped by the window that puts
+// its centre of mass on the playback position. Without that the delay is off a little at low pitches, which puts
+// its error there above Hermite's.
+static void BuildSincTable() {
+  for ( int p = 0; p <= INTERP_SINC_PHASES; p++ ) {
+    float frac = (float)p / INTERP_SINC_PHASES;
+    float window[INTERP_SINC_TAPS], x[INTERP_SINC_TAPS];
+    float sum = 0.0f, moment = 0.0f, sw = 0.0f, swx = 0.0f, swxx = 0.0f;
+    for ( int t = 0; t < INTERP_SINC_TAPS; t++ ) {
+      x[t] = t - INTERP_SINC_BEFORE - frac;                             // distance of the tap from the position
+      float w = x[t] * PI / ( 0.5f * INTERP_SINC_TAPS );                  // -PI .. PI over the taps
+      window[t] = ( fabsf(x[t]) < 0.5f * INTERP_SINC_TAPS ) ? 0.42f + 0.5f * cosf(w) + 0.08f * cosf(2.0f * w) : 0.0f;
+      float a = PI * INTERP_SINC_CUTOFF * x[t];
+      sinc_table[p][t] = window[t] * ( ( fabsf(a) < 1e-6f ) ? 1.0f : sinf(a) / a );
+      sum += sinc_table[p][t];
+      sw += window[t];
+      swx += window[t] * x[t];
+      swxx += window[t] * x[t] * x[t];
+    }
+    for ( int t = 0; t < INTERP_SINC_TAPS; t++ ) {
+      sinc_table[p][t] /= sum;                                          // unity gain at DC for every phase
+      moment += sinc_table[p][t] * x[t];
+    }
+    // h += window * (l0 + l1 * x) with sum(h) still 1 and sum(h * x) = 0
+    float det = sw * swxx - swx * swx;
+    float l0 = moment * swx / det;
+    float l1 = -moment * sw / det;
+    for ( int t = 0; t < INTERP_SINC_TAPS; t++ ) sinc_table[p][t] += window[t] * ( l0 + l1 * x[t] );
+  }
+}
+
+// the sample value at fraction frac behind the frame d points at
+template <int MODE, class T>
+static inline float Interpolate( const T* d, float frac ) {
+  if ( MODE == INTERP_LINEAR ) {
+    return (float)d[0] + frac * (float)( d[1] - d[0] );
+  } else if ( MODE == INTERP_HERMITE ) {
+    float xm1 = d[-1], x0 = d[0], x1 = d[1], x2 = d[2];
+    float c1 = 0.5f * ( x1 - xm1 );
+    float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+    float c3 = 0.5f * ( x2 - xm1 ) + 1.5f * ( x0 - x1 );
+    return ( ( c3 * frac + c2 ) * frac + c1 ) * frac + x0;
+  } else if ( MODE == INTERP_SINC ) {
+    float phase = frac * INTERP_SINC_PHASES;
+    int p = (int)phase;                                                 // frac < 1, so p + 1 is the last row at most
+    float w = phase - p;
+    const float* h0 = sinc_table[ p ];
+    const float* h1 = sinc_table[ p + 1 ];
+    const T* x = d - INTERP_SINC_BEFORE;
+    float acc = 0.0f;
+    for ( int t = 0; t < INTERP_SINC_TAPS; t++ ) acc += ( h0[t] + w * ( h1[t] - h0[t] ) ) * (float)x[t];
+    return acc;
+  }
+  return (float)d[0];
+}
+
+// the same with the mode known at run time only
+template <class T>
+static inline float Interpolate( int mode, const T* d, float frac ) {
+  switch ( mode ) {
+    case INTERP_LINEAR:   return Interpolate<INTERP_LINEAR>( d, frac );
+    case INTERP_HERMITE:  return Interpolate<INTERP_HERMITE>( d, frac );
+    case INTERP_SINC:     return Interpolate<INTERP_SINC>( d, frac );
+    default:              return Interpolate<INTERP_NONE>( d, frac );
+  }
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Streaming playback from flash for the sampler (SAMPLER_STREAM in config.h).
+ *
+ * A kit loaded from a kit image (kit_image.h) at the board's SAMPLE_RATE keeps only the head of each sample in
+ * its cache region, enough to cover the furthest offset_midi start and the time the first chunk of the rest
+ * takes to arrive. A hit on a longer sample takes one of SAMPLER_STREAM_VOICES SampleStreams, and the prefetch
+ * task reads the tail from the image into that stream's ring, STREAM_CHUNK frames at a time, while the hit
+ * plays the head. Once the playback position passes the head, the voice reads from the ring.
+ *
+ * The audio task owns the request (kit, sample, from, end) and writes it under gen as a seqlock: gen is odd
+ * while the fields change and even once they are done, and Take() copies them only between two reads of the
+ * same even gen. The prefetch task owns the ring and filled, and marks the request it fills with ready.
+ * A voice reads frame f from the ring only while ready == gen and f with its interpolation taps lies between
+ * what the task has written and what it may have overwritten since; else it reads silence and counts an
+ * underrun. The task never writes further ahead than the consumed position the voice published at its last
+ * block, plus the read-ahead.
+ *
+ * How far the task reads ahead and how long the heads are follows from the flash throughput, which the sampler
+ * measures while it loads the image: StreamReadAhead() and StreamHead().
+ */
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define STREAM_RING         1024   // frames per stream, a power of 2
+#define STREAM_CHUNK        256    // frames per read
+#define STREAM_PAD          8      // frames behind the ring that repeat its start, for the taps around the wrap
+#define STREAM_BEFORE       3      // taps in front of the position, INTERP_SINC_BEFORE
+#define STREAM_AHEAD        4      // taps behind it, InterpAhead(INTERP_SINC)
+#define STREAM_MAX_SPEED    4      // frames per output sample the sizing allows for, pitch and playback speed
+#define STREAM_WAKE_US      1500   // the prefetch task runs once per DMA buffer, plus scheduling
+#define STREAM_SEEK_US      200    // per read, on top of the bytes
+#define STREAM_START        256    // the furthest offset_midi start is 2 * 127 frames
+#define STREAM_NONE         0xFF
+
+class SampleStream {
+  public:
+    // audio task
+    std::atomic<uint8_t> kit {0};             // kits[] slot and sample in it the tail comes from
+    std::atomic<uint8_t> sample {STREAM_NONE}; // STREAM_NONE while the stream is free
+    std::atomic<uint32_t> from {0};           // first frame the ring gets, STREAM_PAD before the end of the head
+    std::atomic<uint32_t> end {0};            // frames in the sample
+    std::atomic<uint32_t> gen {0};            // odd while the request changes, up by 2 with every change
+    std::atomic<uint32_t> consumed {0};       // playback position at the last block
+
+    // prefetch task
+    std::atomic<uint32_t> ready {0};    // gen of the request ring and filled belong to
+    std::atomic<uint32_t> filled {0};   // frames up to here are in the ring
+    int16_t ring[ STREAM_RING + STREAM_PAD ];
+
+    // audio task: a new request, STREAM_NONE frees the stream
+    inline void Request( uint8_t k, uint8_t s, uint32_t f, uint32_t e ) {
+      uint32_t g = gen.load(std::memory_order_relaxed);
+      gen.store( g + 1, std::memory_order_relaxed );
+      std::atomic_thread_fence(std::memory_order_release);    // odd before any field changes
+      kit.store( k, std::memory_order_relaxed );
+      sample.store( s, std::memory_order_relaxed );
+      from.store( f, std::memory_order_relaxed );
+      end.store( e, std::memory_order_relaxed );
+      consumed.store( f, std::memory_order_relaxed );
+      gen.store( g + 2, std::memory_order_release );
+    }
+
+    // prefetch task: the request and the gen it belongs to, false if the audio task was changing it
+    inline bool Take( uint8_t &k, uint8_t &s, uint32_t &f, uint32_t &e, uint32_t &g ) const {
+      g = gen.load(std::memory_order_acquire);
+      if ( g & 1 ) return false;
+      k = kit.load(std::memory_order_relaxed);
+      s = sample.load(std::memory_order_relaxed);
+      f = from.load(std::memory_order_relaxed);
+      e = end.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);    // the fields before the second look at gen
+      return gen.load(std::memory_order_relaxed) == g;
+    }
+
+    // frame f with its taps, silence if the task hasn't caught up
+    inline const int16_t* Window( uint32_t f, uint32_t &underruns ) const {
+      static const int16_t silence[ STREAM_BEFORE + STREAM_AHEAD + 1 ] = {};
+      if ( ready.load(std::memory_order_acquire) != gen.load(std::memory_order_relaxed) ) {
+        underruns++;
+        return silence + STREAM_BEFORE;
+      }
+      uint32_t to = filled.load(std::memory_order_acquire);
+      if ( f + STREAM_AHEAD >= to || f - STREAM_BEFORE + STREAM_RING < to ) {
+        underruns++;
+        return silence + STREAM_BEFORE;
+      }
+      return ring + ( ( f - STREAM_BEFORE ) & ( STREAM_RING - 1 ) ) + STREAM_BEFORE;
+    }
+
+    // prefetch task: n frames from frame at on into the ring
+    inline void Store( uint32_t at, const int16_t *src, int n ) {
+      for ( int k = 0; k < n; k++ ) {
+        uint32_t i = ( at + k ) & ( STREAM_RING - 1 );
+        ring[i] = src[k];
+        if ( i < STREAM_PAD ) ring[ i + STREAM_RING ] = src[k];
+      }
+    }
+};
+
+// microseconds the prefetch task takes at worst to come back to a stream: all the others read a chunk first
+static inline float StreamRoundUs( float bytesPerUs, int streams ) {
+  return STREAM_WAKE_US + streams * ( STREAM_SEEK_US + STREAM_CHUNK * 2 / bytesPerUs );
+}
+
+// frames the task keeps ahead of a voice: what it plays in two rounds and one chunk more, at most the ring
+static inline uint32_t StreamReadAhead( float bytesPerUs, int streams, uint32_t rate ) {
+  float frames = 2.0f * StreamRoundUs( bytesPerUs, streams ) * 1e-6f * rate * STREAM_MAX_SPEED + STREAM_CHUNK;
+  uint32_t ahead = frames < STREAM_RING - STREAM_BEFORE - STREAM_AHEAD ? frames : STREAM_RING - STREAM_BEFORE - STREAM_AHEAD;
+  return ahead < 2 * STREAM_CHUNK ? 2 * STREAM_CHUNK : ahead;
+}
+
+// frames of a sample that stay resident: the offset starts and what plays while the first chunk comes in
+static inline uint32_t StreamHead( float bytesPerUs, int streams, uint32_t rate ) {
+  float frames = STREAM_START + 2.0f * StreamRoundUs( bytesPerUs, streams ) * 1e-6f * rate * STREAM_MAX_SPEED;
+  return ( (uint32_t)frames + 15 ) & ~15u;
+}
+
+#endif
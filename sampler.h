@@ -1,17 +1,67 @@
 #ifndef SAMPLER_H
 #define SAMPLER_H
 
+#include <atomic>
 #include <FS.h>
 #include <LittleFS.h>
 #include "midi_config.h"
 #include "fx_filtercrusher.h"
+#include "kit_image.h"
+#include "adpcm.h"
+#include "sample_interp.h"
+#include "wav_convert.h"
+#include "sample_stream.h"
+
+#if defined(SAMPLER_FLOAT_STORE) && defined(SAMPLER_ADPCM)
+#error "SAMPLER_FLOAT_STORE and SAMPLER_ADPCM are two different sample stores, pick one"
+#endif
+
+#if defined(SAMPLER_STREAM) && ( defined(SAMPLER_FLOAT_STORE) || defined(SAMPLER_ADPCM) )
+#error "SAMPLER_STREAM streams 16 bit frames from kit images, it works with the int16 sample store only"
+#endif
+
+#ifndef SAMPLER_STREAM_VOICES
+#define SAMPLER_STREAM_VOICES 4
+#endif
+
+#ifdef SAMPLER_FLOAT_STORE
+typedef float sample_t;   // twice the cache per sample, no conversion when playing
+typedef float tap_t;      // what the interpolation reads
+#elif defined(SAMPLER_ADPCM)
+typedef uint8_t sample_t; // ADPCM blocks, the store is indexed in bytes then
+typedef int16_t tap_t;    // the voice's decoder history
+#else
+typedef int16_t sample_t;
+typedef int16_t tap_t;
+#endif
+
+#ifndef SAMPLER_INTERPOLATION
+#define SAMPLER_INTERPOLATION INTERP_NONE
+#endif
+
+#ifndef SAMPLER_MAX_VOICES
+#define SAMPLER_MAX_VOICES SAMPLECNT
+#endif
+
+#ifndef SAMPLER_FADE_MS
+#define SAMPLER_FADE_MS 5
+#endif
+
+// the drum hits sum into a few buses by instrument, each with its own pan, effect sends and side-chain tap
+enum eDrumBus_t { BUS_KICK, BUS_SNARE, BUS_HATS, BUS_PERC, DRUM_BUSES };
+
+// where ProcessBlock() puts what the buses send besides the main out, one value per sample
+struct DrumSends {
+  float *delay_l, *delay_r;
+  float *reverb_l, *reverb_r;
+  float *side;                  // the compressor's side-chain, mono
+};
 
 class Sampler {
   public:
     Sampler(){}
     Sampler(uint8_t progNow) { program_tmp = progNow; progNumber = progNow; };
     void Init();
-    void ScanContents(fs::FS &fs, const char *dirname, uint8_t levels);
     inline void SelectNote( uint8_t note ){
       if(sampleInfoCount>0) selectedNote = note % repeat; else  selectedNote = note;
 #ifdef DEBUG_SAMPLER
@@ -23,6 +73,13 @@ DEBF("Select note: %d\r\n", note);
     inline void SetNoteDecay_Midi( uint8_t data1); 
     inline void SetNoteVolume_Midi( uint8_t data1);
     inline void SetSoundPitch_Midi( uint8_t data1);
+    inline void SetNoteChoke_Midi( uint8_t data1 );
+    inline void SetNoteBus_Midi( uint8_t data1 );
+    // the bus the selected note plays through
+    inline void SetBusPan_Midi( uint8_t data1 );
+    inline void SetBusDelay_Midi( uint8_t data1 )   { buses[ GetSoundBus() ].delay = data1 * MIDI_NORM; };
+    inline void SetBusReverb_Midi( uint8_t data1 )  { buses[ GetSoundBus() ].reverb = data1 * MIDI_NORM; };
+    inline void SetBusSide_Midi( uint8_t data1 )    { buses[ GetSoundBus() ].side = data1 * MIDI_NORM; };
     inline void SetSoundPitch(float value);   
     inline void SetDelaySend(uint8_t lvl)   {_sendDelay = (float)lvl;};
     inline void SetReverbSend(uint8_t lvl)  {_sendReverb = (float)lvl;};
@@ -31,22 +88,40 @@ DEBF("Select note: %d\r\n", note);
     uint16_t GetSoundPan_Midi()   { return samplePlayer[ selectedNote ].pan_midi; };
     uint8_t GetSoundPitch_Midi()  { return samplePlayer[ selectedNote ].pitch_midi; };
     uint8_t GetSoundVolume_Midi() { return samplePlayer[ selectedNote ].volume_midi; };
+    uint8_t GetSoundChoke()       { return choke_group[ selectedNote + 1 ]; };
+    uint8_t GetSoundBus()         { return bus_midi[ selectedNote + 1 ]; };
     int32_t GetSamplesCount()     { return sampleInfoCount; }
+    int GetActiveCount()          { return activeCount; }
+    bool IsPlaying( int sample )  { return sample >= 0 && sample < sampleInfoCount && samplePlayer[ sample ].active; }
+    int GetKitCount()             { return kitCount; }
+    uint8_t GetKit( int i )       { return kitNumbers[ i ]; }
+    uint8_t GetProgram()          { return progNumber; }
     // Offset   for the Sample-Playback to cut the sample from the left
     inline void NoteOn( uint8_t note, uint8_t vol );
     inline void NoteOff( uint8_t note );
     void SetPlaybackSpeed_Midi( uint8_t value ){  SetSoundPitch( (float) MIDI_NORM * value ); };
     void SetPlaybackSpeed( float value );
     void SetProgram( uint8_t prog );
+    inline void CheckKit();
     void SetVolume( float value ) { _volume = value; };
+    void SetInterpolation( uint8_t mode );  // for the kit that plays now, INTERP_NONE .. INTERP_SINC
+    uint8_t GetInterpolation()    { return kits[frontKit].interpolation; }
+#ifdef SAMPLER_STREAM
+    uint32_t GetSoundSize()       { return samplePlayer[ selectedNote ].sampleSize; }
+    uint32_t GetSoundResident()   { return samplePlayer[ selectedNote ].resident; }  // frames of the head
+    uint32_t GetStreamUnderruns() { return underruns; }
+#endif
     inline void Process( float *left, float *right );
+    inline void ProcessBlock( float *left, float *right, int len, const DrumSends *sends = NULL );
     inline void ParseCC(uint8_t cc_number, uint8_t cc_value);
     inline void PitchBend(int number);
     float _sendReverb = 0.0f;
     float _sendDelay = 0.0f;
+    static const int FADE_VOICES = 4;     // fading hits on top of SAMPLER_MAX_VOICES, before they get cut
     
   private:
     void CreateDefaultSamples(fs::FS &fs);
+    void ScanKits();
     void WriteFile(fs::FS &fs, const String fname, size_t fsize, const uint8_t bytearray[] );
     boolean is_muted[17]={ false, false,false,false,false ,false,false,false,false ,false,false,false,false ,false,false,false,false };
                   
@@ -56,6 +131,9 @@ DEBF("Select note: %d\r\n", note);
     uint8_t pitch_midi[17]      = { 64, 64,64,64,64, 64,64,64,64, 64,64,64,64, 64,64,64,64 };
     uint8_t pan_midi[17]        = { 64, 64,64,64,64, 64,64,64,64, 64,64,64,64, 64,64,64,64 };
     uint8_t pitchdecay_midi[17] = { 64, 64,64,64,64, 64,64,64,64, 64,64,64,64, 64,64,64,64 };
+    uint8_t choke_group[17]     = { 0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0 }; // a hit fades out the others of its group, 0 = none
+    uint8_t bus_midi[17]        = { BUS_PERC,  BUS_KICK, BUS_SNARE, BUS_PERC, BUS_PERC,  BUS_PERC, BUS_SNARE, BUS_HATS, BUS_HATS, // BD SD LT HT CLK CL CH OH
+                                    BUS_PERC, BUS_HATS, BUS_PERC, BUS_PERC,  BUS_PERC, BUS_PERC, BUS_PERC, BUS_PERC };       // RS CR CO CB
     String shortInstr[17] ={ "ACC", "111","222","333","HHop", "Cr","Cl","LT","HT", "S1","S2","S3","S4", "T1","T2","T3","T4" };
     // Soundset/Program-Settings
     uint8_t  program_midi = 0; 
@@ -65,37 +143,19 @@ DEBF("Select note: %d\r\n", note);
     float _volume = 1.0f;
     float sampler_playback = 1.0f;
     volatile uint8_t selectedNote = 0;
-    // union is very handy for easy conversion of bytes to the wav header information
-    union wavHeader{
-        struct{
-            char riff[4];						// 4
-            uint32_t fileSize; 					// 8
-            char waveType[4];					// 12
-            char format[4];						// 16
-            uint32_t lengthOfData;				// 20
-            uint16_t numberOfChannels;			// 22
-            uint16_t audioFormat;				// 24
-            uint32_t sampleRate;				// 28
-            uint32_t byteRate;					// 32
-            uint16_t bytesPerSample;			// 34
-            uint16_t bitsPerSample;				// 36
-            char dataStr[4];					// 40
-            uint32_t dataSize; 					// 44
-        };
-        uint8_t wavHdr[44];
-    };
-
     typedef struct samplePlayerS{
    //     char filename[32]; // move it out of the struct in hope to speed up the sampler
    //     File file;
         uint32_t sampleRate; 
-        uint32_t sampleStart; // in a PSRAM common buffer;
-        uint32_t sampleSize;
+        uint32_t sampleStart; // in a PSRAM common buffer, in sample_t units (frames, or bytes with SAMPLER_ADPCM)
+        uint32_t sampleSize;  // in frames
+#ifdef SAMPLER_STREAM
+        uint32_t resident;    // frames in the cache, the rest streams
+#endif
         float samplePosF;
         uint32_t samplePos;
      //   uint32_t lastDataOut; 
         bool active;
-        uint32_t sampleSeek;
     //    uint32_t dataIn;
         float volume; // Volume of Track
         float signal;
@@ -115,18 +175,153 @@ DEBF("Select note: %d\r\n", note);
     
         float pitchdecay = 0.0f;
         uint8_t pitchdecay_midi;
+        uint8_t choke = 0;
+        uint8_t bus = BUS_PERC;
       
     } samplePlayerS ;
     
     samplePlayerS samplePlayer[ SAMPLECNT ];
-    char filenames[ SAMPLECNT ][32];
+
+    static const int HIT_BANDS = 16;     // velocity steps of 8
+    static const uint8_t NO_GROUP = 0xFF;
+
+    // a drum kit as the loader leaves it: its own cache region and where each sample sits in there
+    typedef struct kitS {
+        sample_t* data = NULL;      // all the samples of the kit back to back, in sample_t units
+        size_t frames = 0;          // size of the region in sample_t units
+        int32_t count = 0;
+        uint8_t repeat = 1;
+        uint8_t program = 0;
+        uint8_t interpolation = SAMPLER_INTERPOLATION;
+        uint32_t sampleStart[ SAMPLECNT ];
+        uint32_t sampleSize[ SAMPLECNT ];
+        uint32_t sampleRate[ SAMPLECNT ];
+        char filenames[ SAMPLECNT ][32];
+#ifdef SAMPLER_STREAM
+        uint32_t resident[ SAMPLECNT ];     // frames of the head, sampleSize if it is all in the cache
+        uint32_t imageStart[ SAMPLECNT ];   // frame in the image payload
+        uint32_t imageOffset = 0;           // of the payload in the image file
+        File image;                         // open while the kit streams
+#endif
+        // velocity layers and round robin, see kit_image.h. Per sample from layers.txt or the image index,
+        // BuildLayers() turns them into hitGroup: note, velocity / 8 -> the group of samples that take turns
+        uint8_t layerNote[ SAMPLECNT ];     // 0: plays its own note only, n: a layer of note n - 1
+        uint8_t layerVelocity[ SAMPLECNT ];
+        uint8_t hitGroup[ SAMPLECNT ][ HIT_BANDS ]; // NO_GROUP: the note plays its own sample
+        uint8_t groupFirst[ SAMPLECNT ];    // into groupSamples
+        uint8_t groupCount[ SAMPLECNT ];
+        uint8_t groupSamples[ SAMPLECNT ];
+    } kitS;
+
+    // new notes play the front kit, a program change loads the back one in a background task and the audio
+    // task swaps the two at the next block. Voices started before keep playing from the old region, the loader
+    // waits until they have ended before it overwrites it again.
+    kitS kits[2];
+    uint8_t frontKit = 0;
+    std::atomic<int> kitRequest {-1};     // program to load next, -1 if none
+    std::atomic<bool> kitReady {false};   // the back kit is loaded, waiting for the swap
+    std::atomic<bool> backFree {true};    // no voice plays from the back kit anymore
+    TaskHandle_t kitLoader = NULL;
+    uint8_t kitNumbers[ 32 ];             // kit folders found on LittleFS
+    int kitCount = 0;
+    void ScanContents(fs::FS &fs, const char *dirname, uint8_t levels, kitS &kit);
+    void SetRegion( kitS &kit, void *mem, size_t bytes );
+    bool LoadKit( uint8_t prog, kitS &kit );
+    bool LoadKitImage( const char *path, kitS &kit );
+    bool StoreSample( File &f, kitS &kit, int i, size_t &pointer );
+    void LoadLayers( const char *dir, kitS &kit );
+    void BuildLayers( kitS &kit );
+    inline int PickSample( int j, uint8_t vol );
+    uint8_t roundRobin[ SAMPLECNT ];      // next turn in each group of the front kit
+    WavConverter converter;               // the loader's, WAVs of any rate and format to the store's
+    bool LoadRequestedKit();
+    void InstallKit();
+    static void KitLoaderTask( void *param );
+
+    // playback state of the sounding players only, packed side by side so that Process() walks just the hits
+    // that are playing instead of every loaded sample. Slots are kept in player order, which is the order
+    // the players get summed in. NoteOn() fills a slot, the end of a sample or of a fade-out frees it.
+    typedef struct activeVoicesS {
+        float samplePosF[ SAMPLECNT ];
+        float vel[ SAMPLECNT ];
+        float decay[ SAMPLECNT ];
+        float pitch[ SAMPLECNT ];
+        float pan[ SAMPLECNT ];
+        float volume[ SAMPLECNT ];
+        float pitchdecay[ SAMPLECNT ];
+        float signal[ SAMPLECNT ];
+        const sample_t* data[ SAMPLECNT ];  // in the region of the kit the hit was started from
+        uint32_t sampleSize[ SAMPLECNT ];
+        uint8_t interp[ SAMPLECNT ];        // interpolation of the kit the hit was started from
+        uint16_t fade[ SAMPLECNT ];         // samples left of a choked or stolen hit's fade-out, 0 if it plays on
+        uint8_t choke[ SAMPLECNT ];
+        uint8_t bus[ SAMPLECNT ];
+#ifdef SAMPLER_STREAM
+        uint32_t resident[ SAMPLECNT ];     // the stream takes over from here, 0xFFFFFFFF without one
+        uint8_t stream[ SAMPLECNT ];        // STREAM_NONE if the hit plays from the cache only
+#endif
+        uint32_t age[ SAMPLECNT ];          // hits started before it, the oldest gets stolen first on a tie
+#ifdef SAMPLER_ADPCM
+        AdpcmDecoder decoder[ SAMPLECNT ];
+#endif
+        uint8_t player[ SAMPLECNT ];
+    } activeVoicesS;
+
+    activeVoicesS act;
+    int activeCount = 0;
+    inline int ActiveSlot( int player );
+    inline void Activate( int player );
+    inline void Release( int slot );
+    inline void Choke( uint8_t group, int except );
+    inline int StealSlot( bool fading );
+    uint32_t hits = 0;
+    float fadeDecay = 0.0f;               // per sample, -60 dB over FADE_LEN
+    static const int FADE_LEN = SAMPLE_RATE * SAMPLER_FADE_MS / 1000;
+
+    // the buses keep their settings across kit changes, like a mixer would
+    typedef struct drumBusS {
+        uint8_t pan_midi = 64;
+        float gain_l = 1.0f;        // balance from pan_midi, unity in the middle
+        float gain_r = 1.0f;
+        float delay = 1.0f;         // times the drums' _sendDelay
+        float reverb = 1.0f;        // times the drums' _sendReverb
+        float side = 0.0f;          // into the compressor's side-chain
+    } drumBusS;
+    drumBusS buses[ DRUM_BUSES ];
+    float busL[ DRUM_BUSES ][ DMA_BUF_LEN ];  // ProcessBlock() renders the hits into these, then mixes them in one pass
+    float busR[ DRUM_BUSES ][ DMA_BUF_LEN ];
+    inline void MixBuses( float *left, float *right, int len, const DrumSends *sends, int at );
+
+#ifdef SAMPLER_STREAM
+    // the tails of the long samples, see sample_stream.h
+    SampleStream streams[ SAMPLER_STREAM_VOICES ];
+    int streamsTaken = 0;
+    std::atomic<uint32_t> streamAhead {2 * STREAM_CHUNK}; // read-ahead from the measured flash throughput
+    uint32_t underruns = 0;
+    std::atomic<int> streamReading {-1};     // kit slot the prefetch task reads from right now
+    TaskHandle_t streamer = NULL;
+    bool LoadKitHeads( File &f, const KitImageHeader &hdr, kitS &kit );
+    inline void StartStream( int slot, int player );
+    inline void StopStream( int slot );
+    void Prefetch();
+    static void StreamTask( void *param );
+#endif
+    inline void RemoveSlot( int slot );
+    template <int MODE> inline bool RenderRun( int s, float *left, float *right, int len );
    // samplePlayerS* samplePlayer = NULL;
     
     // float global_pitch_decay = 0.0f; // good from -0.2 to +1.0
     
     volatile int32_t sampleInfoCount = -1; // storing the count if found samples in file system 
     float slowRelease; // slow releasing signal will be used when sample playback stopped 
-    uint8_t* RamCache = NULL ;
+#ifdef SAMPLER_ADPCM
+    static const int SAMPLE_ALIGN = 4;  // bytes
+    static const int SAMPLE_GUARD = 0;  // the decoders stop at the end of their sample
+#else
+    static const int SAMPLE_ALIGN = KIT_IMAGE_ALIGN; // frames, the same layout as in a kit image
+    static const int SAMPLE_GUARD = KIT_IMAGE_GUARD;
+#endif
+    static const int SAMPLE_CHUNK = 512; // frames per read when loading
 
     FxFilterCrusher Effects;
 };
@@ -58,7 +58,7 @@ void Sampler::WriteFile(fs::FS &fs, const String fname, size_t fsize, const uint
   f.close();
 }
 
-void Sampler::ScanContents(fs::FS &fs, const char *dirname, uint8_t levels) {
+void Sampler::ScanContents(fs::FS &fs, const char *dirname, uint8_t levels, kitS &kit) {
   String str;
 #ifdef DEBUG_SAMPLER
   DEBF("Listing directory: %s\r\n", dirname);
@@ -82,7 +82,7 @@ void Sampler::ScanContents(fs::FS &fs, const char *dirname, uint8_t levels) {
 #endif
       if ( levels ) {
         str = (String)(dirname + (String)(file.name()) + '/');
-        ScanContents(fs, str.c_str(), levels - 1);
+        ScanContents(fs, str.c_str(), levels - 1, kit);
       }
     } else {
 #ifdef DEBUG_SAMPLER
@@ -93,13 +93,15 @@ void Sampler::ScanContents(fs::FS &fs, const char *dirname, uint8_t levels) {
       DEBUG(file.size());
 #endif
 
-      if ( sampleInfoCount < SAMPLECNT ) {
+      const char *name = file.name();
+      size_t nameLen = strlen(name);
+      if ( kit.count < SAMPLECNT && nameLen > 4 && strcasecmp(name + nameLen - 4, ".wav") == 0 ) {
         str = (String)(file.name());
-       // shortInstr[ sampleInfoCount ] = str.substring(str.length() - 7, str.length() - 4);
+       // shortInstr[ kit.count ] = str.substring(str.length() - 7, str.length() - 4);
         str = (String)dirname + str;
-//        strncpy( samplePlayer[ sampleInfoCount ].filename, str.c_str() , 32);
-        strncpy( filenames[ sampleInfoCount ], str.c_str() , 32);
-        sampleInfoCount ++;
+//        strncpy( samplePlayer[ kit.count ].filename, str.c_str() , 32);
+        strncpy( kit.filenames[ kit.count ], str.c_str() , 32);
+        kit.count ++;
       }
     }
     delay(1);
@@ -113,43 +115,29 @@ void Sampler::Init() {
   
   Effects.Init();
   Effects.SetBitCrusher( 0.0f );
-
-  size_t toRead = 512, oldPointer = 0, buffPointer = 0;
+  BuildSincTable();
 
   if ( !LittleFS.begin(FORMAT_LITTLEFS_IF_FAILED)) {
     DEBUG("LittleFS Mount Failed");
     return;
   }
-#ifdef NO_PSRAM
-  String myDir = "/" + (String)progNumber + "/";
-#else
-  #ifdef PRELOAD_ALL
-    String myDir = "/" ;
-  #else
-    String myDir = "/" + (String)progNumber + "/";
-  #endif
-#endif
-
-  sampleInfoCount = 0;
-  ScanContents(LittleFS, myDir.c_str() , 5);
-  if (sampleInfoCount<5) {
-    CreateDefaultSamples(LittleFS);
-    ScanContents(LittleFS, myDir.c_str() , 5);
-  }
-  repeat = min(sampleInfoCount , repeat); // 12 (an octave) or less
 
-  if (repeat==0) repeat = 1;
-  
 #ifndef NO_PSRAM
   // allocate buffer in PSRAM to be able to load all samples 
+  // PRELOAD_ALL needs it all for the one kit, else it is split in the front and the back kit
   heap_caps_print_heap_info(MALLOC_CAP_8BIT);
   if (psramFound()) {
-    if ( RamCache == NULL ) {
+    if ( kits[0].data == NULL ) {
       psramInit();
-      RamCache = (uint8_t*)ps_malloc(PSRAM_SAMPLER_CACHE);
-     // RamCache = (uint8_t*)malloc(PSRAM_SAMPLER_CACHE);
+  #ifdef PRELOAD_ALL
+      SetRegion( kits[0], ps_malloc(PSRAM_SAMPLER_CACHE), PSRAM_SAMPLER_CACHE );
+  #else
+      for ( int k = 0; k < 2; k++ ) {
+        SetRegion( kits[k], ps_malloc(PSRAM_SAMPLER_CACHE / 2), PSRAM_SAMPLER_CACHE / 2 );
+      }
+  #endif
     }
-    if (RamCache == NULL) {
+    if (kits[0].data == NULL) {
       DEBUG ("FAILED TO ALLOCATE PSRAM CACHE BUFFER!");
     } else {
       DEBF ("PSRAM BUFFER OF %d bytes ALLOCATED! STANDARD CONFIG ENGAGED!\r\n", PSRAM_SAMPLER_CACHE );
@@ -163,79 +151,401 @@ void Sampler::Init() {
 #else
   DEBF("Free heap: %d\r\n", heap_caps_get_free_size(MALLOC_CAP_8BIT));
   heap_caps_print_heap_info(MALLOC_CAP_8BIT);
-  if ( RamCache == NULL ) {
-    RamCache = (uint8_t*)malloc(RAM_SAMPLER_CACHE);
-    // RamCache = (uint8_t*)heap_caps_malloc(RAM_SAMPLER_CACHE, MALLOC_CAP_8BIT);
+  if ( kits[0].data == NULL ) {
+    for ( int k = 0; k < 2; k++ ) {
+      SetRegion( kits[k], malloc(RAM_SAMPLER_CACHE), RAM_SAMPLER_CACHE );
+      // SetRegion( kits[k], heap_caps_malloc(RAM_SAMPLER_CACHE, MALLOC_CAP_8BIT), RAM_SAMPLER_CACHE );
+    }
   }
-  if (RamCache == NULL) {
+  if (kits[0].data == NULL) {
     DEBUG ("FAILED TO ALLOCATE RAM CACHE BUFFER!");
   } else {
-    DEBF ("HEAP BUFFER of %d bytes ALLOCATED! MINIMAL CONFIG ENGAGED!\r\n", RAM_SAMPLER_CACHE);
+    DEBF ("HEAP BUFFERS of 2 x %d bytes ALLOCATED! MINIMAL CONFIG ENGAGED!\r\n", RAM_SAMPLER_CACHE);
   }
 
 #endif
+
+  // the first kit loads right here, there is nothing playing yet
+  activeCount = 0;
+  for ( int i = 0; i < SAMPLECNT; i++ ) samplePlayer[i].active = false;
+  fadeDecay = powf( 0.001f, 1.0f / FADE_LEN );
+  buses[ BUS_KICK ].reverb = 0.25f; // a dry kick under a wet snare
+  buses[ BUS_KICK ].side = 1.0f;    // the kick ducks the mix
+  if ( !LoadKit( progNumber, kits[frontKit] ) || kits[frontKit].count < 5 ) {
+    CreateDefaultSamples(LittleFS);
+    LoadKit( progNumber, kits[frontKit] );
+  }
+  InstallKit();
+  ScanKits();
+
+  if ( kitLoader == NULL && kits[frontKit ^ 1].data != NULL ) {
+    xTaskCreatePinnedToCore( KitLoaderTask, "KitLoader", 4096, this, LOADER_TASK_PRIORITY, &kitLoader, 1 ); // time-sliced with loop()
+  }
+#ifdef SAMPLER_STREAM
+  if ( streamer == NULL ) {
+    xTaskCreatePinnedToCore( StreamTask, "Stream", 4096, this, STREAM_TASK_PRIORITY, &streamer, 1 ); // below the audio tasks, above the loader
+  }
+#endif
+}
+
+// a kit's cache region, after SAMPLE_GUARD silent frames for the interpolation taps in front of the first sample
+void Sampler::SetRegion( kitS &kit, void *mem, size_t bytes ) {
+  if ( mem == NULL || bytes / sizeof(sample_t) <= SAMPLE_GUARD ) {
+    return;
+  }
+  kit.data = (sample_t*)mem;
+  for ( int k = 0; k < SAMPLE_GUARD; k++ ) *kit.data++ = 0;
+  kit.frames = bytes / sizeof(sample_t) - SAMPLE_GUARD;
+}
+
+// loads one kit into its region, from its packed image if there is one, else from its WAV folder.
+// The caller makes sure no voice plays from there.
+bool Sampler::LoadKit( uint8_t prog, kitS &kit ) {
+  size_t framePointer = 0;
+#ifdef NO_PSRAM
+  String myDir = "/" + (String)prog + "/";
+  String myImage = "/kits/" + (String)prog + ".kit";
+#else
+  #ifdef PRELOAD_ALL
+    String myDir = "/" ;
+    String myImage = "/kits/all.kit";
+  #else
+    String myDir = "/" + (String)prog + "/";
+    String myImage = "/kits/" + (String)prog + ".kit";
+  #endif
+#endif
+
+  kit.count = 0;
+  kit.program = prog;
+  kit.interpolation = SAMPLER_INTERPOLATION;
+  memset( kit.layerNote, 0, sizeof(kit.layerNote) );
+  memset( kit.layerVelocity, 0, sizeof(kit.layerVelocity) );
+#ifdef SAMPLER_STREAM
+  kit.image.close(); // CheckKit() made sure no stream reads from it
+#endif
+  if ( LoadKitImage( myImage.c_str(), kit ) ) {
+    BuildLayers( kit );
+    return true;
+  }
+  ScanContents(LittleFS, myDir.c_str() , 5, kit);
+  kit.repeat = min(kit.count , (int32_t)12); // 12 (an octave) or less
+  if (kit.repeat==0) kit.repeat = 1;
+  
 #ifdef DEBUG_SAMPLER
   DEBUG("---\nList Samples:");
 #endif
-  for (int i = 0; i < sampleInfoCount; i++ ) {
+  for (int i = 0; i < kit.count; i++ ) {
 #ifdef DEBUG_SAMPLER
 //    DEBF( "s[%d]: %s\n", i, samplePlayer[i].filename );
-    DEBF( "s[%d]: %s\n", i, filenames[i] );
+    DEBF( "s[%d]: %s\n", i, kit.filenames[i] );
 #endif
 
 //    File f = LittleFS.open( (String)(samplePlayer[i].filename) );
-    File f = LittleFS.open( (String)(filenames[i]) );
+    File f = LittleFS.open( (String)(kit.filenames[i]) );
 
+    kit.sampleStart[i] = 0;
+    kit.sampleSize[i] = 0;
+    kit.sampleRate[i] = 0;
     if ( f ) {
-      size_t len = f.size();
-      union wavHeader wav;
-      if ( len ) {
-        toRead = sizeof(wav.wavHdr);
-        f.read(&(wav.wavHdr[0]),toRead);
-        len -= toRead;
+      WavInfo wav;
+      size_t len = ReadWavInfo( f, wav ) ? f.size() - f.position() : 0;
+      if ( len == 0 || !converter.Begin( wav, min((size_t)wav.dataBytes, len), SAMPLE_RATE ) ) { // some samples have wrong header info
+        DEBF("%s skipped: %s\r\n", kit.filenames[i], len == 0 ? "no sample data" : converter.Refused());
+        f.close();
+        continue;
       }
+      StoreSample( f, kit, i, framePointer );
 
-      // load sample data to the RAM/PSRAM buffer, we only do this step on startup
-      samplePlayer[i].sampleStart = buffPointer;
-      oldPointer = buffPointer;
-      while( len ){
-        if(len > (1UL<<15)){
-          toRead = (1UL<<15);
-        } else {
-          toRead = len;
-        }
-        f.read(&(RamCache[buffPointer]), toRead);
-        buffPointer += toRead;
-        len -= toRead;
-      }
-      wav.dataSize = min(wav.dataSize, buffPointer-oldPointer); // some samples have wrong header info
-      
   //    samplePlayer[i].file =            f;// store file pointer for future use // nope, we don't, we close file, LittleFS won't let us keep so many open files, neither  memory...
-      samplePlayer[i].sampleRate =      wav.sampleRate;
+      kit.sampleRate[i] =               SAMPLE_RATE; // converted
 #ifdef DEBUG_SAMPLER
-      DEBF("fileSize: %d\n",            wav.fileSize);
-      DEBF("lengthOfData: %d\n",        wav.lengthOfData);
-      DEBF("numberOfChannels: %d\n",    wav.numberOfChannels);
+      DEBF("numberOfChannels: %d\n",    wav.channels);
       DEBF("sampleRate: %d\n",          wav.sampleRate);
-//      DEBF("byteRate: %d\n",            wav.byteRate);
-//      DEBF("bytesPerSample: %d\n",      wav.bytesPerSample);
-      DEBF("bitsPerSample: %d\n",       wav.bitsPerSample);
-      DEBF("dataSize: %d\n",            wav.dataSize); 
-//      DEBF("dataStartInBuffer: %d\n",   samplePlayer[i].sampleStart);
-//      DEBF("dataInBlock: %d\n",         (buffPointer - samplePlayer[i].sampleStart));
-#endif
-      samplePlayer[i].sampleSize =      wav.dataSize; /* without mark section and size info */
-      samplePlayer[i].sampleSeek =      0xFFFFFFFF;
+      DEBF("bitsPerSample: %d\n",       wav.bits);
+      DEBF("dataSize: %d\n",            wav.dataBytes); 
+#endif
       f.close();
     } else {
       DEBF("error opening file!\n");
     }
   }
+  LoadLayers( myDir.c_str(), kit );
+  BuildLayers( kit );
+  return kit.count > 0;
+}
+
+// reads the layers.txt of the kit folder dir, if there is one, into the kit's layerNote and layerVelocity
+void Sampler::LoadLayers( const char *dir, kitS &kit ) {
+  String path = (String)dir + KIT_LAYERS_FILE;
+  if ( !LittleFS.exists(path.c_str()) ) {
+    return;
+  }
+  File f = LittleFS.open(path);
+  char line[128], name[KIT_IMAGE_NAME];
+  int len = 0, note, velocity;
+  bool more = true;
+  while ( f && more ) {
+    uint8_t c;
+    more = f.read(&c, 1) == 1;
+    if ( more && c != '\n' ) {
+      if ( len < (int)sizeof(line) - 1 ) line[len++] = c;
+      continue;
+    }
+    line[len] = 0;
+    len = 0;
+    if ( !ParseLayerLine( line, note, velocity, name ) || note >= kit.count ) continue;
+    for ( int i = 0; i < kit.count; i++ ) {
+      if ( LayerNameMatches( kit.filenames[i], name ) ) {
+        kit.layerNote[i] = note + 1;
+        kit.layerVelocity[i] = velocity;
+      }
+    }
+  }
+  f.close();
+}
 
+// the NoteOn() lookup from the layers: for every note and velocity step the samples with the highest
+// velocity at or below it, the note's own sample at 0. Notes without layers stay at NO_GROUP.
+void Sampler::BuildLayers( kitS &kit ) {
+  memset( kit.hitGroup, NO_GROUP, sizeof(kit.hitGroup) );
+  // a layer of a note that is itself a layer, or of its own note, would land in two groups: it plays its own note instead
+  for ( int i = 0; i < kit.count; i++ ) {
+    int note = kit.layerNote[i] - 1;
+    if ( note >= 0 && ( note == i || note >= kit.count || kit.layerNote[note] != 0 ) ) {
+      DEBF("[sampler]: %s can't be a layer of note %d, it plays its own\r\n", kit.filenames[i], note);
+      kit.layerNote[i] = 0;
+    }
+  }
+  int groups = 0, members = 0;
+  for ( int j = 0; j < kit.count; j++ ) {
+    bool layered = false;
+    for ( int i = 0; i < kit.count; i++ ) {
+      layered |= ( kit.layerNote[i] == j + 1 );
+    }
+    if ( !layered ) continue;
+    int last = -1;
+    for ( int b = 0; b < HIT_BANDS; b++ ) {
+      int floor = 0;
+      for ( int i = 0; i < kit.count; i++ ) {
+        int v = kit.layerVelocity[i] & ~7;
+        if ( kit.layerNote[i] == j + 1 && v <= b * 8 && v > floor ) floor = v;
+      }
+      if ( floor != last ) {
+        // without chains every sample lands in one group at most, so groups and members never outnumber the samples
+        if ( groups >= SAMPLECNT ) return;
+        kit.groupFirst[groups] = members;
+        if ( floor == 0 && members < SAMPLECNT ) kit.groupSamples[members++] = j;
+        for ( int i = 0; i < kit.count && members < SAMPLECNT; i++ ) {
+          if ( kit.layerNote[i] == j + 1 && ( kit.layerVelocity[i] & ~7 ) == floor && i != j ) kit.groupSamples[members++] = i;
+        }
+        kit.groupCount[groups] = members - kit.groupFirst[groups];
+        groups++;
+        last = floor;
+      }
+      kit.hitGroup[j][b] = groups - 1;
+    }
+  }
+#ifdef DEBUG_SAMPLER
+  DEBF("[sampler]: %d layer groups\r\n", groups);
+#endif
+}
+
+// reads the sample the converter was set up for from f and puts it into the kit's region at pointer, in the
+// format of the sample store. Sets where sample i sits, cuts it if the region is full. False if the file ends early.
+bool Sampler::StoreSample( File &f, kitS &kit, int i, size_t &pointer ) {
+  size_t frames = converter.Frames();
+  size_t toRead = SAMPLE_CHUNK;
+  bool ok = true;
+  while ( pointer % SAMPLE_ALIGN != 0 && pointer < kit.frames ) kit.data[pointer++] = 0; // the taps in front of a start read the gap
+  size_t room = ( pointer + SAMPLE_GUARD < kit.frames ) ? kit.frames - pointer - SAMPLE_GUARD : 0;
+#ifdef SAMPLER_ADPCM
+  if ( AdpcmBytes(frames) > room ) {
+    DEBF("sample cache full, %s is cut\r\n", kit.filenames[i]);
+    frames = room / ADPCM_BLOCK_BYTES * ADPCM_BLOCK;
+  }
+  AdpcmEncoder encoder;
+  encoder.Begin( kit.data + pointer );
+#else
+  if ( frames > room ) {
+    DEBF("sample cache full, %s is cut\r\n", kit.filenames[i]);
+    frames = room;
+  }
+#endif
+  kit.sampleStart[i] = pointer;
+  kit.sampleSize[i] = frames;
+#ifdef SAMPLER_STREAM
+  kit.resident[i] = frames;
+#endif
+  for ( size_t done = 0; done < frames; done += toRead ) {
+    toRead = min(frames - done, (size_t)SAMPLE_CHUNK);
+#if !defined(SAMPLER_FLOAT_STORE) && !defined(SAMPLER_ADPCM)
+    if ( converter.Native() ) {
+      ok &= f.read((uint8_t*)&kit.data[pointer + done], toRead * 2) == toRead * 2; // WAV data is little endian, as the CPU
+      continue;
+    }
+#endif
+    int16_t chunk[SAMPLE_CHUNK];
+    ok &= converter.Read( f, chunk, toRead );
+#ifdef SAMPLER_ADPCM
+    for ( size_t k = 0; k < toRead; k++ ) encoder.Push( chunk[k] );
+#else
+    for ( size_t k = 0; k < toRead; k++ ) kit.data[pointer + done + k] = chunk[k];
+#endif
+  }
+#ifdef SAMPLER_ADPCM
+  encoder.End();
+  pointer += AdpcmBytes(frames);
+#else
+  pointer += frames;
+#endif
+  for ( int k = 0; k < SAMPLE_GUARD && pointer < kit.frames; k++ ) kit.data[pointer++] = 0;
+  converter.End();
+  return ok;
+}
+
+// a packed kit (see kit_image.h): header and index first, then the payload goes into the region in one read,
+// or sample by sample through the converter if the store's format or the rate differs from the image's
+bool Sampler::LoadKitImage( const char *path, kitS &kit ) {
+  if ( !LittleFS.exists(path) ) {
+    return false;
+  }
+  File f = LittleFS.open(path);
+  KitImageHeader hdr;
+  if ( !f || f.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != KIT_IMAGE_MAGIC || hdr.version != KIT_IMAGE_VERSION ) {
+    DEBF("[sampler]: %s is not a kit image\r\n", path);
+    return false;
+  }
+  // the index and the payload have to be in the file, every sample and its guard in the payload
+  if ( hdr.count == 0 || hdr.dataOffset < sizeof(hdr) + hdr.count * sizeof(KitImageEntry)
+       || (uint64_t)f.size() < hdr.dataOffset + (uint64_t)hdr.dataFrames * 2 ) {
+    DEBF("[sampler]: %s is cut short or its header is broken\r\n", path);
+    return false;
+  }
+  kit.count = min((int32_t)hdr.count, (int32_t)SAMPLECNT);
+  bool direct = true;  // the payload is already what the store holds
+  for ( int i = 0; i < hdr.count; i++ ) {
+    KitImageEntry e;
+    if ( f.read((uint8_t*)&e, sizeof(e)) != sizeof(e) ) {
+      kit.count = 0;
+      return false;
+    }
+    if ( e.sampleRate == 0 || e.start > hdr.dataFrames || hdr.dataFrames - e.start < KIT_IMAGE_GUARD
+         || e.frames > hdr.dataFrames - e.start - KIT_IMAGE_GUARD ) { // no sum that could wrap
+      DEBF("[sampler]: %s, sample %d lies outside the payload\r\n", path, i);
+      kit.count = 0;
+      return false;
+    }
+    if ( i >= kit.count ) continue;
+    kit.sampleStart[i] = e.start;
+    kit.sampleSize[i] = e.frames;
+    kit.sampleRate[i] = e.sampleRate;
+    strncpy( kit.filenames[i], e.name, 32 );
+    kit.filenames[i][31] = 0;
+    kit.layerNote[i] = e.layerNote <= kit.count ? e.layerNote : 0;
+    kit.layerVelocity[i] = e.layerVelocity;
+    direct &= ( e.sampleRate == SAMPLE_RATE );
+  }
+#if defined(SAMPLER_FLOAT_STORE) || defined(SAMPLER_ADPCM)
+  direct = false;
+#endif
+#ifdef SAMPLER_STREAM
+  if ( direct ) {
+    return LoadKitHeads( f, hdr, kit );
+  }
+#endif
+  if ( direct && hdr.dataFrames > kit.frames ) {
+    DEBF("[sampler]: %s needs %d frames, the cache holds %d\r\n", path, hdr.dataFrames, kit.frames);
+    kit.count = 0;
+    return false;
+  }
+  if ( direct ) {
+    f.seek(hdr.dataOffset);
+    if ( f.read((uint8_t*)kit.data, hdr.dataFrames * 2) != hdr.dataFrames * 2 ) {
+      DEBF("[sampler]: %s is cut short\r\n", path);
+      kit.count = 0;
+      return false;
+    }
+  } else {
+    size_t pointer = 0;
+    for ( int i = 0; i < kit.count; i++ ) {
+      WavInfo wav = { WAV_FORMAT_PCM, 1, 16, 2, kit.sampleRate[i], kit.sampleSize[i] * 2 };
+      f.seek(hdr.dataOffset + kit.sampleStart[i] * 2);
+      if ( !converter.Begin( wav, wav.dataBytes, SAMPLE_RATE ) || !StoreSample( f, kit, i, pointer ) ) {
+        DEBF("[sampler]: %s is cut short\r\n", path);
+        kit.count = 0;
+        return false;
+      }
+      kit.sampleRate[i] = SAMPLE_RATE;
+    }
+  }
+  kit.repeat = min(kit.count , (int32_t)12); // 12 (an octave) or less
+  if (kit.repeat==0) kit.repeat = 1;
+#ifdef DEBUG_SAMPLER
+  DEBF("[sampler]: %s, %d samples in %d frames\r\n", path, kit.count, hdr.dataFrames);
+#endif
+  return kit.count > 0;
+}
+
+#ifdef SAMPLER_STREAM
+// the streaming version of a direct image load: only the heads go into the region, the image stays open for the
+// prefetch task. A timed read of the payload's start gives the flash throughput the heads and the read-ahead are sized by.
+bool Sampler::LoadKitHeads( File &f, const KitImageHeader &hdr, kitS &kit ) {
+  uint32_t probe = min( hdr.dataFrames, (uint32_t)min( kit.frames, (size_t)8192 ) );
+  f.seek(hdr.dataOffset);
+  unsigned long t = micros();
+  if ( f.read((uint8_t*)kit.data, probe * 2) != probe * 2 ) {
+    DEBUG("[sampler]: kit image is cut short");
+    kit.count = 0;
+    return false;
+  }
+  unsigned long dt = micros() - t;
+  float bytesPerUs = ( dt > 0 ) ? probe * 2.0f / dt : 100.0f; // no clock to go by, as fast as PSRAM
+  uint32_t head = StreamHead( bytesPerUs, SAMPLER_STREAM_VOICES, SAMPLE_RATE );
+  streamAhead.store( StreamReadAhead( bytesPerUs, SAMPLER_STREAM_VOICES, SAMPLE_RATE ), std::memory_order_relaxed );
+
+  size_t pointer = 0;
+  for ( int i = 0; i < kit.count; i++ ) {
+    uint32_t frames = kit.sampleSize[i];
+    uint32_t keep = ( frames <= head + STREAM_PAD ) ? frames : head + STREAM_PAD; // the taps past the head's end
+    WavInfo wav = { WAV_FORMAT_PCM, 1, 16, 2, SAMPLE_RATE, keep * 2 };
+    kit.imageStart[i] = kit.sampleStart[i];
+    f.seek(hdr.dataOffset + kit.imageStart[i] * 2);
+    if ( !converter.Begin( wav, wav.dataBytes, SAMPLE_RATE ) || !StoreSample( f, kit, i, pointer ) ) {
+      DEBF("[sampler]: %s is cut short\r\n", kit.filenames[i]);
+      kit.count = 0;
+      return false;
+    }
+    if ( kit.sampleSize[i] == keep && keep < frames ) { // else the cache was full and the sample is cut
+      kit.resident[i] = head;
+      kit.sampleSize[i] = frames;
+    }
+  }
+  kit.imageOffset = hdr.dataOffset;
+  kit.image = std::move(f);
+  kit.repeat = min(kit.count , (int32_t)12); // 12 (an octave) or less
+  if (kit.repeat==0) kit.repeat = 1;
+#ifdef DEBUG_SAMPLER
+  DEBF("[sampler]: %d samples, heads of %d frames in %d, flash %0.1f bytes/us, read-ahead %d\r\n", kit.count, head, pointer, bytesPerUs, streamAhead.load());
+#endif
+  return kit.count > 0;
+}
+#endif
+
+// points the players at the front kit and resets the instrument settings, as loading a kit always did
+void Sampler::InstallKit() {
+  kitS &kit = kits[frontKit];
+  sampleInfoCount = kit.count;
+  repeat = kit.repeat;
+  progNumber = kit.program;
+  memset( roundRobin, 0, sizeof(roundRobin) );
   for ( int i = 0; i < sampleInfoCount; i++ ) {
     int j = (i % repeat ) + 1 ; 
-    samplePlayer[i].sampleSeek = 0xFFFFFFFF;
-    samplePlayer[i].active = false;
+    samplePlayer[i].sampleStart = kit.sampleStart[i];
+    samplePlayer[i].sampleSize = kit.sampleSize[i];
+#ifdef SAMPLER_STREAM
+    samplePlayer[i].resident = kit.resident[i];
+#endif
+    samplePlayer[i].sampleRate = kit.sampleRate[i];
 
     decay_midi[j] = 100;
     samplePlayer[i].decay_midi = decay_midi[j];
@@ -253,12 +563,68 @@ void Sampler::Init() {
 
     pitch_midi[j] = 64;
     samplePlayer[i].pitch_midi = pitch_midi[j];
+
+    choke_group[j] = 0;
+#ifdef GROUP_HATS
+    if ( j == CH_NUMBER + 1 || j == OH_NUMBER + 1 ) choke_group[j] = 1;
+#endif
     if ( samplePlayer[i].sampleRate > 0 ) {
       samplePlayer[i].pitch = 1.0f / SAMPLE_RATE * samplePlayer[i].sampleRate;
     }
   };
 }
 
+// the numbered folders and kit images on LittleFS, the kits a program change can select
+void Sampler::ScanKits() {
+  kitCount = 0;
+  const char *dirs[] = { "/", "/kits" };
+  for ( const char *dir : dirs ) {
+    File root = LittleFS.open(dir);
+    if ( !root || !root.isDirectory() ) {
+      continue;
+    }
+    File file = root.openNextFile();
+    while ( file && kitCount < (int)sizeof(kitNumbers) ) {
+      bool image = strstr(file.name(), ".kit") != NULL;
+      if ( isdigit(file.name()[0]) && ( image ? !file.isDirectory() : file.isDirectory() ) ) {
+        uint8_t prog = atoi(file.name());
+        bool known = false;
+        for ( int k = 0; k < kitCount; k++ ) known |= ( kitNumbers[k] == prog );
+        if ( !known ) kitNumbers[ kitCount++ ] = prog;
+      }
+      file = root.openNextFile();
+    }
+  }
+}
+
+// loads the latest requested program into the back kit, false while the back kit can't be touched yet
+bool Sampler::LoadRequestedKit() {
+  if ( kitReady.load(std::memory_order_acquire) || !backFree.load(std::memory_order_acquire) ) {
+    return false;
+  }
+  int prog = kitRequest.exchange(-1);
+  if ( prog < 0 ) {
+    return true;
+  }
+  if ( LoadKit( prog, kits[frontKit ^ 1] ) ) {
+    kitReady.store(true, std::memory_order_release);
+  } else {
+    DEBF("[sampler]: no samples in kit %d, keeping kit %d\r\n", prog, progNumber);
+  }
+  return true;
+}
+
+void Sampler::KitLoaderTask( void *param ) {
+  Sampler *sampler = (Sampler*)param;
+  while (true) {
+    if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) {
+      while ( !sampler->LoadRequestedKit() ) {
+        vTaskDelay(1); // the last kit isn't swapped in yet or voices still play from the back region
+      }
+    }
+  }
+}
+
 inline void Sampler::SetNoteVolume_Midi( uint8_t data1) {
   volume_midi[ selectedNote + 1 ] = data1;
 #ifdef DEBUG_MIDI
@@ -325,39 +691,67 @@ inline void Sampler::SetSoundPitch_Midi( uint8_t data1) {
   pitch_midi[ selectedNote + 1 ] = data1;
 }
 
+inline void Sampler::SetNoteChoke_Midi( uint8_t data1 ) {
+#ifdef DEBUG_MIDI
+  DEBF("Sampler - Note[%d].choke: %d\n",  selectedNote, data1 >> 4);
+#endif
+  choke_group[ selectedNote + 1 ] = data1 >> 4;
+}
+
+inline void Sampler::SetNoteBus_Midi( uint8_t data1 ) {
+#ifdef DEBUG_MIDI
+  DEBF("Sampler - Note[%d].bus: %d\n",  selectedNote, data1 >> 5);
+#endif
+  bus_midi[ selectedNote + 1 ] = data1 >> 5; // sounding hits stay on theirs
+}
+
+inline void Sampler::SetBusPan_Midi( uint8_t data1 ) {
+  drumBusS &b = buses[ GetSoundBus() ];
+  float p = ( data1 - 64 ) / 63.0f;
+  if ( p < -1.0f ) p = -1.0f;
+  b.pan_midi = data1;
+  b.gain_l = p > 0.0f ? 1.0f - p : 1.0f;
+  b.gain_r = p < 0.0f ? 1.0f + p : 1.0f;
+}
+
 inline void Sampler::SetSoundPitch(float value) {
   samplePlayer[ selectedNote ].pitch = pow( 2.0f, 4.0f * ( value - 0.5f ) );
+  int slot = ActiveSlot( selectedNote );
+  if ( slot >= 0 ) act.pitch[ slot ] = samplePlayer[ selectedNote ].pitch;
 #ifdef DEBUG_MIDI
   DEBF("Sampler - Note[%d] pitch: %0.3f\n",  selectedNote, samplePlayer[ selectedNote ].pitch );
 #endif
 }
 
 
+// the sample a hit on sample slot j plays: the next in turn of the velocity layer, j itself without layers
+inline int Sampler::PickSample( int j, uint8_t vol ) {
+  const kitS &kit = kits[frontKit];
+  uint8_t g = kit.hitGroup[j][(vol & 127) >> 3];
+  if ( g == NO_GROUP ) {
+    return j;
+  }
+  uint8_t turn = roundRobin[g];
+  roundRobin[g] = ( turn + 1 < kit.groupCount[g] ) ? turn + 1 : 0;
+  return kit.groupSamples[ kit.groupFirst[g] + turn ];
+}
+
 inline void Sampler::NoteOn( uint8_t note, uint8_t vol ) {
 
   /* check for null to avoid division by zero */
   if ( sampleInfoCount == 0 ) {
     return;
   }
-  int j = note % sampleInfoCount;
+  int j = PickSample( note % sampleInfoCount, vol );
   int param_i = note % repeat + 1;
 
   if ( is_muted[ param_i ] == true) {
     return;
   }
 
-#ifdef GROUP_HATS
-  switch (param_i) {
-    case 7:
-      samplePlayer[note+1].active = false;
-      break;
-    case 8:
-      samplePlayer[note-1].active = false;
-      break;
-    default:
-      break;
+  if ( choke_group[ param_i ] > 0 ) {
+    Choke( choke_group[ param_i ], j );
   }
-#endif
 
 #ifdef DEBUG_MIDI
   DEBF("note %d on volume %d\n", note, vol );
@@ -457,20 +851,251 @@ inline void Sampler::NoteOn( uint8_t note, uint8_t vol ) {
 
   if ( newSamplePlayer->active ) {
     /* add last output signal to slow release to avoid noise */
-    slowRelease = newSamplePlayer->signal;
+    slowRelease = act.signal[ ActiveSlot( j ) ];
   }
 
-  newSamplePlayer->samplePosF = 4.0f * newSamplePlayer->offset_midi; // 0.0f;
-  newSamplePlayer->samplePos  = 4 * newSamplePlayer->offset_midi; // 0;
+  newSamplePlayer->samplePosF = 2.0f * newSamplePlayer->offset_midi; // 0.0f; in frames
+  newSamplePlayer->samplePos  = 2 * newSamplePlayer->offset_midi; // 0;
 
   newSamplePlayer->volume = vol * MIDI_NORM * newSamplePlayer->volume_midi * MIDI_NORM;
   newSamplePlayer->vel    = 1.0f;
  // newSamplePlayer->dataIn = 0;
-  newSamplePlayer->sampleSeek = 44 + 4 * newSamplePlayer->offset_midi; // 16 Bit-Samples wee nee
+  newSamplePlayer->choke = choke_group[ param_i ];
+  newSamplePlayer->bus = bus_midi[ param_i ];
 
-  newSamplePlayer->active = true;
+  Activate( j );
+}
+
+// slot of a sounding player in the active list, -1 if it is silent
+inline int Sampler::ActiveSlot( int player ) {
+  for ( int s = 0; s < activeCount; s++ ) {
+    if ( act.player[s] == player ) return s;
+  }
+  return -1;
+}
+
+// (re)starts a player: takes a slot in player order, or reuses its own one on a retrigger, and copies the playback state in.
+// A new hit over SAMPLER_MAX_VOICES steals one, over the FADE_VOICES on top of them a fading one gets cut.
+inline void Sampler::Activate( int player ) {
+  int s = ActiveSlot( player );
+  if ( s < 0 || act.fade[s] > 0 ) { // a new hit, or a fading one back to full
+    int sounding = 0;
+    for ( int i = 0; i < activeCount; i++ ) sounding += act.fade[i] == 0;
+    if ( sounding >= SAMPLER_MAX_VOICES ) {
+      Release( StealSlot( false ) );
+    }
+  }
+  if ( s < 0 ) {
+    if ( activeCount >= SAMPLER_MAX_VOICES + FADE_VOICES ) {
+      RemoveSlot( StealSlot( true ) );
+    }
+    s = activeCount;
+    while ( s > 0 && act.player[s - 1] > player ) {
+      act.player[s]      = act.player[s - 1];
+      act.samplePosF[s]  = act.samplePosF[s - 1];
+      act.vel[s]         = act.vel[s - 1];
+      act.decay[s]       = act.decay[s - 1];
+      act.pitch[s]       = act.pitch[s - 1];
+      act.pan[s]         = act.pan[s - 1];
+      act.volume[s]      = act.volume[s - 1];
+      act.pitchdecay[s]  = act.pitchdecay[s - 1];
+      act.signal[s]      = act.signal[s - 1];
+      act.data[s]        = act.data[s - 1];
+      act.sampleSize[s]  = act.sampleSize[s - 1];
+      act.interp[s]      = act.interp[s - 1];
+      act.fade[s]        = act.fade[s - 1];
+      act.choke[s]       = act.choke[s - 1];
+      act.bus[s]         = act.bus[s - 1];
+      act.age[s]         = act.age[s - 1];
+#ifdef SAMPLER_STREAM
+      act.resident[s]    = act.resident[s - 1];
+      act.stream[s]      = act.stream[s - 1];
+#endif
+#ifdef SAMPLER_ADPCM
+      act.decoder[s]     = act.decoder[s - 1];
+#endif
+      s--;
+    }
+#ifdef SAMPLER_STREAM
+    act.stream[s]      = STREAM_NONE;
+#endif
+    activeCount++;
+  }
+  samplePlayerS &p = samplePlayer[player];
+  act.player[s]      = player;
+  act.samplePosF[s]  = p.samplePosF;
+  act.vel[s]         = p.vel;
+  act.decay[s]       = p.decay;
+  act.pitch[s]       = p.pitch;
+  act.pan[s]         = p.pan;
+  act.volume[s]      = p.volume;
+  act.pitchdecay[s]  = p.pitchdecay;
+  act.signal[s]      = 0.0f;
+  act.data[s]        = kits[frontKit].data + p.sampleStart;
+  act.sampleSize[s]  = p.sampleSize;
+  act.interp[s]      = kits[frontKit].interpolation;
+  act.fade[s]        = 0;
+  act.choke[s]       = p.choke;
+  act.bus[s]         = p.bus;
+  act.age[s]         = hits++;
+#ifdef SAMPLER_STREAM
+  act.resident[s]    = 0xFFFFFFFF; // all from the cache, unless it gets a stream
+  StartStream( s, player );
+#endif
+#ifdef SAMPLER_ADPCM
+  uint32_t start = p.samplePosF;
+  act.decoder[s].Seek( act.data[s], start < p.sampleSize ? start : 0, p.sampleSize ); // from the seek point before an offset start
+#endif
+  p.active = true;
+}
+
+// fades a slot out over FADE_LEN samples, or faster if its own decay already is
+inline void Sampler::Release( int slot ) {
+  if ( act.fade[slot] > 0 ) return;
+  act.fade[slot] = FADE_LEN;
+  if ( act.decay[slot] > fadeDecay ) act.decay[slot] = fadeDecay;
+}
+
+// a hit in a choke group fades out the others in it, a retrigger of the same player restarts it anyway
+inline void Sampler::Choke( uint8_t group, int except ) {
+  for ( int s = 0; s < activeCount; s++ ) {
+    if ( act.choke[s] == group && act.player[s] != except ) Release( s );
+  }
+}
+
+// the quietest slot that is fading or not, the oldest of equally loud ones. There always is one when Activate() asks.
+inline int Sampler::StealSlot( bool fading ) {
+  int best = -1;
+  float level = 0.0f;
+  for ( int s = 0; s < activeCount; s++ ) {
+    if ( ( act.fade[s] > 0 ) != fading ) continue;
+    float l = act.volume[s] * act.vel[s];
+    if ( best < 0 || l < level || ( l == level && act.age[s] - act.age[best] > 0x80000000UL ) ) {
+      best = s;
+      level = l;
+    }
+  }
+  return best;
 }
 
+// frees a slot, the ones above move down so the list stays packed and in player order
+inline void Sampler::RemoveSlot( int slot ) {
+  int player = act.player[slot];
+#ifdef SAMPLER_STREAM
+  StopStream( slot );
+#endif
+  samplePlayer[player].active = false;
+  samplePlayer[player].samplePos = 0;
+  samplePlayer[player].samplePosF = 0.0f;
+  activeCount--;
+  for ( int s = slot; s < activeCount; s++ ) {
+    act.player[s]      = act.player[s + 1];
+    act.samplePosF[s]  = act.samplePosF[s + 1];
+    act.vel[s]         = act.vel[s + 1];
+    act.decay[s]       = act.decay[s + 1];
+    act.pitch[s]       = act.pitch[s + 1];
+    act.pan[s]         = act.pan[s + 1];
+    act.volume[s]      = act.volume[s + 1];
+    act.pitchdecay[s]  = act.pitchdecay[s + 1];
+    act.signal[s]      = act.signal[s + 1];
+    act.data[s]        = act.data[s + 1];
+    act.sampleSize[s]  = act.sampleSize[s + 1];
+    act.interp[s]      = act.interp[s + 1];
+    act.fade[s]        = act.fade[s + 1];
+    act.choke[s]       = act.choke[s + 1];
+    act.bus[s]         = act.bus[s + 1];
+    act.age[s]         = act.age[s + 1];
+#ifdef SAMPLER_STREAM
+    act.resident[s]    = act.resident[s + 1];
+    act.stream[s]      = act.stream[s + 1];
+#endif
+#ifdef SAMPLER_ADPCM
+    act.decoder[s]     = act.decoder[s + 1];
+#endif
+  }
+}
+
+#ifdef SAMPLER_STREAM
+// gives the slot a stream for the tail of its sample, or keeps the one it has on a retrigger.
+// With all the streams taken the hit plays the head only.
+inline void Sampler::StartStream( int slot, int player ) {
+  samplePlayerS &p = samplePlayer[player];
+  int k = act.stream[slot];
+  if ( p.resident >= p.sampleSize ) {
+    StopStream( slot );
+    return;
+  }
+  for ( int i = 0; k == STREAM_NONE && i < SAMPLER_STREAM_VOICES; i++ ) {
+    if ( streams[i].sample.load(std::memory_order_relaxed) == STREAM_NONE ) {
+      k = i;
+      streamsTaken++;
+    }
+  }
+  if ( k == STREAM_NONE ) {
+    act.sampleSize[slot] = p.resident;
+    return;
+  }
+  act.resident[slot] = p.resident;
+  // the image's guard covers the taps past the end. The prefetch task takes the request from here on
+  streams[k].Request( frontKit, player, p.resident - STREAM_PAD, p.sampleSize + KIT_IMAGE_GUARD );
+  act.stream[slot] = k;
+}
+
+inline void Sampler::StopStream( int slot ) {
+  int k = act.stream[slot];
+  if ( k == STREAM_NONE ) return;
+  streams[k].Request( 0, STREAM_NONE, 0, 0 );
+  streamsTaken--;
+  act.stream[slot] = STREAM_NONE;
+}
+
+// brings every taken stream's ring up to its voice's position plus the read-ahead. Runs in the prefetch task,
+// or at block boundaries in the audio task where there is none (host build).
+void Sampler::Prefetch() {
+  const uint32_t ahead = streamAhead.load(std::memory_order_relaxed);
+  for ( int k = 0; k < SAMPLER_STREAM_VOICES; k++ ) {
+    SampleStream &st = streams[k];
+    uint8_t kit, sample;
+    uint32_t from, end, g;
+    while ( !st.Take( kit, sample, from, end, g ) ) {} // the audio task is a few stores from done
+    if ( sample == STREAM_NONE ) {
+      continue;
+    }
+    if ( st.ready.load(std::memory_order_relaxed) != g ) {
+      st.filled.store( from, std::memory_order_relaxed );
+      st.ready.store( g, std::memory_order_release );
+    }
+    kitS &src = kits[kit];
+    uint32_t fl = st.filled.load(std::memory_order_relaxed);
+    while ( fl < end && fl + STREAM_CHUNK <= st.consumed.load(std::memory_order_relaxed) + ahead ) {
+      streamReading.store( kit ); // CheckKit() doesn't hand the kit to the loader while this is set
+      if ( st.gen.load(std::memory_order_acquire) != g ) {
+        break;
+      }
+      int16_t chunk[ STREAM_CHUNK ];
+      int n = ( end - fl < STREAM_CHUNK ) ? end - fl : STREAM_CHUNK;
+      src.image.seek( src.imageOffset + ( src.imageStart[sample] + fl ) * 2 );
+      if ( src.image.read( (uint8_t*)chunk, n * 2 ) != (size_t)n * 2 ) {
+        memset( chunk, 0, sizeof(chunk) );
+      }
+      st.Store( fl, chunk, n );
+      fl += n;
+      st.filled.store( fl, std::memory_order_release );
+    }
+    streamReading.store( -1 );
+  }
+}
+
+void Sampler::StreamTask( void *param ) {
+  Sampler *sampler = (Sampler*)param;
+  while (true) {
+    if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY)) {
+      sampler->Prefetch();
+    }
+  }
+}
+#endif
+
 inline void Sampler::NoteOff( uint8_t note ) {
   /*
      nothing to do yet
@@ -489,9 +1114,50 @@ void Sampler::SetPlaybackSpeed( float value ) {
   sampler_playback = value;
 }
 
+void Sampler::SetInterpolation( uint8_t mode ) {
+  if ( mode >= INTERP_MODES ) mode = INTERP_SINC;
+  kits[frontKit].interpolation = mode; // hits already sounding keep theirs
+#ifdef DEBUG_SAMPLER
+  DEBF("[sampler]: kit %d interpolation %d\r\n", progNumber, mode);
+#endif
+}
+
 void Sampler::SetProgram( uint8_t prog ) {
-  progNumber = prog ;
-  Init();
+  if ( kits[frontKit ^ 1].data == NULL ) {
+    DEBUG("[sampler]: all the kits are loaded already"); // PRELOAD_ALL, notes select the kit
+    return;
+  }
+  kitRequest.store(prog);
+  if ( kitLoader != NULL ) {
+    xTaskNotifyGive(kitLoader);
+  } else {
+    LoadRequestedKit(); // no loader task (host build), the swap still waits for the next block
+  }
+}
+
+// call at block boundaries from the task that renders the drums: swaps in a kit the loader has finished
+// and frees the back region for the next load once no voice plays from it anymore
+inline void Sampler::CheckKit() {
+  if ( kitLoader == NULL && kitRequest.load() >= 0 ) {
+    LoadRequestedKit();
+  }
+  if ( kitReady.load(std::memory_order_acquire) ) {
+    frontKit ^= 1;
+    InstallKit();
+    backFree.store(false, std::memory_order_release);
+    kitReady.store(false, std::memory_order_release);
+  }
+  if ( !backFree.load(std::memory_order_relaxed) ) {
+    const sample_t* from = kits[frontKit ^ 1].data;
+    const sample_t* to = from + kits[frontKit ^ 1].frames;
+    for ( int s = 0; s < activeCount; s++ ) {
+      if ( act.data[s] >= from && act.data[s] < to ) return;
+    }
+#ifdef SAMPLER_STREAM
+    if ( streamReading.load() == ( frontKit ^ 1 ) ) return; // the prefetch task is still at its image
+#endif
+    backFree.store(true, std::memory_order_release);
+  }
 }
 
 
@@ -535,6 +1201,27 @@ inline void Sampler::ParseCC(uint8_t cc_number , uint8_t cc_value) {
     case CC_808_NOTE_SEL:
       SelectNote( cc_value );
       break;
+    case CC_808_INTERPOLATION:
+      SetInterpolation( cc_value >> 5 );
+      break;
+    case CC_808_NOTE_CHOKE:
+      SetNoteChoke_Midi( cc_value );
+      break;
+    case CC_808_NOTE_BUS:
+      SetNoteBus_Midi( cc_value );
+      break;
+    case CC_808_BUS_PAN:
+      SetBusPan_Midi( cc_value );
+      break;
+    case CC_808_BUS_DELAY:
+      SetBusDelay_Midi( cc_value );
+      break;
+    case CC_808_BUS_REVERB:
+      SetBusReverb_Midi( cc_value );
+      break;
+    case CC_808_BUS_SIDECHAIN:
+      SetBusSide_Midi( cc_value );
+      break;
     case CC_808_BD_DECAY:
       SelectNote( 0 ); // BD
       SetNoteDecay_Midi( cc_value );
@@ -606,53 +1293,50 @@ inline void Sampler::Process( float *left, float *right ) {
   //signal_r += slowRelease;
 
   //slowRelease = slowRelease * 0.99; // go slowly to zero
+  for ( int b = 0; b < DRUM_BUSES; b++ ) {
+    busL[b][0] = 0.0f;
+    busR[b][0] = 0.0f;
+  }
 
-  for ( int i = 0; i < sampleInfoCount; i++ ) {
-
-    if ( samplePlayer[i].active  ) {
-      samplePlayer[i].samplePos = samplePlayer[i].samplePosF;
-      samplePlayer[i].samplePos -= samplePlayer[i].samplePos % 2;
-
-      uint32_t dataOut = samplePlayer[i].samplePos;
-      //  DEBUG(dataOut);
-
-      //
-      // reconstruct signal from data
-      //
-      uint8_t byte2 , byte1;
-      union {
-        uint16_t u16;
-        int16_t s16;
-      } sampleU;
-      byte1 = RamCache[samplePlayer[i].sampleStart + dataOut];
-      byte2 = RamCache[samplePlayer[i].sampleStart + dataOut + 1];
-      sampleU.s16 = (((uint16_t)byte2) << 8U) + (uint16_t)byte1;
-
-      samplePlayer[i].signal = (float)(samplePlayer[i].volume) * ((float)sampleU.s16) * 0.00005f;
-
-      signal_l += samplePlayer[i].signal * samplePlayer[i].vel * ( 1 - samplePlayer[i].pan );
+#ifdef SAMPLER_STREAM
+  if ( streamsTaken > 0 && streamer == NULL ) {
+    Prefetch();
+  }
+#endif
+  // only the sounding players, slot by slot in player order
+  for ( int s = 0; s < activeCount; ) {
+    uint32_t samplePos = act.samplePosF[s]; // in frames
+
+#ifdef SAMPLER_ADPCM
+    const tap_t* taps = act.decoder[s].Window( act.data[s], samplePos, InterpAhead( act.interp[s] ) );
+#elif defined(SAMPLER_STREAM)
+    const tap_t* taps = ( samplePos < act.resident[s] ) ? act.data[s] + samplePos : streams[ act.stream[s] ].Window( samplePos, underruns );
+    if ( act.stream[s] != STREAM_NONE ) streams[ act.stream[s] ].consumed.store( samplePos, std::memory_order_relaxed );
+#else
+    const tap_t* taps = act.data[s] + samplePos;
+#endif
+    float x = Interpolate( act.interp[s], taps, act.samplePosF[s] - samplePos );
+    act.signal[s] = (float)(act.volume[s]) * x * 0.00005f;
 
-      signal_r += samplePlayer[i].signal * samplePlayer[i].vel *  samplePlayer[i].pan;
+    busL[ act.bus[s] ][0] += act.signal[s] * act.vel[s] * ( 1 - act.pan[s] );
 
-      samplePlayer[i].vel *= samplePlayer[i].decay;
+    busR[ act.bus[s] ][0] += act.signal[s] * act.vel[s] *  act.pan[s];
 
-      samplePlayer[i].samplePos += 2; // we have consumed two bytes
+    act.vel[s] *= act.decay[s];
 
-      if ( samplePlayer[i].pitchdecay > 0.0f ) {
-        samplePlayer[i].samplePosF += 2.0f * sampler_playback * ( samplePlayer[i].pitch + samplePlayer[i].pitchdecay * samplePlayer[i].vel ); // we have consumed two bytes
-      } else {
-        samplePlayer[i].samplePosF += 2.0f * sampler_playback * ( samplePlayer[i].pitch + samplePlayer[i].pitchdecay * (1 - samplePlayer[i].vel) ); // we have consumed two bytes
-      }
+    if ( act.pitchdecay[s] > 0.0f ) {
+      act.samplePosF[s] += sampler_playback * ( act.pitch[s] + act.pitchdecay[s] * act.vel[s] );
+    } else {
+      act.samplePosF[s] += sampler_playback * ( act.pitch[s] + act.pitchdecay[s] * (1 - act.vel[s]) );
+    }
 
- //     samplePlayer[i].samplePosF += 2.0f * sampler_playback * ( samplePlayer[i].pitch  ); // we have consumed two bytes
-      if ( samplePlayer[i].samplePos >= samplePlayer[i].sampleSize ) {
-        samplePlayer[i].active = false;
-        
-        samplePlayer[i].samplePos = 0;
-        samplePlayer[i].samplePosF = 0.0f;
-      }
+    if ( samplePos + 1 >= act.sampleSize[s] || ( act.fade[s] > 0 && --act.fade[s] == 0 ) ) {
+      RemoveSlot( s ); // the next slot moves down into s
+    } else {
+      s++;
     }
   }
+  MixBuses( &signal_l, &signal_r, 1, NULL, 0 );
   Effects.Process( &signal_l, &signal_r );
  // *left  = signal_l * _volume;
  // *right =  signal_r * _volume;
@@ -661,3 +1345,142 @@ inline void Sampler::Process( float *left, float *right ) {
   // *left  = fast_shape(signal_l * _volume);
   // *right = fast_shape(signal_r * _volume);
 }
+
+// Process() for len samples at once: each sounding player renders its whole run into its bus, the buses
+// get mixed in one pass, then the filter and crusher go over the sum. Players are added in the same order
+// as in Process(). The sends, if asked for, get the buses' share before the filter, scaled by the volume.
+inline void Sampler::ProcessBlock( float *left, float *right, int len, const DrumSends *sends ) {
+  for ( int done = 0; done < len; done += DMA_BUF_LEN ) { // the buses hold one DMA buffer
+    const int n = ( len - done < DMA_BUF_LEN ) ? len - done : DMA_BUF_LEN;
+#ifdef SAMPLER_STREAM
+    if ( streamsTaken > 0 ) {
+      if ( streamer != NULL ) {
+        xTaskNotifyGive( streamer ); // reads while this block renders, the read-ahead covers that
+      } else {
+        Prefetch();
+      }
+    }
+#endif
+    for ( int b = 0; b < DRUM_BUSES; b++ ) {
+      for ( int i = 0; i < n; i++ ) {
+        busL[b][i] = 0.0f;
+        busR[b][i] = 0.0f;
+      }
+    }
+    for ( int s = 0; s < activeCount; ) {
+      float *l = busL[ act.bus[s] ], *r = busR[ act.bus[s] ];
+      bool ended;
+      switch ( act.interp[s] ) {
+        case INTERP_LINEAR:   ended = RenderRun<INTERP_LINEAR>( s, l, r, n );   break;
+        case INTERP_HERMITE:  ended = RenderRun<INTERP_HERMITE>( s, l, r, n );  break;
+        case INTERP_SINC:     ended = RenderRun<INTERP_SINC>( s, l, r, n );     break;
+        default:              ended = RenderRun<INTERP_NONE>( s, l, r, n );     break;
+      }
+      if ( ended ) {
+        RemoveSlot( s ); // the next slot moves down into s
+      } else {
+        s++;
+      }
+    }
+    MixBuses( left + done, right + done, n, sends, done );
+    Effects.ProcessBlock( left + done, right + done, n );
+    for ( int i = done; i < done + n; i++ ) {
+      left[i]  = fclamp(left[i] * _volume, -1.0f, 1.0f);
+      right[i] = fclamp(right[i] * _volume, -1.0f, 1.0f);
+    }
+  }
+}
+
+// sums the buses into left and right, and into the sends at offset at if there are any
+inline void Sampler::MixBuses( float *left, float *right, int len, const DrumSends *sends, int at ) {
+  float gl[ DRUM_BUSES ], gr[ DRUM_BUSES ], dly[ DRUM_BUSES ], rvb[ DRUM_BUSES ], side[ DRUM_BUSES ];
+  for ( int b = 0; b < DRUM_BUSES; b++ ) {
+    gl[b] = buses[b].gain_l;
+    gr[b] = buses[b].gain_r;
+    dly[b] = buses[b].delay * _sendDelay * _volume;
+    rvb[b] = buses[b].reverb * _sendReverb * _volume;
+    side[b] = buses[b].side * 0.5f * _volume;
+  }
+  for ( int i = 0; i < len; i++ ) {
+    float l = 0.0f, r = 0.0f, dl = 0.0f, dr = 0.0f, rl = 0.0f, rr = 0.0f, sc = 0.0f;
+    for ( int b = 0; b < DRUM_BUSES; b++ ) {
+      float bl = busL[b][i] * gl[b], br = busR[b][i] * gr[b];
+      l += bl;
+      r += br;
+      dl += dly[b] * bl;
+      dr += dly[b] * br;
+      rl += rvb[b] * bl;
+      rr += rvb[b] * br;
+      sc += side[b] * ( bl + br );
+    }
+    left[i] = l;
+    right[i] = r;
+    if ( sends ) {
+      sends->delay_l[at + i] = dl;
+      sends->delay_r[at + i] = dr;
+      sends->reverb_l[at + i] = rl;
+      sends->reverb_r[at + i] = rr;
+      sends->side[at + i] = sc;
+    }
+  }
+}
+
+// one slot's run through the block with its state in locals, true if the sample ended
+template <int MODE>
+inline bool Sampler::RenderRun( int s, float *left, float *right, int len ) {
+  const float playback = sampler_playback;
+  const sample_t* data = act.data[s];
+  const uint32_t sampleSize = act.sampleSize[s];
+#ifdef SAMPLER_STREAM
+  const uint32_t resident = act.resident[s];
+  SampleStream *stream = ( act.stream[s] != STREAM_NONE ) ? &streams[ act.stream[s] ] : NULL;
+#endif
+  const float volume = act.volume[s], decay = act.decay[s], pitch = act.pitch[s], pitchdecay = act.pitchdecay[s];
+  const float pan_l = 1 - act.pan[s], pan_r = act.pan[s];
+  float samplePosF = act.samplePosF[s];
+  float vel = act.vel[s];
+  float signal = act.signal[s];
+#ifdef SAMPLER_ADPCM
+  AdpcmDecoder decoder = act.decoder[s];
+#endif
+  const int fade = act.fade[s];
+  const int n = ( fade > 0 && fade < len ) ? fade : len; // a fading hit ends where its fade does
+  bool ended = false;
+  for ( int i = 0; i < n; i++ ) {
+    uint32_t samplePos = samplePosF;
+#ifdef SAMPLER_ADPCM
+    const tap_t* taps = decoder.Window( data, samplePos, InterpAhead( MODE ) );
+#elif defined(SAMPLER_STREAM)
+    const tap_t* taps = ( samplePos < resident ) ? data + samplePos : stream->Window( samplePos, underruns );
+#else
+    const tap_t* taps = data + samplePos;
+#endif
+    signal = volume * Interpolate<MODE>( taps, samplePosF - samplePos ) * 0.00005f;
+    left[i]  += signal * vel * pan_l;
+    right[i] += signal * vel * pan_r;
+    vel *= decay;
+    if ( pitchdecay > 0.0f ) {
+      samplePosF += playback * ( pitch + pitchdecay * vel );
+    } else {
+      samplePosF += playback * ( pitch + pitchdecay * (1 - vel) );
+    }
+    if ( samplePos + 1 >= sampleSize ) {
+      ended = true;
+      break;
+    }
+  }
+  if ( fade > 0 && !ended ) {
+    ended = ( fade <= len );
+    act.fade[s] = fade - n;
+  }
+  act.samplePosF[s] = samplePosF;
+  act.vel[s] = vel;
+  act.signal[s] = signal;
+#ifdef SAMPLER_STREAM
+  if ( stream ) stream->consumed.store( (uint32_t)samplePosF, std::memory_order_relaxed );
+#endif
+#ifdef SAMPLER_ADPCM
+  act.decoder[s] = decoder;
+#endif
+  return ended;
+}
@@ -0,0 +1,240 @@
+/*
+ * SynthKernel: the audio rate stages of several 303 voices in one loop.
+ *
+ * SynthVoice::ProcessBlock() runs its stages voice after voice, and each stage is a recurrence that waits
+ * for its own previous sample. The kernel takes the stage state of up to SYNTH_KERNEL_LANES voices into
+ * structure-of-arrays lanes and advances all lanes together, sample by sample, inside every stage. So the
+ * independent recurrences of the voices interleave, and a host compiler can put the lanes in SIMD registers.
+ *
+ * Per block: Load() the voices, Control() each voice between its MIDI events, then Process(). Control() runs
+ * the voice's own control part (envelopes, oscillator, cutoff declicker, TeeBee coefficients, drive settings) and
+ * records it per sample, so the voices' events need not line up and the output is bit-identical to ProcessBlock().
+ * Process() renders the audio stages of the whole block and gives the state back to the voices, because the
+ * load balancer may move a voice to the other core between blocks.
+ */
+#ifndef SYNTH_KERNEL_H
+#define SYNTH_KERNEL_H
+
+#if FILTER_TYPE != 2
+#error "SynthKernel implements the Open303 filter, FILTER_TYPE 2"
+#endif
+
+class SynthKernel {
+  public:
+    SynthKernel() {}
+
+    // takes over the stage state of count voices (1 .. SYNTH_KERNEL_LANES), spare lanes shadow the first voice
+    inline void Load(SynthVoice* const* voices, int count) {
+      _count = count;
+      for (int l = 0; l < LANES; l++) {
+        _voices[l] = voices[(l < count) ? l : 0];
+        SynthVoice& v = *_voices[l];
+        load(_ampDeclicker, l, v.ampDeclicker);
+        load(_highpass1, l, v.highpass1);
+        load(_allpass, l, v.allpass);
+        load(_feedbackHighpass, l, v.Filter.feedbackHighpass);
+        load(_highpass2, l, v.highpass2);
+        load(_notch, l, v.notch);
+        _y1[l] = v.Filter.y1;
+        _y2[l] = v.Filter.y2;
+        _y3[l] = v.Filter.y3;
+        _y4[l] = v.Filter.y4;
+      }
+    }
+
+    // control part of voice l for samples from .. to-1, in the same sub-blocks as SynthVoice::ProcessBlock()
+    inline void Control(int l, int from, int to) {
+      SynthVoice& v = *_voices[l];
+      float osc[SYNTH_SUBBLOCK], cut[SYNTH_SUBBLOCK], amp[SYNTH_SUBBLOCK], comp[SYNTH_SUBBLOCK];
+      while (from < to) {
+        int len = v.renderControl(osc, cut, amp, comp, to - from);
+        v.filtDeclicker.processBlock(cut, len);
+        filterCoefficients(l, v.Filter, cut, from, len);
+        for (int i = 0; i < len; i++) {
+          _sig[from + i][l] = osc[i];
+          _amp[from + i][l] = amp[i];
+          _comp[from + i][l] = comp[i];
+          _preGain[from + i][l] = v.Drive._pre_gain;
+          _postGain[from + i][l] = v.Drive._post_gain;
+          _foldGain[from + i][l] = v.Distortion.gain_;
+          _foldOffset[from + i][l] = v.Distortion.offset_;
+        }
+        from += len;
+      }
+    }
+
+    // audio rate part of the block, out[l] is the buffer of voice l, then the state goes back to the voices
+    inline void Process(float* const* out) {
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        for (int l = _count; l < LANES; l++) {    // a shadow lane repeats lane 0, which keeps its arithmetic normal
+          _sig[i][l] = _sig[i][0];
+          _amp[i][l] = _amp[i][0];
+          _comp[i][l] = _comp[i][0];
+          _b0[i][l] = _b0[i][0];
+          _k[i][l] = _k[i][0];
+          _g[i][l] = _g[i][0];
+          _preGain[i][l] = _preGain[i][0];
+          _postGain[i][l] = _postGain[i][0];
+          _foldGain[i][l] = _foldGain[i][0];
+          _foldOffset[i][l] = _foldOffset[i][0];
+        }
+      }
+
+      // one loop per stage, all lanes per sample
+      processBiquad(_ampDeclicker, _comp);
+      processOnePole(_highpass1, _sig);         // pre-filter highpass, following open303
+      processOnePole(_allpass, _sig);           // phase correction, following open303
+      processFilter();                          // main filter
+      processOnePole(_highpass2, _sig);         // post-filtering, following open303
+      processBiquad(_notch, _sig);              // post-filtering, following open303
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        for (int l = 0; l < LANES; l++) {
+          float pre = (float)(_preGain[i][l] * _sig[i][l] * 2.0f);     // overdrive
+          float x = (float)(fast_shape(pre) * _postGain[i][l]);
+          x += _foldOffset[i][l];                                   // distortion
+          x *= _foldGain[i][l];
+          float ft = floorf((x + 1.0f) * 0.5f);
+          float sgn = (static_cast<int>(ft) % 2 == 0) ? 1.0f : -1.0f;
+          _sig[i][l] = sgn * (x - 2.0f * ft) * _amp[i][l] * _comp[i][l]; // amp envelope and compensation
+        }
+      }
+
+      for (int l = 0; l < _count; l++) {
+        SynthVoice& v = *_voices[l];
+        for (int i = 0; i < DMA_BUF_LEN; i++) out[l][i] = _sig[i][l];
+        v._compens = _comp[DMA_BUF_LEN - 1][l];
+        store(_ampDeclicker, l, v.ampDeclicker);
+        store(_highpass1, l, v.highpass1);
+        store(_allpass, l, v.allpass);
+        store(_feedbackHighpass, l, v.Filter.feedbackHighpass);
+        store(_highpass2, l, v.highpass2);
+        store(_notch, l, v.notch);
+        v.Filter.y1 = _y1[l];
+        v.Filter.y2 = _y2[l];
+        v.Filter.y3 = _y3[l];
+        v.Filter.y4 = _y4[l];
+      }
+    }
+
+  private:
+    static const int LANES = SYNTH_KERNEL_LANES;
+
+    // the filters' coefficients do not change after SynthVoice::Init(), only their state is carried from block to block
+    struct OnePoleLanes { float b0[LANES], b1[LANES], a1[LANES], x1[LANES], y1[LANES]; };
+    struct BiquadLanes  { float b0[LANES], b1[LANES], b2[LANES], a1[LANES], a2[LANES], x1[LANES], x2[LANES], y1[LANES], y2[LANES]; };
+
+    static inline void load(OnePoleLanes& s, int l, const OnePoleFilter& f) {
+      s.b0[l] = f.b0; s.b1[l] = f.b1; s.a1[l] = f.a1;
+      s.x1[l] = f.x1; s.y1[l] = f.y1;
+    }
+    static inline void store(const OnePoleLanes& s, int l, OnePoleFilter& f) { f.x1 = s.x1[l]; f.y1 = s.y1[l]; }
+    static inline void load(BiquadLanes& s, int l, const BiquadFilter& f) {
+      s.b0[l] = f.b0; s.b1[l] = f.b1; s.b2[l] = f.b2; s.a1[l] = f.a1; s.a2[l] = f.a2;
+      s.x1[l] = f.x1; s.x2[l] = f.x2; s.y1[l] = f.y1; s.y2[l] = f.y2;
+    }
+    static inline void store(const BiquadLanes& s, int l, BiquadFilter& f) { f.x1 = s.x1[l]; f.x2 = s.x2[l]; f.y1 = s.y1[l]; f.y2 = s.y2[l]; }
+
+    // the b0, k, g trajectory of TeeBeeFilter::ProcessBlock(): calculated at the control points, interpolated in between
+    inline void filterCoefficients(int l, TeeBeeFilter& f, const float* cut, int from, int len) {
+      int n = 0;
+      while (n < len) {
+        int seg = len - n;
+        if (seg > FILTER_CONTROL_RATE) seg = FILTER_CONTROL_RATE;
+        float b0 = f.b0, k = f.k, g = f.g;
+        f.SetCutoff(cut[n + seg - 1]);
+        float step = one_div((float)seg);
+        float db0 = (f.b0 - b0) * step, dk = (f.k - k) * step, dg = (f.g - g) * step;
+        for (int i = 1; i < seg; i++) {
+          b0 += db0;
+          k  += dk;
+          g  += dg;
+          _b0[from + n][l] = b0; _k[from + n][l] = k; _g[from + n][l] = g;
+          n++;
+        }
+        _b0[from + n][l] = f.b0; _k[from + n][l] = f.k; _g[from + n][l] = f.g;   // land exactly on the control point
+        n++;
+      }
+    }
+
+    // same arithmetic as OnePoleFilter::processBlock()
+    static inline void processOnePole(OnePoleLanes& f, float (*buf)[LANES]) {
+      float b0[LANES], b1[LANES], a1[LANES], x1[LANES], y1[LANES];   // locals, so the compiler sees they don't alias buf
+      for (int l = 0; l < LANES; l++) { b0[l] = f.b0[l]; b1[l] = f.b1[l]; a1[l] = f.a1[l]; x1[l] = f.x1[l]; y1[l] = f.y1[l]; }
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        for (int l = 0; l < LANES; l++) {
+          float in = buf[i][l];
+          y1[l] = (float)b0[l] * in + b1[l] * x1[l] + a1[l] * y1[l] + (float)1.1e-38;
+          x1[l] = in;
+          buf[i][l] = y1[l];
+        }
+      }
+      for (int l = 0; l < LANES; l++) { f.x1[l] = x1[l]; f.y1[l] = y1[l]; }
+    }
+
+    // same arithmetic as BiquadFilter::processBlock()
+    static inline void processBiquad(BiquadLanes& f, float (*buf)[LANES]) {
+      float b0[LANES], b1[LANES], b2[LANES], a1[LANES], a2[LANES], x1[LANES], x2[LANES], y1[LANES], y2[LANES];
+      for (int l = 0; l < LANES; l++) {
+        b0[l] = f.b0[l]; b1[l] = f.b1[l]; b2[l] = f.b2[l]; a1[l] = f.a1[l]; a2[l] = f.a2[l];
+        x1[l] = f.x1[l]; x2[l] = f.x2[l]; y1[l] = f.y1[l]; y2[l] = f.y2[l];
+      }
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        for (int l = 0; l < LANES; l++) {
+          float in = buf[i][l];
+          float y = b0[l]*in + b1[l]*x1[l] + b2[l]*x2[l] + a1[l]*y1[l] + a2[l]*y2[l] + TINY;
+          x2[l] = x1[l];
+          x1[l] = in;
+          y2[l] = y1[l];
+          y1[l] = y;
+          buf[i][l] = y;
+        }
+      }
+      for (int l = 0; l < LANES; l++) { f.x1[l] = x1[l]; f.x2[l] = x2[l]; f.y1[l] = y1[l]; f.y2[l] = y2[l]; }
+    }
+
+    // TeeBeeFilter::Process() in TB_303 mode, with the feedback highpass inlined
+    inline void processFilter() {
+      OnePoleLanes& f = _feedbackHighpass;
+      float b0[LANES], b1[LANES], a1[LANES], x1[LANES], y1[LANES];
+      float s1[LANES], s2[LANES], s3[LANES], s4[LANES];
+      for (int l = 0; l < LANES; l++) {
+        b0[l] = f.b0[l]; b1[l] = f.b1[l]; a1[l] = f.a1[l]; x1[l] = f.x1[l]; y1[l] = f.y1[l];
+        s1[l] = _y1[l]; s2[l] = _y2[l]; s3[l] = _y3[l]; s4[l] = _y4[l];
+      }
+      for (int i = 0; i < DMA_BUF_LEN; i++) {
+        for (int l = 0; l < LANES; l++) {
+          float b = _b0[i][l];
+          float fb = _k[i][l] * s4[l];
+          y1[l] = (float)b0[l] * fb + b1[l] * x1[l] + a1[l] * y1[l] + (float)1.1e-38;
+          x1[l] = fb;
+          float y0 = _sig[i][l] - y1[l];
+          s1[l] += 2*b*(y0-s1[l]+s2[l]);
+          s2[l] +=   b*(s1[l]-2*s2[l]+s3[l]);
+          s3[l] +=   b*(s2[l]-2*s3[l]+s4[l]);
+          s4[l] +=   b*(s3[l]-2*s4[l]);
+          _sig[i][l] = 2*_g[i][l]*s4[l];
+        }
+      }
+      for (int l = 0; l < LANES; l++) {
+        f.x1[l] = x1[l]; f.y1[l] = y1[l];
+        _y1[l] = s1[l]; _y2[l] = s2[l]; _y3[l] = s3[l]; _y4[l] = s4[l];
+      }
+    }
+
+    SynthVoice* _voices[LANES];
+    int _count = 0;
+
+    // the signal and what Control() recorded, [sample][lane]
+    float _sig[DMA_BUF_LEN][LANES];
+    float _amp[DMA_BUF_LEN][LANES];
+    float _comp[DMA_BUF_LEN][LANES];
+    float _b0[DMA_BUF_LEN][LANES], _k[DMA_BUF_LEN][LANES], _g[DMA_BUF_LEN][LANES];   // TeeBee coefficients
+    float _preGain[DMA_BUF_LEN][LANES], _postGain[DMA_BUF_LEN][LANES];               // overdrive
+    float _foldGain[DMA_BUF_LEN][LANES], _foldOffset[DMA_BUF_LEN][LANES];            // wavefolder
+
+    BiquadLanes   _ampDeclicker, _notch;
+    OnePoleLanes  _highpass1, _allpass, _feedbackHighpass, _highpass2;
+    float _y1[LANES], _y2[LANES], _y3[LANES], _y4[LANES];   // TeeBee ladder
+};
+
+#endif
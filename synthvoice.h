@@ -10,6 +10,7 @@
 
 
 #define MIDI_MVA_SZ 8
+#define SYNTH_SUBBLOCK  DMA_BUF_LEN   // ProcessBlock() works in chunks of this many samples (stack arrays of this size)
 #if FILTER_TYPE == 0
 #include "moogladder.h"
 #endif
@@ -39,7 +40,7 @@ typedef struct
 
 class SynthVoice {
 public:
-  SynthVoice();
+  SynthVoice() {};
   SynthVoice(uint8_t ind) {_index = ind;};
   void Init();
   inline void on_midi_noteON(uint8_t note, uint8_t velocity);
@@ -67,6 +68,8 @@ public:
   inline float GetPan()                 {return _pan;}
   inline float GetVolume()              {return _volume;}
   inline float getSample() ;
+  inline void ProcessBlock(float* out, size_t n); // same output as n getSample() calls, stage by stage
+  friend class SynthKernel;                       // renders the stages of several voices at once, see synth_kernel.h
   float _sendDelay = 0.0f;
   float _sendReverb = 0.0f;
   int midiNotes[2] = {-1, -1};
@@ -119,7 +122,6 @@ private:
   uint8_t _midiNote = 69;
   float  _currentStep = 1.0f;
   float  _subStep = 4.0f;
-  int    _wave_cnt = 0;
   float  _currentPeriod = 1.0f; // should be int (trying to come exactly to 0 phase)
   float  _avgStep = 1.0f;
   float  _avgPeriod = 1.0f; // measured in samples
@@ -128,6 +130,12 @@ private:
   float  _deltaStep = 0.0f;
   float  _slideMs = 60.0f;
   float  _phaze = 0.0f;
+  int32_t _waveOct = -1;          // band-limited waveform: the shared mipmap level _waveOct, see lookupWave()
+  const float* _waveTable = nullptr; // that level, its length - 1 and its length / TABLE_SIZE
+  int32_t _waveMask = TABLE_MASK;
+  float  _waveScale = 1.0f;
+  float  _waveSaw = 1.0f;         // their exp-saw and exp-square shares, from _waveMix
+  float  _waveSquare = 0.0f;
   float  _tuning = 1.0f;
   float  _effectiveStep = 1.0f;
   float  _pitchbend = 1.0f;
@@ -164,6 +172,10 @@ private:
   void note_off() ;
   void note_on(uint8_t midiNote, bool slide, bool accent) ;
   inline void calcEnvModScalerAndOffset();
+  inline float oscSample();               // blended waveform at the current phase
+  inline void updateWave();               // follows the octave of _currentStep and _waveMix
+  inline void advancePhase();             // slide and phase increment, once per sample
+  inline int renderControl(float* out, float* cut, float* amp, float* comp, int len); // oscillator and the per-sample controls of up to len samples, returns how many
  // Smoother          ampDeclicker;
  // Smoother          filtDeclicker;
 
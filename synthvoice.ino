@@ -70,9 +70,9 @@ inline float SynthVoice::getSample() {
   float samp = 0.0f, filtEnv = 0.0f, ampEnv = 0.0f, final_cut = 0.0f;
     filtEnv = GetFilterEnv();
     ampEnv = GetAmpEnv();
+    updateWave();
     if (_eAmpEnvState != ENV_IDLE) {
-      // samp = (float)((1.0f - _waveMix) * lookupTable(*(tables[_waveBase]), _phaze)) + (float)(_waveMix * lookupTable(*(tables[_waveBase+1]), _phaze)) ; // lookup and blend waveforms
-      samp = (float)((1.0f - _waveMix) * lookupTable(exp_square_tbl, _phaze)) + (float)(_waveMix * lookupTable(saw_tbl, _phaze)) ; // lookup and blend waveforms
+      samp = oscSample();
     } else {
       samp = 0.0f;
     }
@@ -103,6 +103,95 @@ inline float SynthVoice::getSample() {
     
     samp *=  _compens;
 
+    advancePhase();
+    
+    //synth_buf[_index][i] = fast_shape(samp); // mono limitter
+    return  samp;
+  
+}
+
+
+inline int SynthVoice::renderControl(float* out, float* cut, float* amp, float* comp, int len) {
+  float ph[SYNTH_SUBBLOCK];    // oscillator phase
+  bool  gate[SYNTH_SUBBLOCK];  // amp envelope running
+  if (len > SYNTH_SUBBLOCK) len = SYNTH_SUBBLOCK;
+
+  // envelopes, cutoff trajectory, oscillator phase
+  updateWave();
+  for (int i = 0; i < len; i++) {
+    if (mipmapOctave(_currentStep) != _waveOct) { // slid into another octave, the next call moves on to its level
+      len = i;
+      break;
+    }
+    float filtEnv = GetFilterEnv();
+    amp[i] = GetAmpEnv();
+    gate[i] = (_eAmpEnvState != ENV_IDLE);
+    ph[i] = _phaze;
+    cut[i] = (float)_filter_freq * ( (float)_envMod * ((float)filtEnv - 0.2f) + 1.3f * (float)_accentation + 1.0f );
+    comp[i] = _volume * 8.0f  * _fx_compens ;
+    advancePhase();
+  }
+
+  // oscillator: band-limited lookup of the blended waveform, same as oscSample()
+  lookupWaveBlock(_waveTable, _waveMask, _waveScale, _waveSaw, _waveSquare, ph, out, len);
+  for (int i = 0; i < len; i++) {
+    if (!gate[i]) out[i] = 0.0f;
+  }
+  return len;
+}
+
+
+inline void SynthVoice::ProcessBlock(float* out, size_t n) {
+  float cut[SYNTH_SUBBLOCK];   // cutoff trajectory
+  float amp[SYNTH_SUBBLOCK];   // amp envelope
+  float comp[SYNTH_SUBBLOCK];  // volume/fx compensation, declicked
+  while (n > 0) {
+    // control rate part, up to the end of the sub-block or to an octave change of the oscillator
+    int len = renderControl(out, cut, amp, comp, (n > SYNTH_SUBBLOCK) ? SYNTH_SUBBLOCK : (int)n);
+    filtDeclicker.processBlock(cut, len);
+    ampDeclicker.processBlock(comp, len);
+
+    // audio rate part: one tight loop per stage
+    highpass1.processBlock(out, len);         // pre-filter highpass, following open303
+    allpass.processBlock(out, len);           // phase correction, following open303
+#if FILTER_TYPE == 2
+    Filter.ProcessBlock(out, cut, len);       // main filter
+#else
+    for (int i = 0; i < len; i++) {
+      Filter.SetCutoff(cut[i]);
+      out[i] = Filter.Process(out[i]);
+    }
+#endif
+    highpass2.processBlock(out, len);         // post-filtering, following open303
+    notch.processBlock(out, len);             // post-filtering, following open303
+    for (int i = 0; i < len; i++) out[i] = Drive.Process(out[i]);      // overdrive
+    for (int i = 0; i < len; i++) out[i] = Distortion.Process(out[i]); // distortion
+    for (int i = 0; i < len; i++) out[i] = out[i] * amp[i] * comp[i]; // amp envelope and compensation
+    _compens = comp[len - 1];
+
+    out += len;
+    n -= len;
+  }
+}
+
+
+inline float SynthVoice::oscSample() {
+  // return (float)((1.0f - _waveMix) * lookupTable(*(tables[_waveBase]), _phaze)) + (float)(_waveMix * lookupTable(*(tables[_waveBase+1]), _phaze)) ; // lookup and blend waveforms
+  return lookupWave(_waveTable, _waveMask, _waveScale, _waveSaw, _waveSquare, _phaze);
+}
+
+
+inline void SynthVoice::updateWave() {
+  _waveOct = mipmapOctave(_currentStep);
+  _waveTable = mipmapTable(_waveOct);
+  _waveMask = mipmapMask(_waveOct);
+  _waveScale = (float)(_waveMask + 1) * DIV_TABLE_SIZE;
+  _waveSquare = 0.66f * (1.0f - _waveMix); // exp-square is 0.66 * (saw(x) - saw(x + TABLE_SIZE/2))
+  _waveSaw = _waveMix + _waveSquare;
+}
+
+
+inline void SynthVoice::advancePhase() {
     if ((_slide || _portamento) && _deltaStep != 0.0f) {     // portamento / slide processing
       if (fabs(_effectiveStep - _currentStep) >= fabs(_deltaStep)) {
         _currentStep += _deltaStep;
@@ -112,38 +201,11 @@ inline float SynthVoice::getSample() {
       }
     }
 
-    // Increment and wrap phase
+    // Increment and wrap phase, the mipmaps are band-limited, so the pitch stays exact at any note
     _phaze += _currentStep;
-    /* 
-     *  // this is more accurate classical approach, but it gives quite early audible aliasing when not using band-limited samples
     if ( _phaze >= TABLE_SIZE) {
        _phaze -= TABLE_SIZE ;
-    */
-   
-     
-    // this is less accurate in terms of pitch, especially at higher notes, but at this price you have quite no aliasing, as phase reset produces no moire
-    if ( _phaze >= TABLE_SIZE) {
-      if (_wave_cnt == 3) { // we drop the phase every 4 periods
-        _wave_cnt = 0; 
-        _phaze = 0.0f; // we reset the phase, so aliasing will be present in the form of lower octave tones which is less annoying
-      } else {
-        _wave_cnt++;
-        _phaze -= TABLE_SIZE ;
-      }
-       
     }
-    
-    /*
-    // this is less accurate in terms of pitch, especially at higher notes, but at this price you have quite no aliasing, as phase reset produces no moire
-    if ( _phaze >= TABLE_SIZE) {
-      _phaze = 2.0f * (float)( (int)(0.5f * (_phaze - (float)TABLE_SIZE)) ); 
-      DEBF("%0.5f\r\n", _phaze);
-    }*/
-
-    
-    //synth_buf[_index][i] = fast_shape(samp); // mono limitter
-    return  samp;
-  
 }
 
 
@@ -190,7 +252,7 @@ inline void SynthVoice::ParseCC(uint8_t cc_number , uint8_t cc_value) {
       break;
     case CC_303_RESO:
       _reso = cc_value * MIDI_NORM ;
-      _flt_compens = one_div( bilinearLookup(norm1_tbl, _cutoff * 127.0f, cc_value ));
+      _flt_compens = one_div( lookupBilinear(norm1_tbl, _cutoff * 127.0f * NORM_TBL_KMAP, cc_value * NORM_TBL_KMAP));
       SetReso(_reso);
       break;
     case CC_303_DECAY: // Env release
@@ -205,7 +267,7 @@ inline void SynthVoice::ParseCC(uint8_t cc_number , uint8_t cc_value) {
       break;
     case CC_303_CUTOFF:
       _cutoff = (float)cc_value * MIDI_NORM;
-      _flt_compens = one_div( bilinearLookup(norm1_tbl, cc_value, _reso * 127.0f));
+      _flt_compens = one_div( lookupBilinear(norm1_tbl, cc_value * NORM_TBL_KMAP, _reso * 127.0f * NORM_TBL_KMAP));
       SetCutoff(_cutoff);
       break;
     case CC_303_DELAY_SEND:
@@ -222,12 +284,12 @@ inline void SynthVoice::ParseCC(uint8_t cc_number , uint8_t cc_value) {
       break;
     case CC_303_DISTORTION:
       _gain = (float)cc_value * MIDI_NORM ;
-      _fx_compens = one_div( bilinearLookup(norm2_tbl, _drive * 127.0f,  cc_value));
+      _fx_compens = one_div( lookupBilinear(norm2_tbl, _drive * 127.0f * NORM_TBL_KMAP, cc_value * NORM_TBL_KMAP));
       SetDistortionLevel(_gain);
       break;
     case CC_303_OVERDRIVE:
       _drive = (float)cc_value * MIDI_NORM ;
-      _fx_compens = one_div( bilinearLookup(norm2_tbl, cc_value, _gain * 127.0f));
+      _fx_compens = one_div( lookupBilinear(norm2_tbl, cc_value * NORM_TBL_KMAP, _gain * 127.0f * NORM_TBL_KMAP));
       SetOverdriveLevel(_drive);
       break;
     case CC_303_SATURATOR:
@@ -264,7 +326,7 @@ float SynthVoice::GetAmpEnv() {
         _ampEnvPosition = 0;
         _ampEnvVal = (-exp_tbl[ TABLE_SIZE - 1 ] + 1.0f) * 0.5f * _k_acc;
       } else {
-        _ampEnvVal = (-lookupTable(exp_tbl, _ampEnvPosition ) + 1.0f) * 0.5f * _k_acc;
+        _ampEnvVal = (-lookupLinear(exp_tbl, _ampEnvPosition ) + 1.0f) * 0.5f * _k_acc;
         if (_pass_val > _ampEnvVal) _ampEnvVal = _pass_val;
       }
       _pass_val = _ampEnvVal;
@@ -276,7 +338,7 @@ float SynthVoice::GetAmpEnv() {
         _ampEnvPosition = 0;
         _ampEnvVal = _sust_level;
       } else {
-        _ampEnvVal = _sust_level + (1.0f - _sust_level) * (lookupTable(exp_tbl, _ampEnvPosition) + 1.0f) * 0.5f * _k_acc;
+        _ampEnvVal = _sust_level + (1.0f - _sust_level) * (lookupLinear(exp_tbl, _ampEnvPosition) + 1.0f) * 0.5f * _k_acc;
       }
       _pass_val = _ampEnvVal;
       break;
@@ -292,7 +354,7 @@ float SynthVoice::GetAmpEnv() {
         _ampEnvVal = 0.0f;
       } else {
         if (_ampEnvPosition <= _ampEnvReleaseStep) _release_lvl = _pass_val;
-        _ampEnvVal = _release_lvl * (lookupTable(exp_tbl, _ampEnvPosition) + 1.0f) * 0.5f * _k_acc;
+        _ampEnvVal = _release_lvl * (lookupLinear(exp_tbl, _ampEnvPosition) + 1.0f) * 0.5f * _k_acc;
       }
       _ampEnvPosition += _ampEnvReleaseStep;
       _pass_val = _ampEnvVal;
@@ -331,7 +393,7 @@ inline float SynthVoice::GetFilterEnv() {
         _filterEnvPosition = 0.0f;
         _filterEnvVal = (-exp_tbl[ TABLE_SIZE - 1 ] + 1.0f) * 0.5f ;
       } else {
-        _filterEnvVal = (-lookupTable(exp_tbl, _filterEnvPosition) + 1.0f) * 0.5f  ;
+        _filterEnvVal = (-lookupLinear(exp_tbl, _filterEnvPosition) + 1.0f) * 0.5f  ;
       }
       _filterEnvPosition += _filterEnvAttackStep;
       break;
@@ -341,7 +403,7 @@ inline float SynthVoice::GetFilterEnv() {
         _filterEnvPosition = 0.0f;
         _filterEnvVal = 0.0f;
       } else {
-        _filterEnvVal =  (lookupTable(exp_tbl, _filterEnvPosition) + 1.0f) * 0.5f  ;
+        _filterEnvVal =  (lookupLinear(exp_tbl, _filterEnvPosition) + 1.0f) * 0.5f  ;
       }
       _filterEnvPosition += _filterEnvDecayStep;
       _offset *= _offset_leak;
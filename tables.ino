@@ -38,11 +38,51 @@ float sin_fill(uint16_t i) {
   return res;
 }
 
-float expSquare_fill(uint16_t i) { // requires exp() table
-  uint16_t j = i + 0.5f*TABLE_SIZE;
-  if (j>=TABLE_SIZE) j = j - TABLE_SIZE;
-  float res = 0.66f * (saw_tbl[i]-saw_tbl[j]);
-  return res;
+void buildMipmaps() { // band-limited copies of saw_tbl, one per octave of the phase step, requires saw and sin tables
+  // exp-square is 0.66 * (saw(x) - saw(x + TABLE_SIZE/2)), lookupWave() derives it, so only the saw is stored
+  const int harmonics = TABLE_SIZE / 4; // nothing above is ever kept
+  float* re = (float*)malloc(sizeof(float) * harmonics * 2);
+  if (re == NULL) { // no room for the spectrum: plain copies of saw_tbl, aliased, but the oscillator still plays
+    DEBUG("buildMipmaps: out of memory, the oscillator falls back to saw_tbl");
+    for (int k = 0; k < WAVE_MIPMAPS; k++) {
+      float* t = (float*)mipmapTable(k);
+      int32_t size = mipmapMask(k) + 1;
+      for (int i = 0; i < size; i++) t[i] = saw_tbl[i * (TABLE_SIZE / size)];
+      t[size] = t[0]; // guard point
+    }
+    return;
+  }
+  float* im = re + harmonics;
+  float dc = 0.0f;
+  for (int i = 0; i < TABLE_SIZE; i++) dc += saw_tbl[i];
+  dc *= DIV_TABLE_SIZE;
+  // plain DFT, the integer arguments make sin_tbl exact: sin(2*pi*h*i/N) = sin_tbl[(h*i) & TABLE_MASK]
+  re[0] = im[0] = 0.0f;
+  for (int h = 1; h < harmonics; h++) {
+    float a = 0.0f, b = 0.0f;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+      a += saw_tbl[i] * sin_tbl[(h * i + TABLE_SIZE / 4) & TABLE_MASK];
+      b += saw_tbl[i] * sin_tbl[(h * i) & TABLE_MASK];
+    }
+    re[h] = a * 2.0f * DIV_TABLE_SIZE;
+    im[h] = b * 2.0f * DIV_TABLE_SIZE;
+  }
+  // level k stays alias-free up to a step of 2^(k+1): it keeps the harmonics below TABLE_SIZE/4 >> k, sampled
+  // at every r-th point of saw_tbl's grid
+  for (int k = 0; k < WAVE_MIPMAPS; k++) {
+    int top = harmonics >> k;
+    float* t = (float*)mipmapTable(k);
+    int32_t size = mipmapMask(k) + 1, r = TABLE_SIZE / size;
+    for (int i = 0; i < size; i++) {
+      float res = dc;
+      for (int h = 1; h < top; h++) {
+        res += re[h] * sin_tbl[(h * i * r + TABLE_SIZE / 4) & TABLE_MASK] + im[h] * sin_tbl[(h * i * r) & TABLE_MASK];
+      }
+      t[i] = res;
+    }
+    t[size] = t[0]; // guard point
+  }
+  free(re);
 }
 
 float freqToPhaseInc(float freq, uint16_t sampleSize, uint16_t sampleRate) {
@@ -62,13 +102,13 @@ void buildTables() {
   }
 
   for (int i = 0; i <= TABLE_SIZE; i++) {
-    exp_square_tbl[i] = expSquare_fill(i);
     shaper_tbl[i] = shaper_fill(i); 
     knob_tbl[i] = knob_fill(i);
 	  sin_tbl[i]  = sin_fill(i);
   //  saw_tbl[i] = 1.0f - 2.0f * (float)i * (float)DIV_TABLE_SIZE;
   //  square_tbl[i] = (i>TABLE_SIZE/2) ? 1.0f : -1.0f; 
   }
+  buildMipmaps();
   for (int i = 0; i < 16; i++) {
     for (int j = 0; j < 16; j++){
       norm1_tbl[i][j] = cutoff_reso_avg + (cutoff_reso[i][j] - cutoff_reso_avg) * NORM1_DEPTH;
@@ -0,0 +1,39 @@
+/*
+ * VoiceBank: SYNTH_VOICES 303 voices.
+ *
+ * Voice v listens to MIDI channel SYNTH1_MIDI_CHAN + v. It has its own event queue, its own mono buffer in
+ * every AudioBlock, and its own mixer strip: pan and the delay/reverb sends, which the voice keeps (CC 10, 91, 92).
+ * Every voice is an engine of the load balancer, so the bank spreads over both cores.
+ */
+#ifndef VOICE_BANK_H
+#define VOICE_BANK_H
+
+static_assert(SYNTH_VOICES >= 1 && SYNTH_VOICES <= 7, "the load balancer handles up to 7 voices plus the drums");
+static_assert(DRUM_MIDI_CHAN < SYNTH1_MIDI_CHAN || DRUM_MIDI_CHAN >= SYNTH1_MIDI_CHAN + SYNTH_VOICES, "a voice would take the drums' MIDI channel");
+
+class VoiceBank {
+  public:
+    VoiceBank() {
+      for (int v = 0; v < SYNTH_VOICES; v++) _voices[v].SetIndex(v); // to recognize them from the inside
+    }
+
+    void Init() {
+      for (int v = 0; v < SYNTH_VOICES; v++) _voices[v].Init();
+    }
+
+    inline SynthVoice& Voice(int v)   { return _voices[v]; }
+    inline MidiQueue& Events(int v)   { return _events[v]; }
+
+    // the voice on a MIDI channel, -1 if none
+    static inline int GetVoice(uint8_t channel) {
+      int v = (int)channel - SYNTH1_MIDI_CHAN;
+      return (v >= 0 && v < SYNTH_VOICES) ? v : -1;
+    }
+    static inline uint8_t GetChannel(int v) { return SYNTH1_MIDI_CHAN + v; }
+
+  private:
+    SynthVoice _voices[SYNTH_VOICES];
+    MidiQueue _events[SYNTH_VOICES];    // MIDI on its way from loop() to whichever core renders the voice
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * WavConverter: the sample data of a WAV as mono 16 bit frames at the engine's rate, for the sampler's loader
+ * and the kit packer (host/kitpack.h). So the sampler's store and render loop only ever see one format.
+ *
+ * It takes 8 bit (unsigned), 16, 24 and 32 bit PCM and 32 bit float, also as WAVE_FORMAT_EXTENSIBLE, with any
+ * number of channels, which it averages to mono. If the rate differs, a windowed sinc resamples it. Begin()
+ * makes the polyphase table, with the cutoff below the lower of the two Nyquist frequencies, so a sample that
+ * goes down in rate doesn't alias. Going down, the kernel gets wider by the ratio, and a file more than
+ * WAV_CONVERT_MAX_RATIO times the target rate is turned down, with the reason in Refused(). 16 bit mono at the
+ * target rate is Native(): the loader reads that straight into its store.
+ *
+ * The read buffer, the ring and the table are allocated by Begin() and freed by End(), so they only take memory
+ * while a sample loads, and the table only as many taps as the ratio needs.
+ */
+#ifndef WAV_CONVERT_H
+#define WAV_CONVERT_H
+
+#include <math.h>
+#include <stdlib.h>
+#include "kit_image.h"
+
+#define WAV_CONVERT_TAPS      16    // input frames under the kernel when the rate goes up, times the ratio going down
+#define WAV_CONVERT_MAX_RATIO 8     // 352.8 kHz to 44.1 kHz, 128 taps and a 33 KB table
+#define WAV_CONVERT_PHASES    64
+#define WAV_CONVERT_CUTOFF    0.9f  // of the lower Nyquist frequency
+#define WAV_CONVERT_BUF       1536  // bytes of WAV data per read
+
+class WavConverter {
+  public:
+    WavConverter() {}
+    ~WavConverter() { End(); }
+    WavConverter( const WavConverter& ) = delete;
+    WavConverter& operator=( const WavConverter& ) = delete;
+
+    // bytes is what the data chunk holds, rate the output rate. False if the format isn't one of the above,
+    // the rate goes down too far or there's no memory for the conversion: Refused() says which.
+    bool Begin( const WavInfo &info, uint32_t bytes, uint32_t rate ) {
+      End();
+      _format = info.format;
+      _channels = info.channels;
+      _bits = info.bits;
+      _blockAlign = info.blockAlign ? info.blockAlign : _channels * _bits / 8;
+      bool pcm = ( _format == WAV_FORMAT_PCM && ( _bits == 8 || _bits == 16 || _bits == 24 || _bits == 32 ) );
+      bool flt = ( _format == WAV_FORMAT_FLOAT && _bits == 32 );
+      if ( !( pcm || flt ) || _channels == 0 || _blockAlign != _channels * _bits / 8 || info.sampleRate == 0 || rate == 0 ) {
+        _refused = "not a PCM or float WAV";
+        return false;
+      }
+      uint32_t ratio = ( info.sampleRate + rate - 1 ) / rate;
+      if ( ratio > WAV_CONVERT_MAX_RATIO ) {
+        _refused = "rate too far above the target";
+        return false;
+      }
+      _native = ( pcm && _bits == 16 && _channels == 1 && info.sampleRate == rate );
+      _inLeft = bytes / _blockAlign;
+      _step = ( (uint64_t)info.sampleRate << 32 ) / rate;
+      _outFrames = ( info.sampleRate == rate ) ? _inLeft : ( (uint64_t)_inLeft * rate + info.sampleRate - 1 ) / info.sampleRate;
+      _outPos = 0;
+      _inPos = 0;
+      _bufPos = _bufLen = 0;
+      _short = false;
+      _taps = ( info.sampleRate != rate ) ? WAV_CONVERT_TAPS * ratio : 0;
+      _ringMask = 0;
+      while ( _ringMask + 1 < (uint32_t)_taps ) _ringMask = _ringMask * 2 + 1;  // a power of 2 that holds the taps
+      size_t floats = _taps > 0 ? ( _ringMask + 1 ) + ( WAV_CONVERT_PHASES + 1 ) * _taps : 0;
+      _mem = (float*)malloc( floats * sizeof(float) + WAV_CONVERT_BUF );
+      if ( _mem == NULL ) {
+        _refused = "out of memory";
+        return false;
+      }
+      _ring = _mem;
+      _table = _mem + ( _taps > 0 ? _ringMask + 1 : 0 );
+      _buf = (uint8_t*)( _mem + floats );
+      if ( _taps > 0 ) {
+        for ( uint32_t k = 0; k <= _ringMask; k++ ) _ring[k] = 0.0f;
+        float fc = WAV_CONVERT_CUTOFF * ( rate < info.sampleRate ? (float)rate / info.sampleRate : 1.0f );
+        for ( int p = 0; p <= WAV_CONVERT_PHASES; p++ ) {
+          float frac = (float)p / WAV_CONVERT_PHASES, sum = 0.0f;
+          for ( int t = 0; t < _taps; t++ ) {
+            float x = t - ( _taps / 2 - 1 ) - frac;
+            float w = x * (float)M_PI / ( 0.5f * _taps );
+            float window = ( fabsf(x) < 0.5f * _taps ) ? 0.42f + 0.5f * cosf(w) + 0.08f * cosf(2.0f * w) : 0.0f;
+            float a = (float)M_PI * fc * x;
+            _table[p * _taps + t] = window * ( ( fabsf(a) < 1e-6f ) ? 1.0f : sinf(a) / a );
+            sum += _table[p * _taps + t];
+          }
+          for ( int t = 0; t < _taps; t++ ) _table[p * _taps + t] /= sum;
+        }
+      }
+      _refused = NULL;
+      return true;
+    }
+
+    // frees what Begin() took, once the sample is read
+    void End() {
+      free( _mem );
+      _mem = NULL;
+    }
+
+    uint32_t Frames() const { return _outFrames; }
+    bool Native() const { return _native; }
+    const char* Refused() const { return _refused; }
+
+    // the next n output frames, false if the file ended early (the missing frames are silence)
+    template <class F>
+    bool Read( F &f, int16_t *out, size_t n ) {
+      for ( size_t k = 0; k < n; k++, _outPos++ ) {
+        float x;
+        if ( _step == ( (uint64_t)1 << 32 ) ) {
+          x = Input( f );
+        } else {
+          uint64_t pos = _outPos * _step;
+          uint32_t src = pos >> 32;
+          while ( _inPos <= src + _taps / 2 ) {
+            _ring[ _inPos & _ringMask ] = Input( f );
+            _inPos++;
+          }
+          const float* h = _table + (int)( (uint32_t)pos * ( WAV_CONVERT_PHASES / 4294967296.0f ) + 0.5f ) * _taps;
+          uint32_t first = src - ( _taps / 2 - 1 );
+          x = 0.0f;
+          for ( int t = 0; t < _taps; t++ ) x += h[t] * _ring[ ( first + t ) & _ringMask ];
+        }
+        long v = lrintf( x );
+        out[k] = v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+      }
+      return !_short;
+    }
+
+  private:
+    // the next input frame, averaged to mono, in 16 bit scale
+    template <class F>
+    float Input( F &f ) {
+      if ( _inLeft == 0 ) {
+        return 0.0f;
+      }
+      if ( _bufPos >= _bufLen ) {
+        size_t n = WAV_CONVERT_BUF / _blockAlign;
+        if ( n > _inLeft ) n = _inLeft;
+        _bufLen = f.read( _buf, n * _blockAlign ) / _blockAlign * _blockAlign;
+        _bufPos = 0;
+        if ( _bufLen == 0 ) {
+          _short = true;
+          _inLeft = 0;
+          return 0.0f;
+        }
+      }
+      const uint8_t* b = _buf + _bufPos;
+      float sum = 0.0f;
+      for ( int c = 0; c < _channels; c++ ) {
+        switch ( _bits ) {
+          case 8:   sum += ( b[0] - 128 ) * 256.0f; b += 1; break;
+          case 16:  sum += (int16_t)( b[0] | ( b[1] << 8 ) ); b += 2; break;
+          case 24:  sum += (int32_t)( ( b[0] << 8 ) | ( b[1] << 16 ) | ( (uint32_t)b[2] << 24 ) ) * ( 1.0f / 65536.0f ); b += 3; break;
+          default:
+            uint32_t u = b[0] | ( b[1] << 8 ) | ( b[2] << 16 ) | ( (uint32_t)b[3] << 24 );
+            if ( _format == WAV_FORMAT_FLOAT ) {
+              float v;
+              memcpy( &v, &u, 4 );
+              sum += v * 32768.0f;
+            } else {
+              sum += (int32_t)u * ( 1.0f / 65536.0f );
+            }
+            b += 4;
+            break;
+        }
+      }
+      _bufPos += _blockAlign;
+      _inLeft--;
+      return ( _channels == 1 ) ? sum : sum / _channels;
+    }
+
+    uint16_t _format, _channels, _bits, _blockAlign;
+    int _taps;                // 0 at the same rate
+    uint32_t _ringMask;       // input frames kept for the taps, minus 1
+    bool _native, _short;
+    uint32_t _inLeft;         // input frames not read yet
+    uint32_t _inPos;          // input frames in the ring so far
+    uint32_t _outFrames;
+    uint64_t _outPos;
+    uint64_t _step;           // input frames per output frame, 32.32 fixed point
+    size_t _bufPos, _bufLen;
+    const char* _refused = NULL;
+    float* _mem = NULL;       // one block for the three below, from Begin() to End()
+    float* _ring;
+    float* _table;            // WAV_CONVERT_PHASES + 1 rows of _taps
+    uint8_t* _buf;            // WAV_CONVERT_BUF bytes
+};
+
+#endif
@@ -32,6 +32,8 @@ class Wavefolder {
     */
     inline void SetOffset(float offset) { offset_ = offset; }
 
+    friend class SynthKernel;  // reads gain and offset
+
   private:
     float gain_, offset_, compens_;
 };